@@ -0,0 +1,101 @@
+#ifndef ARCHIVESTORE_H
+#define ARCHIVESTORE_H
+
+#include <QString>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include "journalentry.h"
+
+/**
+ * @brief Cold storage for old entries in compressed monthly archives
+ * 
+ * Entries are grouped by creation month into one archive file each
+ * (e.g. "2019-03.jarc"). Every entry is compressed into its own block and
+ * a footer index records each entry's key, id, title, dates and block
+ * location, so loading an archive reads only the index and a single entry
+ * can be decompressed on demand.
+ * 
+ * All methods are thread-safe.
+ */
+class ArchiveStore
+{
+public:
+    /**
+     * @brief Metadata kept in memory for every archived entry
+     */
+    struct ArchivedEntry {
+        QString key;
+        QString id;          // Stable entry id, so it survives reloads
+        QString title;
+        QDateTime createdAt;
+        QDateTime modifiedAt;
+        QString month;       // Archive the entry lives in, as yyyy-MM
+        qint64 offset;       // Start of the compressed block
+        qint64 size;         // Length of the compressed block
+    };
+    
+    explicit ArchiveStore(const QString& directory);
+    
+    /**
+     * @brief Read the index of every archive file in the directory
+     */
+    void load();
+    
+    bool contains(const QString& key) const;
+    QList<ArchivedEntry> entries() const;
+    
+    /**
+     * @brief Decompress a single archived entry
+     * @return The entry, or an empty entry if it is not archived
+     */
+    JournalEntry readEntry(const QString& key) const;
+    
+    /**
+     * @brief Add entries to their monthly archives
+     * @param entries Entries to archive, keyed by their storage key
+     * @return true if every affected archive was written
+     */
+    bool addEntries(const QHash<QString, JournalEntry>& entries);
+    
+    /**
+     * @brief Remove an entry from its archive
+     * @return true if the entry was archived and has been removed
+     */
+    bool removeEntry(const QString& key);
+    
+private:
+    struct Block {
+        ArchivedEntry meta;
+        QByteArray data;     // Compressed entry text
+    };
+    
+    QString m_directory;
+    QHash<QString, ArchivedEntry> m_index;
+    mutable QMutex m_mutex;
+    
+    QString archivePath(const QString& month) const;
+    bool loadArchive(const QString& month);
+    QByteArray readBlock(const ArchivedEntry& meta) const;
+    
+    /**
+     * @brief Read the blocks a rewrite of a month archive must carry over
+     * @return false if any block could not be read in full; the archive
+     *         must then not be rewritten or those entries would be lost
+     */
+    bool readBlocksExcept(const QString& month, const QSet<QString>& excluded,
+                          QList<Block> *blocks) const;
+    
+    /**
+     * @brief Rewrite a month archive without some of its entries
+     * 
+     * Deletes the archive if nothing is left in it. Leaves the index
+     * entries of @p keys alone.
+     */
+    bool rewriteWithout(const QString& month, const QSet<QString>& keys);
+    bool writeArchive(const QString& month, QList<Block>& blocks);
+};
+
+#endif // ARCHIVESTORE_H
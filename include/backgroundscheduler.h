@@ -0,0 +1,117 @@
+#ifndef BACKGROUNDSCHEDULER_H
+#define BACKGROUNDSCHEDULER_H
+
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QFuture>
+#include <QPromise>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+/**
+ * @brief Thread pool shared by every open journal
+ *
+ * Work is tagged with the journal it belongs to (its owner). Tasks of the
+ * active owner are always started first and may use every worker; tasks
+ * of other owners are limited to a single worker between them and pause
+ * at yield() points while foreground work is queued or running. Long
+ * tasks are expected to call yield() between units of work so switching
+ * journals takes effect without waiting for them to finish.
+ */
+class BackgroundScheduler
+{
+public:
+    static BackgroundScheduler& instance();
+    
+    /**
+     * @brief Give @p owner's work priority over everyone else's
+     */
+    void setActiveOwner(const void *owner);
+    bool isActive(const void *owner) const;
+    
+    void submit(const void *owner, std::function<void()> task);
+    
+    /**
+     * @brief Queue @p function and return a future for its result
+     *
+     * The future is cancelled if the task is dropped by cancel() before
+     * it starts.
+     */
+    template <typename Function>
+    auto run(const void *owner, Function function) -> QFuture<std::invoke_result_t<Function>>;
+    
+    /**
+     * @brief Pause point for long-running tasks
+     *
+     * Returns at once for the active owner. Background owners wait here
+     * while foreground work is pending.
+     *
+     * @return false if @p owner was cancelled and the task should stop
+     */
+    bool yield(const void *owner);
+    
+    /**
+     * @brief Drop @p owner's queued tasks and wait for its running ones
+     *
+     * Must not be called from one of @p owner's own tasks.
+     */
+    void cancel(const void *owner);
+
+private:
+    BackgroundScheduler();
+    ~BackgroundScheduler();
+    Q_DISABLE_COPY(BackgroundScheduler)
+    
+    struct Task {
+        const void *owner;
+        std::function<void()> run;
+    };
+    
+    int nextTaskIndex() const;
+    bool foregroundPending() const;
+    void startWorkers();
+    void workerLoop();
+    
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    QList<Task> m_queue;
+    const void *m_activeOwner;
+    int m_workers;
+    int m_foregroundRunning;
+    int m_backgroundRunning;
+    int m_yielding;             // Workers paused in yield()
+    QHash<const void *, int> m_running;
+    QSet<const void *> m_cancelled;
+    
+    // Declared last so its threads are joined before the queues go away
+    QThreadPool m_pool;
+};
+
+template <typename Function>
+auto BackgroundScheduler::run(const void *owner, Function function) -> QFuture<std::invoke_result_t<Function>>
+{
+    using Result = std::invoke_result_t<Function>;
+    
+    // std::function needs a copyable callable, QPromise is move-only
+    auto promise = std::make_shared<QPromise<Result>>();
+    QFuture<Result> future = promise->future();
+    
+    submit(owner, [promise, function]() mutable {
+        promise->start();
+        if constexpr (std::is_void_v<Result>) {
+            function();
+        } else {
+            promise->addResult(function());
+        }
+        promise->finish();
+    });
+    
+    return future;
+}
+
+#endif // BACKGROUNDSCHEDULER_H
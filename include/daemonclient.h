@@ -0,0 +1,78 @@
+#ifndef DAEMONCLIENT_H
+#define DAEMONCLIENT_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QDateTime>
+#include <QLocalSocket>
+#include <QCoreApplication>
+#include "daemonprotocol.h"
+
+/**
+ * @brief Blocking connection to the current user's jrnl daemon
+ *
+ * Every call waits for its reply, so a client can be used from any one
+ * thread without an event loop. Callers treat a failed connection as
+ * "no daemon" and do the work themselves.
+ */
+class DaemonClient
+{
+    Q_DECLARE_TR_FUNCTIONS(DaemonClient)
+
+public:
+    struct EntrySummary {
+        QString id;
+        QString filePath;
+        QString title;
+        QDateTime createdAt;
+    };
+    
+    /**
+     * @brief An entry file as the daemon last read it
+     */
+    struct SnapshotEntry {
+        qint64 version;     // File modification time in ms when read
+        QByteArray text;    // Markdown, as MarkdownFormat::serialize() writes it
+    };
+    
+    DaemonClient();
+    ~DaemonClient();
+    
+    /**
+     * @brief Connect and check that the daemon speaks this protocol
+     * @return false if no compatible daemon answers in time
+     */
+    bool connectToDaemon();
+    bool isConnected() const;
+    
+    /**
+     * @brief Entries of a journal, oldest first
+     * @param filter Frontmatter filter as for FileManager::entriesMatching(), or empty
+     */
+    bool listEntries(const QString& journal, const QString& filter,
+                     QList<EntrySummary> *entries, QString *error = nullptr);
+    
+    /**
+     * @brief An entry named by its id or its path, as Markdown
+     * @param entry Id, or file path absolute or relative to the journal
+     */
+    bool readEntry(const QString& journal, const QString& entry,
+                   QString *filePath, QString *text, QString *error = nullptr);
+    
+    /**
+     * @brief Every entry file of a Markdown journal, keyed by relative path
+     */
+    bool snapshot(const QString& journal, QHash<QString, SnapshotEntry> *entries);
+    bool shutdown();
+
+private:
+    bool request(DaemonProtocol::Message type, const QByteArray& arguments,
+                 QByteArray *results, QString *error);
+    
+    QLocalSocket m_socket;
+    QByteArray m_buffer;
+    quint32 m_nextRequestId;
+};
+
+#endif // DAEMONCLIENT_H
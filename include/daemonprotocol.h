@@ -0,0 +1,65 @@
+#ifndef DAEMONPROTOCOL_H
+#define DAEMONPROTOCOL_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDataStream>
+
+/**
+ * @brief Wire format between the jrnl daemon and its clients
+ *
+ * Messages travel over a local socket as frames: a little-endian 32-bit
+ * length, then that many bytes of QDataStream data. Each request starts
+ * with its type and an id that the reply repeats; the arguments and
+ * results of each type are listed below.
+ */
+namespace DaemonProtocol {
+
+const quint32 VERSION = 1;
+const QDataStream::Version STREAM_VERSION = QDataStream::Qt_6_0;
+
+enum class Message : quint8 {
+    Hello = 1,      // version -> version
+    ListEntries,    // journal, filter -> count, then (id, path, title, created) each
+    ReadEntry,      // journal, id or path -> path, Markdown text
+    Snapshot,       // journal -> count, then (key, file time ms, Markdown text) each
+    Shutdown,       // -> nothing
+    Reply = 0x80,
+    Failure         // -> message
+};
+
+enum class FrameStatus {
+    Incomplete,     // Wait for more data
+    Complete,
+    Invalid         // Larger than any genuine message; drop the peer
+};
+
+/**
+ * @brief Name of the current user's daemon socket
+ */
+QString serverName();
+
+QByteArray frame(const QByteArray& payload);
+
+/**
+ * @brief Stream values into a message body
+ */
+template<typename... Args>
+QByteArray encode(const Args&... args)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(STREAM_VERSION);
+    (stream << ... << args);
+    return data;
+}
+
+/**
+ * @brief Remove the first whole frame from a receive buffer
+ * @param payload Set to the frame's payload when it is complete
+ */
+FrameStatus takeFrame(QByteArray *buffer, QByteArray *payload);
+
+} // namespace DaemonProtocol
+
+#endif // DAEMONPROTOCOL_H
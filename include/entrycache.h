@@ -0,0 +1,58 @@
+#ifndef ENTRYCACHE_H
+#define ENTRYCACHE_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QMutex>
+#include <QString>
+#include "journalentry.h"
+
+/**
+ * @brief Memory-budgeted LRU cache of parsed entries
+ * 
+ * Entries are costed by the memory their text occupies and the least
+ * recently used ones are evicted once the budget is exceeded. Each entry
+ * is stored with a version stamp (the file's modification time for
+ * Markdown files) and a lookup only hits if the stamp still matches, so
+ * files changed behind our back are re-read.
+ * 
+ * All methods are thread-safe.
+ */
+class EntryCache
+{
+public:
+    explicit EntryCache(qint64 maxBytes);
+    
+    /**
+     * @brief Look up an entry
+     * @param version Current version stamp of the entry
+     * @return true and fills @p entry if a matching version is cached
+     */
+    bool find(const QString& key, const QDateTime& version, JournalEntry *entry);
+    bool contains(const QString& key, const QDateTime& version) const;
+    
+    /**
+     * @brief Cache an entry
+     * @param replace Whether to overwrite an entry already cached under the
+     *                key even if its version is as new; prefetching passes
+     *                false so it never replaces a copy stored by a save,
+     *                but still replaces one that is out of date
+     */
+    void insert(const QString& key, const JournalEntry& entry, const QDateTime& version,
+                bool replace = true);
+    void remove(const QString& key);
+    void clear();
+    
+    void setMaxBytes(qint64 maxBytes);
+    
+private:
+    struct Item {
+        JournalEntry entry;
+        QDateTime version;
+    };
+    
+    QCache<QString, Item> m_cache;
+    mutable QMutex m_mutex;
+};
+
+#endif // ENTRYCACHE_H
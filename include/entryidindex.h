@@ -0,0 +1,63 @@
+#ifndef ENTRYIDINDEX_H
+#define ENTRYIDINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+/**
+ * @brief Two-way map between stable entry ids and storage keys
+ *
+ * An entry's id is written to its frontmatter on save and never changes,
+ * while its key follows the file through renames and moves. Anything
+ * that must keep pointing at an entry holds the id and looks the key up
+ * here when it needs the file.
+ *
+ * Entries saved before ids existed get one in memory when indexed; it is
+ * written out on their next save. When a file's own id is adopted, the
+ * id it had in memory stays valid as an alias, so references taken
+ * earlier in the session still resolve.
+ */
+class EntryIdIndex
+{
+public:
+    EntryIdIndex();
+    
+    /**
+     * @brief Record the entry stored under a key
+     * @param id Id from the entry's frontmatter, or empty
+     * @param claim Take @p id from another entry already holding it,
+     *        which gets a fresh one
+     * @return The id the entry goes by: @p id, unless it is empty or
+     *         another entry already holds it (as with a copied file) and
+     *         @p claim is false, in which case a fresh one
+     */
+    QString insert(const QString& key, const QString& id, bool claim = false);
+    
+    /**
+     * @brief Key of the entry other than @p key that holds @p id, if any
+     */
+    QString conflictingKey(const QString& key, const QString& id) const;
+    void removeKey(const QString& key);
+    
+    /**
+     * @brief Follow an entry to a new key, keeping its ids
+     */
+    void renameKey(const QString& from, const QString& to);
+    void clear();
+    
+    QString keyForId(const QString& id) const { return m_keysById.value(id); }
+    QString idForKey(const QString& key) const;
+    bool containsKey(const QString& key) const { return m_idsByKey.contains(key); }
+    
+    static QString createId();
+
+private:
+    QString assign(const QString& key, const QString& id);
+    void release(const QString& key, const QString& id);
+    
+    QHash<QString, QString> m_keysById;
+    QHash<QString, QStringList> m_idsByKey;     // Current id first, then aliases
+};
+
+#endif // ENTRYIDINDEX_H
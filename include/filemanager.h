@@ -4,42 +4,270 @@
 #include <QString>
 #include <QList>
 #include <QDir>
+#include <QFuture>
+#include <QMutex>
+#include <functional>
+#include <memory>
 #include "journalentry.h"
+#include "storagebackend.h"
+#include "revisionstore.h"
+#include "linkgraph.h"
+#include "timelineindex.h"
+#include "similarityindex.h"
+#include "metadatastore.h"
+#include "entryidindex.h"
+#include "entrycache.h"
+
+class ArchiveStore;
 
 /**
  * @brief Manages journal entry storage as Markdown files
  * 
  * This class handles reading and writing journal entries to/from
  * Markdown files, ensuring portability and long-term durability.
+ * The actual persistence is delegated to a StorageBackend selected per
+ * journal, either one Markdown file per entry or a packed single file.
  */
 class FileManager
 {
 public:
+    /**
+     * @brief On-disk arrangement of entry files
+     * 
+     * Flat keeps every entry in the journal directory itself. Sharded
+     * places each entry under a YYYY/MM/ subdirectory derived from its
+     * creation date so no single directory grows without bound.
+     */
+    enum class Layout {
+        Flat,
+        Sharded
+    };
+    
+    /**
+     * @brief Where entries are persisted
+     */
+    enum class Backend {
+        Markdown,   // One .md file per entry (default)
+        Packed      // Single append-only pack file
+    };
+    
     FileManager();
     explicit FileManager(const QString& journalDirectory);
+    ~FileManager();
     
     // Directory management
     QString journalDirectory() const { return m_journalDir.absolutePath(); }
     void setJournalDirectory(const QString& path);
     bool ensureDirectoryExists();
     
+    // Layout management
+    Layout layout() const { return m_layout; }
+    void setLayout(Layout layout);
+    
+    /**
+     * @brief Move flat entry files into their YYYY/MM/ shards
+     * 
+     * Switches the journal to the sharded layout first so new entries
+     * land in shards immediately, then moves existing files one at a time
+     * with atomic renames. Entries stay readable throughout and an
+     * interrupted migration can simply be run again.
+     * 
+     * @param progress Optional callback receiving (done, total); returning
+     *                 false stops the migration after the current file
+     * @return Number of files moved
+     */
+    int migrateToShardedLayout(const std::function<bool(int, int)>& progress = {});
+    
+    // Storage backend
+    Backend backend() const { return m_backendType; }
+    
+    /**
+     * @brief The backend a journal is configured for, without loading it
+     */
+    static Backend journalBackend(const QString& journalDirectory);
+    
+    /**
+     * @brief Switch the journal to another storage backend
+     * 
+     * Copies every entry into the new backend, records the choice in the
+     * journal configuration and then removes the old representation.
+     * 
+     * @return true if the journal now uses the requested backend
+     */
+    bool setBackend(Backend backend);
+    
+    /**
+     * @brief Export all entries as Markdown files into a directory
+     * @param directory Target directory, keeping the journal's relative paths
+     * @return true if every entry was exported
+     */
+    bool exportToMarkdown(const QString& directory);
+    
     // Entry operations
-    bool saveEntry(JournalEntry& entry);  // Non-const to allow updating file path
+    bool saveEntry(JournalEntry& entry);  // Non-const to allow updating file path and id
+    
+    /**
+     * @brief Load an entry, served from the entry cache when still current
+     */
     JournalEntry loadEntry(const QString& filePath);
-    QList<JournalEntry> loadAllEntries();
+    
+    /**
+     * @brief Current path of the entry with a stable id, or empty if unknown
+     */
+    QString entryPath(const QString& id) const;
+    QString entryId(const QString& filePath) const;
+    
+    /**
+     * @brief Path of the entry named by an id, or by a file path absolute
+     *        or relative to the journal, or empty if there is none
+     */
+    QString findEntry(const QString& reference) const;
+    
+    /**
+     * @brief Warm the entry cache in the background
+     * 
+     * Replaces any prefetch still pending, so callers can pass the
+     * neighbours of each new selection without requests piling up.
+     * 
+     * @param filePaths Entries to load, most likely to be needed first
+     */
+    void prefetch(const QStringList& filePaths);
+    
+    /**
+     * @brief Load every entry in the journal, oldest first
+     * 
+     * Archived entries are returned with metadata only (their content is
+     * left empty); call loadEntry() to decompress one.
+     * 
+     * @param fromDaemon Take entry text from a running jrnl daemon. Only
+     *        files that have not changed since the daemon read them are
+     *        taken from it; the rest, or all of them without a daemon,
+     *        are read from disk as usual. Asking the daemon may wait on
+     *        it rescanning the journal, so this is for background loads.
+     */
+    QList<JournalEntry> loadAllEntries(bool fromDaemon = false);
+    
     bool deleteEntry(const QString& filePath);
     
+    /**
+     * @brief Decompress every archived entry
+     * 
+     * Safe to call from a worker thread; pass the result to indexEntries()
+     * on the owning thread to add archived content to the indexes. Run
+     * through the BackgroundScheduler with this manager as owner, it gives
+     * way to the active journal and stops early if the work is cancelled.
+     */
+    QList<JournalEntry> loadArchivedEntries() const;
+    void indexEntries(const QList<JournalEntry>& entries);
+    
+    // Timeline
+    
+    /**
+     * @brief Paths of entries created within [from, to], oldest first
+     * 
+     * Answered from the timeline index kept current by loadAllEntries(),
+     * saveEntry() and deleteEntry(); an invalid bound leaves that end open.
+     */
+    QStringList entriesInRange(const QDateTime& from, const QDateTime& to) const;
+    int entryCountOn(const QDate& date) const;
+    
+    // Link and tag graph
+    QStringList backlinks(const QString& filePath) const;
+    QStringList tags() const;
+    QStringList entriesWithTag(const QString& tag) const;
+    
+    /**
+     * @brief Paths of the entries whose wording is closest to an entry's
+     * @param count Maximum number of entries, most similar first
+     */
+    QStringList relatedEntries(const QString& filePath, int count);
+    
+    /**
+     * @brief Paths of the entries whose frontmatter matches a filter
+     * @param filter Expression such as `project=alpha AND mood>=4`, see MetadataStore
+     * @param error Set to what is wrong with the filter, if anything
+     * @return false if the filter cannot be parsed
+     */
+    bool entriesMatching(const QString& filter, QStringList *paths, QString *error = nullptr) const;
+    QStringList metadataFields() const;
+    
+    // Archive tier
+    int archiveAgeDays() const;
+    void setArchiveAgeDays(int days);
+    
+    /**
+     * @brief Move entries older than archiveAgeDays() into compressed archives
+     * @return Number of entries archived
+     */
+    int archiveOldEntries();
+    
+    // Mirror, see JournalMirror
+    QString mirrorDirectory() const;
+    void setMirrorDirectory(const QString& directory);
+    
+    // Revision history
+    QList<RevisionStore::Revision> revisions(const QString& filePath) const;
+    
+    /**
+     * @brief Read a revision back as an entry
+     * @return false if its stored history is damaged
+     */
+    bool loadRevision(const RevisionStore::Revision& revision, JournalEntry *entry) const;
+    
     // File utilities
+    
+    /**
+     * @brief Name for a new entry, numbered (-2, -3, ...) if another entry
+     * already has the same date and title
+     */
     QString generateFileName(const QString& title, const QDateTime& dateTime);
     QStringList listEntryFiles();
     
 private:
     QDir m_journalDir;
+    Layout m_layout;
+    Backend m_backendType;
+    std::unique_ptr<StorageBackend> m_backend;
+    std::unique_ptr<ArchiveStore> m_archive;
+    std::unique_ptr<RevisionStore> m_revisions;
+    LinkGraph m_linkGraph;
+    TimelineIndex m_timeline;
+    SimilarityIndex m_similarity;
+    MetadataStore m_metadata;
+    EntryIdIndex m_entryIds;
+    EntryCache m_cache;
+    
+    // Background prefetching
+    struct PrefetchItem {
+        QString key;
+        QString filePath;
+    };
+    QList<PrefetchItem> m_prefetchQueue;
+    bool m_prefetchActive;
+    QMutex m_prefetchMutex;
+    QFuture<void> m_prefetchFuture;
     
     // Helper functions
     QString sanitizeFileName(const QString& name);
-    bool writeMarkdownFile(const QString& filePath, const JournalEntry& entry);
-    JournalEntry parseMarkdownFile(const QString& filePath);
+    QString shardForFileName(const QString& fileName) const;
+    QString metadataFilePath(const QString& name) const;
+    QString entryKey(const QString& filePath) const;
+    JournalEntry readEntry(const QString& key) const;
+    QDateTime entryVersion(const QString& filePath) const;
+    QDateTime entryCreated(const QString& key) const;
+    QString resolveId(const QString& key, const JournalEntry& entry);
+    bool isOriginal(const QString& key, const JournalEntry& entry, const QString& other) const;
+    static QByteArray revisionText(const JournalEntry& entry);
+    void runPrefetch();
+    void waitForPrefetch();
+    void cancelBackgroundWork();
+    void indexEntry(const QString& key, const JournalEntry& entry);
+    void unindexEntry(const QString& key);
+    void addToIndexes(const QString& id, const JournalEntry& entry);
+    void removeFromIndexes(const QString& id);
+    QStringList entryPaths(const QStringList& ids) const;
+    void loadJournalConfig();
+    std::unique_ptr<StorageBackend> createBackend(Backend backend) const;
 };
 
 #endif // FILEMANAGER_H
@@ -0,0 +1,42 @@
+#ifndef HISTORYDIALOG_H
+#define HISTORYDIALOG_H
+
+#include <QDialog>
+#include <QListWidget>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include "filemanager.h"
+#include "revisionstore.h"
+#include "journalentry.h"
+
+/**
+ * @brief Browses the saved revisions of an entry
+ * 
+ * Lists every revision newest first and shows a line diff of the
+ * selected revision against the one before it. Accepting the dialog
+ * restores the selected revision.
+ */
+class HistoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    HistoryDialog(FileManager *fileManager, const QString& filePath, QWidget *parent = nullptr);
+    
+    JournalEntry selectedRevision() const { return m_selected; }
+
+private slots:
+    void onRevisionSelected(int row);
+
+private:
+    FileManager *m_fileManager;
+    QList<RevisionStore::Revision> m_revisions;
+    QListWidget *m_revisionList;
+    QPlainTextEdit *m_diffView;
+    QPushButton *m_restoreButton;
+    JournalEntry m_selected;
+    
+    void showDiff(const QString& before, const QString& after);
+};
+
+#endif // HISTORYDIALOG_H
@@ -0,0 +1,91 @@
+#ifndef JOURNALDAEMON_H
+#define JOURNALDAEMON_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QDateTime>
+#include <QDataStream>
+#include <memory>
+#include "filemanager.h"
+#include "journalentry.h"
+
+/**
+ * @brief Per-user background service holding journals loaded and indexed
+ *
+ * Listens on DaemonProtocol::serverName() and answers one request at a
+ * time per client. Journals are loaded on first use (or up front through
+ * preload()), watched for changes and rescanned once the changes settle,
+ * so clients are always answered from a complete, current index. A
+ * request for a journal with unscanned changes rescans it first.
+ *
+ * Journals using the packed backend are refused, and dropped once they
+ * switch to it: holding a pack open here would make the daemon a second
+ * writer to it. Clients read packed journals themselves.
+ */
+class JournalDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JournalDaemon(QObject *parent = nullptr);
+    ~JournalDaemon();
+    
+    /**
+     * @brief Start listening
+     * @return false if another daemon is already running or the socket
+     *         cannot be created
+     */
+    bool start(QString *error);
+    
+    /**
+     * @brief Load a journal now instead of on its first request
+     */
+    void preload(const QString& directory);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void rescanStaleJournals();
+
+private:
+    struct Journal {
+        std::unique_ptr<FileManager> fileManager;
+        QFileSystemWatcher *watcher;
+        QList<JournalEntry> entries;        // From the last scan, oldest first
+        QHash<QString, qint64> versions;    // Modification time in ms of each file when scanned
+        QDateTime configModified;           // Of the journal's configuration and archives when loaded
+        QDateTime archiveModified;
+        bool stale;
+    };
+    
+    Journal *journal(const QString& directory, QString *error);
+    void dropJournal(const QString& path);
+    
+    /**
+     * @brief Rescan a journal
+     * @return false if it now uses the packed backend and must be dropped
+     */
+    bool scan(Journal *journal);
+    void watch(Journal *journal);
+    
+    /**
+     * @brief Reply payload for a request payload, or empty to drop the client
+     */
+    QByteArray handleRequest(const QByteArray& payload);
+    QByteArray listEntries(QDataStream& in, QString *error);
+    QByteArray readEntry(QDataStream& in, QString *error);
+    QByteArray snapshot(QDataStream& in, QString *error);
+    
+    QLocalServer *m_server;
+    QTimer *m_rescanTimer;
+    QHash<QString, Journal *> m_journals;
+    QHash<QLocalSocket *, QByteArray> m_buffers;
+    bool m_shuttingDown;
+};
+
+#endif // JOURNALDAEMON_H
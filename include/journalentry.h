@@ -3,44 +3,66 @@
 
 #include <QString>
 #include <QDateTime>
+#include <QList>
+#include <QPair>
 #include <QMetaType>
 
 /**
  * @brief Represents a single journal entry
  * 
  * This class encapsulates all data for a journal entry including
- * title, content, creation/modification times, and file path.
+ * its id, title, content, creation/modification times, and file path.
  */
 class JournalEntry
 {
 public:
+    // Frontmatter field other than id, title, created and modified: name and
+    // raw value, which may span several lines for YAML lists. A frontmatter
+    // line that is not a field (a comment, say) has an empty name and the
+    // whole line as its value
+    using Field = QPair<QString, QString>;
+    
     JournalEntry();
     JournalEntry(const QString& title, const QString& content);
     
     // Getters
+    QString id() const { return m_id; }
     QString title() const { return m_title; }
     QString content() const { return m_content; }
     QDateTime createdAt() const { return m_createdAt; }
     QDateTime modifiedAt() const { return m_modifiedAt; }
     QString filePath() const { return m_filePath; }
+    QList<Field> fields() const { return m_fields; }
+    QString field(const QString& name) const;
     
     // Setters
+    void setId(const QString& id) { m_id = id; }
     void setTitle(const QString& title);
     void setContent(const QString& content);
     void setCreatedAt(const QDateTime& dateTime) { m_createdAt = dateTime; }
     void setModifiedAt(const QDateTime& dateTime) { m_modifiedAt = dateTime; }
     void setFilePath(const QString& path) { m_filePath = path; }
+    void setFields(const QList<Field>& fields) { m_fields = fields; }
+    
+    /**
+     * @brief Set a frontmatter field, keeping its place if it exists
+     *
+     * An empty value removes the field.
+     */
+    void setField(const QString& name, const QString& value);
     
     // Utility
     bool isEmpty() const;
     void updateModifiedTime();
     
 private:
+    QString m_id;               // Stable across renames, see EntryIdIndex
     QString m_title;
     QString m_content;
     QDateTime m_createdAt;
     QDateTime m_modifiedAt;
     QString m_filePath;
+    QList<Field> m_fields;      // In frontmatter order
 };
 
 Q_DECLARE_METATYPE(JournalEntry)
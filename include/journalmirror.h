@@ -0,0 +1,120 @@
+#ifndef JOURNALMIRROR_H
+#define JOURNALMIRROR_H
+
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <functional>
+
+class QFileInfo;
+
+/**
+ * @brief Keeps a copy of a journal directory up to date incrementally
+ *
+ * The mirror holds a manifest of every file it copied: size, modification
+ * time and a signature made of a weak rolling checksum and an MD5 digest
+ * per block. A sync only opens journal files whose size or time differs
+ * from the manifest. Changed files are matched against the old signature
+ * the way rsync does, by rolling the weak checksum over every byte
+ * offset, so only the changed stretches are taken from the journal and
+ * the rest is reused from the old mirror copy. When every reused block
+ * stays where it was, as with appended pack and revision files, the
+ * mirror copy is patched in place and only the new bytes are written.
+ *
+ * verify() rereads the mirror against the block digests, spread over
+ * all cores.
+ */
+class JournalMirror
+{
+    Q_DECLARE_TR_FUNCTIONS(JournalMirror)
+
+public:
+    struct SyncStats {
+        int files = 0;              // Files in the journal
+        int unchanged = 0;          // Skipped on size and time alone
+        int copied = 0;             // New to the mirror
+        int updated = 0;            // Rewritten from a delta
+        int removed = 0;            // Gone from the journal
+        qint64 literalBytes = 0;    // Taken from the journal
+        qint64 reusedBytes = 0;     // Matched in the old mirror copy
+        QStringList errors;
+    };
+    
+    struct VerifyResult {
+        int files = 0;
+        QStringList missing;
+        QStringList damaged;
+        QStringList outdated;       // Changed in the journal since the last sync
+        QStringList errors;
+        
+        bool isClean() const { return missing.isEmpty() && damaged.isEmpty() && errors.isEmpty(); }
+    };
+    
+    JournalMirror(const QString& journalDirectory, const QString& mirrorDirectory);
+    
+    /**
+     * @brief Bring the mirror up to date with the journal
+     *
+     * Files removed from the journal are removed from the mirror. The
+     * callback is given the number of files processed so far and the
+     * total; returning false stops after the current file, keeping the
+     * work done so far.
+     */
+    SyncStats sync(const std::function<bool(int done, int total)>& progress = {});
+    
+    /**
+     * @brief Check every mirrored file against its recorded signature
+     *
+     * Damaged files are dropped from the manifest, so the next sync
+     * copies them again.
+     */
+    VerifyResult verify(const std::function<bool(int done, int total)>& progress = {});
+
+private:
+    struct FileRecord {
+        qint64 size = -1;
+        qint64 modified = 0;        // Journal file time, ms since the epoch
+        quint32 blockSize = 0;
+        QVector<quint32> weak;
+        QByteArray strong;          // One MD5 digest per block
+    };
+    
+    // A stretch of the new file, taken from the journal (oldOffset < 0)
+    // or from the old mirror copy
+    struct Segment {
+        qint64 offset;
+        qint64 length;
+        qint64 oldOffset;
+    };
+    
+    struct Piece {
+        QString path;
+        const FileRecord *record;
+        int firstBlock;
+        int blockCount;
+    };
+    
+    static quint32 blockSizeFor(qint64 size);
+    static quint32 weakChecksum(const uchar *data, qint64 length);
+    static QByteArray strongChecksum(const uchar *data, qint64 length);
+    static FileRecord signature(const uchar *data, qint64 size);
+    static QList<Segment> computeDelta(const uchar *data, qint64 size, const FileRecord& old);
+    
+    QString manifestPath() const;
+    bool loadManifest();
+    bool saveManifest() const;
+    QStringList journalFiles() const;
+    bool syncFile(const QString& path, const QFileInfo& info, SyncStats *stats);
+    bool verifyPiece(const Piece& piece) const;
+    
+    QDir m_journalDir;
+    QDir m_mirrorDir;
+    QHash<QString, FileRecord> m_records;
+};
+
+#endif // JOURNALMIRROR_H
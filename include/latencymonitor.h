@@ -0,0 +1,107 @@
+#ifndef LATENCYMONITOR_H
+#define LATENCYMONITOR_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include <array>
+#include <vector>
+
+/**
+ * @brief Fixed-precision histogram of durations in nanoseconds
+ *
+ * Uses the HdrHistogram bucket layout: values below 128 ns are counted
+ * exactly, and every power-of-two range above that is split into 64
+ * linear sub-buckets, so any recorded value is reported within 1/64
+ * (about 1.6%) of its true size. Recording is a bit scan and an
+ * increment, and the whole range up to about a minute fits in 2k
+ * counters.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+    
+    void record(qint64 nanoseconds);
+    void reset();
+    
+    quint64 count() const { return m_count; }
+    qint64 max() const { return m_max; }
+    double mean() const;
+    
+    /**
+     * @brief Smallest recorded value that at least @p percentile percent
+     *        of samples do not exceed
+     */
+    qint64 percentile(double percentile) const;
+
+private:
+    static int bucketFor(qint64 value);
+    static qint64 valueFor(int bucket);
+    
+    std::vector<quint64> m_buckets;
+    quint64 m_count;
+    qint64 m_max;
+    double m_sum;
+};
+
+/**
+ * @brief Timings for the editor's keystroke-to-screen path
+ *
+ * The editor, highlighter and document layout report how long each
+ * stage took; a keystroke that changed the document or cursor is also
+ * held open until the next paint finishes, which gives the end-to-end
+ * latency the user actually sees. Highlighting and layout run inside the
+ * key handling that triggers them, so Input includes them. Everything
+ * runs on the GUI thread.
+ */
+class LatencyMonitor
+{
+public:
+    enum Stage {
+        Input,       // Key handling, including the document edit
+        Highlight,   // One highlightBlock() pass
+        Layout,      // One relayout of the changed blocks
+        Paint,       // One viewport paint
+        KeyToPaint,  // Key press received until its paint finished
+        StageCount
+    };
+    
+    LatencyMonitor();
+    
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    
+    void record(Stage stage, qint64 nanoseconds);
+    
+    /**
+     * @brief Start an end-to-end measurement for a key press received at
+     *        @p receivedAt
+     */
+    void markInput(qint64 receivedAt);
+    
+    /**
+     * @brief Close the pending key press, if any, at the end of a paint
+     */
+    void markPainted();
+    
+    void reset();
+    
+    const LatencyHistogram& histogram(Stage stage) const { return m_histograms[stage]; }
+    static QString stageName(Stage stage);
+    
+    /**
+     * @brief A few lines for the on-screen overlay
+     */
+    QString summary() const;
+    
+    /**
+     * @brief Full table of every stage, for attaching to bug reports
+     */
+    QString report() const;
+
+private:
+    QElapsedTimer m_clock;
+    std::array<LatencyHistogram, StageCount> m_histograms;
+    qint64 m_pendingInput;
+};
+
+#endif // LATENCYMONITOR_H
@@ -0,0 +1,85 @@
+#ifndef LINKGRAPH_H
+#define LINKGRAPH_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+/**
+ * @brief Graph of [[wiki links]] and #tags between entries
+ * 
+ * Entries, link targets and tags are interned to dense integer ids and
+ * kept in adjacency lists: each entry records the titles it links to and
+ * the tags it carries, and each title and tag records the entries
+ * pointing at it. Backlink and tag lookups are therefore a hash lookup
+ * plus the size of the answer, and updating an entry only touches its
+ * own edges.
+ * 
+ * Links refer to titles, so a link to an entry that does not exist yet
+ * starts resolving as soon as an entry with that title is added.
+ */
+class LinkGraph
+{
+public:
+    LinkGraph();
+    
+    /**
+     * @brief Replace an entry's links and tags with those in its content
+     * @param entryId Stable identifier of the entry
+     * @param title Entry title, which other entries link to
+     * @param content Entry Markdown content
+     */
+    void updateEntry(const QString& entryId, const QString& title, const QString& content);
+    void removeEntry(const QString& entryId);
+    bool containsEntry(const QString& entryId) const { return m_entryIds.contains(entryId); }
+    QStringList entries() const { return m_entryIds.keys(); }
+    void clear();
+    
+    /**
+     * @brief Ids of the entries that link to the given entry's title
+     */
+    QStringList backlinks(const QString& entryId) const;
+    
+    /**
+     * @brief Ids of the entries carrying a tag (without the leading '#')
+     */
+    QStringList entriesWithTag(const QString& tag) const;
+    
+    /**
+     * @brief All tags in use, sorted
+     */
+    QStringList tags() const;
+    
+    // Parsing helpers
+    static QStringList extractLinks(const QString& content);
+    static QStringList extractTags(const QString& content);
+    
+private:
+    struct Node {
+        QString entryId;
+        quint32 title = 0;          // Title id this entry answers to
+        QVector<quint32> links;     // Title ids this entry links to
+        QVector<quint32> tags;      // Tag ids this entry carries
+        bool used = false;
+    };
+    
+    QVector<Node> m_nodes;
+    QVector<quint32> m_freeNodes;
+    QHash<QString, quint32> m_entryIds;
+    
+    QHash<QString, quint32> m_titleIds;
+    QVector<QSet<quint32>> m_linkedFrom;    // Title id -> linking nodes
+    
+    QHash<QString, quint32> m_tagIds;
+    QVector<QString> m_tagNames;
+    QVector<QSet<quint32>> m_taggedWith;    // Tag id -> tagged nodes
+    
+    quint32 internTitle(const QString& title);
+    quint32 internTag(const QString& tag);
+    void unlinkNode(quint32 node);
+    static QString normalize(const QString& text);
+};
+
+#endif // LINKGRAPH_H
@@ -5,9 +5,18 @@
 #include <QListWidget>
 #include <QSplitter>
 #include <QLabel>
+#include <QComboBox>
+#include <QLineEdit>
+#include <QCalendarWidget>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QHash>
+#include <QFuture>
+#include <memory>
 #include "markdowneditor.h"
 #include "filemanager.h"
 #include "journalentry.h"
+#include "titleindex.h"
 
 /**
  * @brief Main application window
@@ -31,13 +40,38 @@ private slots:
     void newEntry();
     void saveEntry();
     void deleteEntry();
+    void showHistory();
+    void showQuickSwitcher();
     
     // Entry selection
     void onEntrySelected(QListWidgetItem *item);
+    void onTagFilterChanged();
+    void onCalendarDayClicked(const QDate& date);
+    void showCalendarMonth();
+    void clearDateRange();
+    void onJournalChangedOnDisk();
+    void onJournalSelected(int index);
+    
+    // Journals
+    void openJournalDialog();
+    void closeJournal();
     
     // Settings
     void showSettings();
     void toggleDistractionFree();
+    void toggleCalendar(bool visible);
+    void toggleLatencyOverlay(bool visible);
+    void toggleSpellCheck(bool enabled);
+    
+    // Tools
+    void migrateToShardedLayout();
+    void changeStorageBackend();
+    void exportToMarkdown();
+    void archiveOldEntries();
+    void mirrorJournal();
+    void verifyMirror();
+    void dumpLatencyReport();
+    void toggleTracing(bool enabled);
     
     // Application
     void about();
@@ -45,13 +79,51 @@ private slots:
 private:
     // UI Components
     MarkdownEditor *m_editor;
+    QWidget *m_sidebar;
+    QComboBox *m_tagFilter;
+    QLineEdit *m_fieldFilter;
+    QWidget *m_calendarPanel;
+    QCalendarWidget *m_calendar;
     QListWidget *m_entryList;
+    QListWidget *m_backlinkList;
+    QListWidget *m_relatedList;
     QSplitter *m_splitter;
     QLabel *m_statusLabel;
+    QComboBox *m_journalSelector;
+    
+    /**
+     * @brief A journal kept open in the background
+     * 
+     * Holds what the sidebar and editor showed for it while another
+     * journal is in front, so switching back needs no rescan.
+     */
+    struct OpenJournal {
+        int id;
+        FileManager *fileManager;
+        QFileSystemWatcher *watcher;
+        QFuture<QList<JournalEntry>> loading;   // Initial scan, until loaded
+        JournalEntry currentEntry;
+        QHash<QString, QString> entryTitles;
+        bool loaded;
+        bool stale;                             // Changed on disk while hidden
+    };
+    QList<OpenJournal *> m_journals;
     
-    // Data
+    // Data of the journal being shown
     FileManager *m_fileManager;
+    OpenJournal *m_journal;
+    int m_nextJournalId;
     JournalEntry m_currentEntry;
+    QHash<QString, QString> m_entryTitles;
+    std::shared_ptr<const TitleIndex> m_titleIndex;   // Built on demand from m_entryTitles
+    QDateTime m_rangeFrom;
+    QDateTime m_rangeTo;
+    
+    // External change tracking
+    QTimer *m_reloadTimer;
+    
+    // Applies the field filter once typing pauses
+    QTimer *m_filterTimer;
     
     // UI Setup
     void setupUi();
@@ -61,9 +133,28 @@ private:
     
     // Helper functions
     void loadEntryList();
+    void populateEntryList();
+    void refreshTagFilter();
+    void updateBacklinks();
+    void updateRelated();
+    void updateCalendarMarks();
+    void setDateRange(const QDateTime& from, const QDateTime& to);
+    void indexArchivedEntries(OpenJournal *journal);
+    void watchJournal(OpenJournal *journal);
+    OpenJournal *journalById(int id) const;
+    OpenJournal *openJournal(const QString& directory);
+    void finishLoading(OpenJournal *journal);
+    void activateJournal(OpenJournal *journal);
+    void showJournal(OpenJournal *journal);
+    void restoreJournals();
+    void saveOpenJournals();
+    QString entryDisplayText(const JournalEntry& entry) const;
     void displayEntry(const JournalEntry& entry);
+    void openEntry(const QString& filePath);
     bool maybeSave();
     void setCurrentEntry(const JournalEntry& entry);
+    void selectCurrentEntryInList();
+    void prefetchNeighbours();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,37 @@
+#ifndef MARKDOWNBACKEND_H
+#define MARKDOWNBACKEND_H
+
+#include <QDir>
+#include "storagebackend.h"
+
+/**
+ * @brief Stores each entry as its own Markdown file
+ * 
+ * This is the default backend: the journal directory is a plain folder
+ * of .md files, either flat or sharded into YYYY/MM/ subdirectories.
+ * 
+ * readEntry() may be called from worker threads.
+ */
+class MarkdownBackend : public StorageBackend
+{
+public:
+    explicit MarkdownBackend(const QString& rootPath);
+    
+    void setSharded(bool sharded) { m_sharded = sharded; }
+    
+    bool writeEntry(const QString& key, const JournalEntry& entry) override;
+    JournalEntry readEntry(const QString& key) override;
+    bool removeEntry(const QString& key) override;
+    QStringList listKeys() override;
+    
+private:
+    QDir m_root;
+    QString m_rootPath;
+    bool m_sharded;
+    
+    QString keyPath(const QString& key) const { return m_rootPath + "/" + key; }
+    
+    QStringList listShardedKeys();
+};
+
+#endif // MARKDOWNBACKEND_H
@@ -2,9 +2,16 @@
 #define MARKDOWNEDITOR_H
 
 #include <QPlainTextEdit>
+#include <QPlainTextDocumentLayout>
 #include <QSyntaxHighlighter>
 #include <QTextCharFormat>
 #include <QRegularExpression>
+#include <QLabel>
+#include <QTimer>
+#include "latencymonitor.h"
+#include "spellchecker.h"
+
+class MarkdownHighlighter;
 
 /**
  * @brief Custom text editor optimized for Markdown editing
@@ -22,13 +29,53 @@ public:
     void setDistractionFreeMode(bool enabled);
     bool isModified() const { return document()->isModified(); }
     void setModified(bool modified) { document()->setModified(modified); }
+    
+    /**
+     * @brief Show or hide the latency overlay in the editor's corner
+     */
+    void setLatencyHudVisible(bool visible);
+    bool isLatencyHudVisible() const { return m_latencyHud->isVisible(); }
+    LatencyMonitor& latencyMonitor() { return m_latency; }
+    
+    void setSpellCheckEnabled(bool enabled) { m_spellChecker->setEnabled(enabled); }
+    SpellChecker *spellChecker() const { return m_spellChecker; }
 
 protected:
     void keyPressEvent(QKeyEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
 
 private:
     bool m_distractionFreeMode;
+    LatencyMonitor m_latency;
+    MarkdownHighlighter *m_highlighter;
+    SpellChecker *m_spellChecker;
+    QLabel *m_latencyHud;
+    QTimer m_hudTimer;
+    
     void setupEditor();
+    void setupLatencyHud();
+    void positionLatencyHud();
+    void refreshLatencyHud();
+};
+
+/**
+ * @brief Plain text layout that reports how long each relayout takes
+ */
+class TimedDocumentLayout : public QPlainTextDocumentLayout
+{
+    Q_OBJECT
+
+public:
+    TimedDocumentLayout(QTextDocument *document, LatencyMonitor *monitor);
+
+protected:
+    void documentChanged(int from, int charsRemoved, int charsAdded) override;
+
+private:
+    LatencyMonitor *m_latency;
+    int m_depth;            // Relayouts started from within a relayout are not counted again
 };
 
 /**
@@ -40,16 +87,35 @@ class MarkdownHighlighter : public QSyntaxHighlighter
 
 public:
     explicit MarkdownHighlighter(QTextDocument *parent = nullptr);
+    
+    /**
+     * @brief Report the time spent in each block pass to @p monitor
+     */
+    void setLatencyMonitor(LatencyMonitor *monitor) { m_latency = monitor; }
+    
+    /**
+     * @brief Underline the misspellings @p checker reports for each block
+     */
+    void setSpellChecker(SpellChecker *checker) { m_spellChecker = checker; }
 
 protected:
     void highlightBlock(const QString &text) override;
 
 private:
+    enum BlockState {
+        Normal = 0,
+        InCodeFence = 1     // Inside a ``` or ~~~ fenced code block
+    };
+    
     struct HighlightRule {
         QRegularExpression pattern;
         QTextCharFormat format;
     };
     QVector<HighlightRule> m_rules;
+    QRegularExpression m_fencePattern;
+    QTextCharFormat m_codeFormat;
+    LatencyMonitor *m_latency;
+    SpellChecker *m_spellChecker;
     
     void setupHighlightRules();
 };
@@ -0,0 +1,36 @@
+#ifndef MARKDOWNFORMAT_H
+#define MARKDOWNFORMAT_H
+
+#include <QString>
+#include "journalentry.h"
+
+/**
+ * @brief Conversion between journal entries and their Markdown text
+ * 
+ * Every storage backend persists entries in this representation, which
+ * keeps them interchangeable and lets any store be exported losslessly
+ * as plain Markdown files. Frontmatter fields other than the id, title
+ * and dates, and lines that are not fields at all, are carried through
+ * JournalEntry::fields() unchanged.
+ */
+namespace MarkdownFormat {
+
+/**
+ * @brief Render an entry as Markdown with YAML frontmatter
+ * @param entry The entry to render
+ * @return The complete file contents
+ */
+QString serialize(const JournalEntry& entry);
+
+/**
+ * @brief Parse Markdown text into an entry
+ * @param text The complete file contents
+ * @param hasFrontmatter Set to whether the text carried frontmatter; when
+ *                       it did not, the caller should supply the dates
+ * @return The parsed entry (file path is left empty)
+ */
+JournalEntry parse(const QString& text, bool *hasFrontmatter = nullptr);
+
+} // namespace MarkdownFormat
+
+#endif // MARKDOWNFORMAT_H
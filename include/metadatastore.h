@@ -0,0 +1,105 @@
+#ifndef METADATASTORE_H
+#define METADATASTORE_H
+
+#include <QString>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <vector>
+#include "journalentry.h"
+
+/**
+ * @brief Column store of frontmatter fields, for filtering entries
+ *
+ * Every field is a column indexed by entry row. String values are
+ * dictionary-encoded, with a bitmap of the rows holding each distinct
+ * value, so an equality test is one hash lookup. Values that read as
+ * numbers or ISO dates are also kept in typed arrays that range tests
+ * scan without touching a string. Terms are combined as bitmaps, 64
+ * rows per machine word.
+ *
+ * Filters look like `project=alpha AND mood>=4`:
+ *  - `field=value`, `field!=value`, `<`, `<=`, `>`, `>=`, and
+ *    `field~text` for values containing a text
+ *  - a field name alone matches entries that have the field
+ *  - AND, OR, NOT and parentheses combine terms; terms written side by
+ *    side must all match
+ *  - values with spaces or operators are quoted: `place="New York"`
+ *
+ * Names and text compare without regard to case. A date without a time
+ * stands for the whole day. title, created and modified are fields too,
+ * and each item of a list field counts as a value.
+ */
+class MetadataStore
+{
+    Q_DECLARE_TR_FUNCTIONS(MetadataStore)
+
+public:
+    MetadataStore();
+    
+    void updateEntry(const QString& entryId, const JournalEntry& entry);
+    void removeEntry(const QString& entryId);
+    void clear();
+    
+    /**
+     * @brief Names of the fields in use, sorted
+     */
+    QStringList fieldNames() const;
+    
+    /**
+     * @brief Ids of the entries matching a filter
+     * @param error Set to what is wrong with the filter, if anything
+     * @return false if the filter cannot be parsed
+     */
+    bool select(const QString& filter, QStringList *entryIds, QString *error = nullptr) const;
+
+private:
+    class Bitmap
+    {
+    public:
+        void set(quint32 row);
+        void reset(quint32 row);
+        void unite(const Bitmap& other);
+        void intersect(const Bitmap& other);
+        void subtract(const Bitmap& other);
+        
+        std::vector<quint64> words;
+    };
+    
+    enum class Op { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Contains };
+    
+    struct Column {
+        QString name;                               // As first seen
+        QHash<QString, quint32> codes;              // Folded value -> code
+        QVector<QString> values;                    // Code -> folded value
+        QVector<Bitmap> rowsWithCode;
+        std::vector<quint32> firstCodes;            // NO_CODE where the row has none
+        QHash<quint32, QVector<quint32>> moreCodes; // Further items of list values
+        
+        // Typed copies, allocated once the column holds a number or date
+        std::vector<double> numbers;                // NaN where not a number
+        std::vector<qint64> dates;                  // NO_DATE where not a date
+        Bitmap present;
+    };
+    
+    struct Parser;
+    
+    static QStringList splitValues(const QString& value);
+    static bool parseDate(const QString& text, qint64 *from, qint64 *to);
+    
+    void setValue(const QString& name, quint32 row, const QString& value);
+    void clearRow(quint32 row);
+    Bitmap rowsWithField(const QString& name) const;
+    Bitmap compare(const QString& name, Op op, const QString& value) const;
+    
+    QVector<QString> m_entryIds;                    // Row -> entry, empty if free
+    QVector<quint32> m_freeRows;
+    QHash<QString, quint32> m_rows;
+    Bitmap m_live;
+    
+    QVector<Column> m_columns;
+    QHash<QString, int> m_columnIds;                // Folded name -> column
+};
+
+#endif // METADATASTORE_H
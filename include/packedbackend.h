@@ -0,0 +1,92 @@
+#ifndef PACKEDBACKEND_H
+#define PACKEDBACKEND_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QLockFile>
+#include "storagebackend.h"
+
+/**
+ * @brief Stores all entries in a single append-only pack file
+ * 
+ * Each save appends one record to the pack instead of creating a file,
+ * so large journals avoid per-entry open/close overhead and inode usage.
+ * The pack is memory-mapped for reads and an in-memory index maps keys
+ * to record offsets; it is rebuilt by scanning the pack on open, which
+ * also discards a torn record left by a crash.
+ * 
+ * Overwritten and deleted records become dead space that is reclaimed by
+ * compaction once it outweighs the live data. Records hold the entry's
+ * exact Markdown text, so exporting the pack is lossless.
+ * 
+ * Several processes may have the same pack open. Appends and compaction
+ * happen under a lock file, and compaction bumps a generation number in
+ * the pack header; before using its index, each instance picks up
+ * records other processes appended and reloads a pack that was replaced.
+ * 
+ * All methods are thread-safe.
+ */
+class PackedBackend : public StorageBackend
+{
+public:
+    /**
+     * @param packPath The pack file, created if missing
+     * @param lockPath Lock file held while the pack is written
+     */
+    PackedBackend(const QString& packPath, const QString& lockPath);
+    ~PackedBackend() override;
+    
+    bool isOpen() const;
+    
+    bool writeEntry(const QString& key, const JournalEntry& entry) override;
+    JournalEntry readEntry(const QString& key) override;
+    bool removeEntry(const QString& key) override;
+    QStringList listKeys() override;
+    
+    /**
+     * @brief Rewrite the pack with live records only
+     * @return true if the pack was rewritten
+     */
+    bool compact();
+    
+    /**
+     * @brief Write every entry as a Markdown file below a directory
+     * @param directory Target directory; keys become relative file paths
+     * @return true if all entries were written
+     */
+    bool exportToMarkdown(const QString& directory);
+    
+private:
+    struct Slot {
+        qint64 offset;     // Start of the record in the pack
+        quint32 keyLength;
+        quint32 dataLength;
+    };
+    
+    QFile m_file;
+    QString m_lockPath;
+    uchar *m_map;
+    qint64 m_mappedSize;
+    qint64 m_indexedSize;       // End of the last record in m_index
+    quint32 m_generation;       // Bumped by every compaction
+    QHash<QString, Slot> m_index;
+    qint64 m_liveBytes;
+    qint64 m_deadBytes;
+    mutable QMutex m_mutex;
+    
+    bool lockPack(QLockFile *lock) const;
+    bool openPack(bool locked);
+    bool loadIndex(bool locked);
+    bool scanRecords(bool locked);
+    bool refresh(bool locked);
+    bool remap();
+    void unmap();
+    bool appendRecord(quint8 type, const QString& key, const QByteArray& data, Slot *slot);
+    QByteArray recordData(const Slot& slot);
+    void retireSlot(const QString& key);
+    void maybeCompact();
+    bool compactLocked();
+};
+
+#endif // PACKEDBACKEND_H
@@ -0,0 +1,69 @@
+#ifndef QUICKSWITCHER_H
+#define QUICKSWITCHER_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QLabel>
+#include <QFutureWatcher>
+#include <QVector>
+#include <memory>
+#include "titleindex.h"
+
+/**
+ * @brief Ctrl+P style dialog for jumping to an entry by name
+ *
+ * Ranks every entry against the typed text on a background thread and
+ * shows the best matches; the search never blocks typing, and results
+ * for text that has since changed are dropped. When the new text extends
+ * the previous one only the previous matches are searched again.
+ */
+class QuickSwitcher : public QDialog
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @param index Titles to search, shared with the window that built it
+     * @param owner BackgroundScheduler owner to run searches as
+     */
+    QuickSwitcher(std::shared_ptr<const TitleIndex> index, const void *owner,
+                  QWidget *parent = nullptr);
+    
+    /**
+     * @brief Path of the chosen entry, empty if none was chosen
+     */
+    QString selectedPath() const { return m_selectedPath; }
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void onQueryChanged(const QString& query);
+    void onSearchFinished();
+    void acceptCurrent();
+
+private:
+    struct SearchResult {
+        QString query;
+        QList<TitleIndex::Match> matches;
+        QVector<int> matched;
+        qint64 elapsedNs;
+    };
+    
+    std::shared_ptr<const TitleIndex> m_index;
+    const void *m_owner;
+    QLineEdit *m_queryEdit;
+    QListWidget *m_resultList;
+    QLabel *m_statusLabel;
+    QFutureWatcher<SearchResult> m_searchWatcher;
+    QString m_pendingQuery;
+    bool m_searchPending;
+    QString m_lastQuery;
+    QVector<int> m_lastMatched;
+    QString m_selectedPath;
+    
+    void startSearch(const QString& query);
+};
+
+#endif // QUICKSWITCHER_H
@@ -0,0 +1,77 @@
+#ifndef REVISIONSTORE_H
+#define REVISIONSTORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QMutex>
+
+/**
+ * @brief Content-addressed store of entry revisions
+ * 
+ * Each saved revision is split into content-defined chunks using a
+ * rolling gear hash, so an edit only changes the chunks around it.
+ * Chunks are stored once, compressed, under their SHA-256 hash; a
+ * revision is a manifest listing its chunk hashes, itself stored as an
+ * object. A one-line edit to a large entry therefore costs one or two
+ * new chunks plus a manifest.
+ * 
+ * Every entry has an append-only log of fixed-size revision records,
+ * which makes listing and fetching any past revision cheap.
+ * 
+ * All methods are thread-safe.
+ */
+class RevisionStore
+{
+public:
+    struct Revision {
+        QDateTime timestamp;
+        QByteArray manifest;   // Hash of the revision's manifest object
+        qint64 size;           // Size of the revision text in bytes
+    };
+    
+    explicit RevisionStore(const QString& directory);
+    
+    /**
+     * @brief Record a new revision of an entry
+     * 
+     * Nothing is written if the content matches the latest revision.
+     * 
+     * @param entryId Stable id of the entry, so history survives renames
+     * @param content Full text of the revision
+     * @return true if the revision is stored
+     */
+    bool recordRevision(const QString& entryId, const QByteArray& content);
+    
+    /**
+     * @brief List an entry's revisions, oldest first
+     * @param entryId Stable id of the entry; history recorded before ids
+     *        existed is found under the entry's storage key instead
+     */
+    QList<Revision> revisions(const QString& entryId) const;
+    
+    /**
+     * @brief Reassemble the text of a revision
+     * @return false if any of its objects is missing or damaged
+     */
+    bool readRevision(const Revision& revision, QByteArray *content) const;
+    
+private:
+    QString m_directory;
+    mutable QMutex m_mutex;
+    
+    QString objectPath(const QByteArray& hash) const;
+    QString logPath(const QString& entryId) const;
+    QByteArray storeObject(const QByteArray& data);
+    
+    /**
+     * @brief Read and decompress a stored object
+     * @return A null array if the object is missing or damaged
+     */
+    QByteArray readObject(const QByteArray& hash) const;
+    QList<QByteArray> splitChunks(const QByteArray& content) const;
+    bool latestRevision(const QString& entryId, Revision *revision) const;
+};
+
+#endif // REVISIONSTORE_H
@@ -0,0 +1,101 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QVector>
+#include <vector>
+
+/**
+ * @brief Finds entries with similar wording, for "related entries"
+ *
+ * Each entry is reduced to a TF-IDF term vector. Terms are hashed into a
+ * fixed number of dimensions with a random sign, so no vocabulary is
+ * kept, and the normalised vector is quantised to one signed byte per
+ * dimension. Cosine similarity is then an integer dot product that runs
+ * 16 dimensions at a time with SSE2 or NEON.
+ *
+ * Large journals are searched through locality-sensitive hashing: random
+ * hyperplanes split the vectors into buckets in several tables, and only
+ * entries sharing a bucket (or one a single bit away) with the query are
+ * scored exactly. Small journals are scanned in full, which is faster.
+ *
+ * Term weights depend on how many entries use each term. Vectors are
+ * rebuilt when the number of entries has drifted far enough since they
+ * were last computed, on the next query.
+ */
+class SimilarityIndex
+{
+public:
+    struct Match {
+        QString entryId;
+        float score;        // Cosine similarity
+    };
+    
+    SimilarityIndex();
+    
+    /**
+     * @brief Replace an entry's term vector with one for its current text
+     */
+    void updateEntry(const QString& entryId, const QString& title, const QString& content);
+    void removeEntry(const QString& entryId);
+    void clear();
+    
+    /**
+     * @brief Up to @p count entries most similar to @p entryId, best first
+     */
+    QList<Match> related(const QString& entryId, int count);
+    
+    /**
+     * @brief Dot product of two quantised vectors
+     */
+    static int dot(const qint8 *a, const qint8 *b);
+
+private:
+    struct Term {
+        quint32 hash;
+        float weight;       // Log-scaled term frequency
+    };
+    
+    struct Slot {
+        QString entryId;
+        QVector<Term> terms;
+        float scale = 0;    // Cosine value of one quantisation step
+        bool used = false;
+        bool bucketed = false;
+    };
+    
+    static QVector<Term> extractTerms(const QString& title, const QString& content);
+    
+    quint32 allocateSlot(const QString& entryId);
+    void forgetTerms(quint32 slot);
+    void computeVector(quint32 slot);
+    quint16 signature(quint32 slot, int table) const;
+    void insertBuckets(quint32 slot);
+    void removeBuckets(quint32 slot);
+    void noteDocumentCountChanged();
+    void rebuild();
+    
+    const qint8 *vector(quint32 slot) const;
+    
+    QVector<Slot> m_slots;
+    QVector<quint32> m_freeSlots;
+    QHash<QString, quint32> m_slotIds;
+    
+    // Quantised vectors and per-table bucket keys, indexed by slot
+    std::vector<qint8> m_vectors;
+    std::vector<quint16> m_signatures;
+    
+    QHash<quint32, int> m_documentFrequency;
+    int m_documents;
+    int m_builtForDocuments;
+    bool m_stale;
+    
+    std::vector<qint8> m_planes;                        // Random +/-1 hyperplanes
+    QVector<QHash<quint16, QVector<quint32>>> m_buckets;
+    std::vector<quint32> m_visited;
+    quint32 m_visitStamp;
+};
+
+#endif // SIMILARITYINDEX_H
@@ -0,0 +1,146 @@
+#ifndef SPELLCHECKER_H
+#define SPELLCHECKER_H
+
+#include <QObject>
+#include <QSyntaxHighlighter>
+#include <QTextBlock>
+#include <QTextBlockUserData>
+#include <QTextCursor>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QTimer>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <memory>
+#include "spelldictionary.h"
+
+class SpellChecker;
+
+/**
+ * @brief Spelling state of one block, stored on the block itself
+ *
+ * Remembers which text was last checked, so only blocks whose text has
+ * changed since are sent to the checker again.
+ */
+class SpellBlockData : public QTextBlockUserData
+{
+public:
+    struct Misspelling {
+        int start;
+        QString word;
+    };
+    
+    SpellBlockData(SpellChecker *checker, quint64 blockId);
+    ~SpellBlockData() override;
+    
+    quint64 id;
+    QTextBlock block;              // Refreshed on every highlight pass
+    size_t checkedHash;
+    bool checked;
+    bool queued;
+    QList<Misspelling> misspellings;
+
+private:
+    QPointer<SpellChecker> m_checker;
+};
+
+/**
+ * @brief Checks the spelling of an editor's text in the background
+ *
+ * The highlighter asks for each block's misspellings as it formats it.
+ * Blocks whose text changed are queued, and after a short pause in typing
+ * they are checked on a worker thread against a memory-mapped
+ * SpellDictionary. Results are stored on the blocks and only those blocks
+ * are rehighlighted, so the rest of the document is never formatted again.
+ *
+ * Inline code, link targets, wiki links, URLs, tags and words with digits
+ * are skipped; fenced code blocks are left out by the highlighter.
+ */
+class SpellChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Range {
+        int start;
+        int length;
+    };
+    
+    explicit SpellChecker(QObject *parent = nullptr);
+    
+    /**
+     * @brief Highlighter to refresh blocks through once they are checked
+     */
+    void setHighlighter(QSyntaxHighlighter *highlighter) { m_highlighter = highlighter; }
+    
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+    bool hasDictionary() const { return m_dictionary != nullptr; }
+    
+    /**
+     * @brief Misspelled words in @p block, for use while highlighting it
+     *
+     * Queues the block for checking if @p text has not been checked yet.
+     * Until then, earlier results are returned where the word is unchanged.
+     */
+    QList<Range> misspellings(const QTextBlock& block, const QString& text);
+    
+    /**
+     * @brief The misspelled word under @p cursor, or an empty string
+     */
+    QString misspelledWordAt(const QTextCursor& cursor) const;
+    
+    /**
+     * @brief Accept @p word from now on, in this and every later session
+     */
+    void addToDictionary(const QString& word);
+
+signals:
+    void dictionaryReady(bool found);
+
+private slots:
+    void onDictionaryLoaded();
+    void startCheck();
+    void onCheckFinished();
+
+private:
+    friend class SpellBlockData;
+    
+    struct Job {
+        quint64 id;
+        QString text;
+    };
+    struct Result {
+        quint64 id;
+        QString text;
+        QList<SpellBlockData::Misspelling> misspellings;
+    };
+    
+    static std::shared_ptr<const SpellDictionary> loadDictionary();
+    static QList<Result> check(const QList<Job>& jobs,
+                               std::shared_ptr<const SpellDictionary> dictionary,
+                               const QSet<QString>& personal);
+    static bool isCorrect(const QString& word, const SpellDictionary& dictionary,
+                          const QSet<QString>& personal);
+    static QString personalDictionaryPath();
+    
+    void forgetBlock(quint64 id);
+    void refreshAll();
+    
+    QPointer<QSyntaxHighlighter> m_highlighter;
+    std::shared_ptr<const SpellDictionary> m_dictionary;
+    QSet<QString> m_personal;
+    bool m_enabled;
+    
+    // Every live block's data by id, so results can find their block
+    QHash<quint64, SpellBlockData *> m_blocks;
+    quint64 m_nextBlockId;
+    QList<quint64> m_queue;
+    
+    QTimer m_checkTimer;
+    QFutureWatcher<std::shared_ptr<const SpellDictionary>> m_loadWatcher;
+    QFutureWatcher<QList<Result>> m_checkWatcher;
+};
+
+#endif // SPELLCHECKER_H
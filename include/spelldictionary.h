@@ -0,0 +1,64 @@
+#ifndef SPELLDICTIONARY_H
+#define SPELLDICTIONARY_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QFile>
+#include <QHash>
+
+/**
+ * @brief Read-only word list stored as a memory-mapped DAWG
+ *
+ * A directed acyclic word graph is a trie whose equal suffixes are
+ * shared, so a typical word list needs well under a byte per word of
+ * the original text. The compiled graph is a flat array of 32-bit edges
+ * that is mapped straight from disk; opening a dictionary reads nothing
+ * but the header, and lookups touch only the edges along one path.
+ *
+ * Lookups are const and may run from any number of threads.
+ */
+class SpellDictionary
+{
+public:
+    SpellDictionary();
+    ~SpellDictionary();
+    
+    /**
+     * @brief Build a dictionary file from a list of words
+     *
+     * Words are matched exactly, so the list should hold every form that
+     * is to be accepted.
+     *
+     * @return false if the list cannot be encoded or the file not written
+     */
+    static bool compile(QStringList words, const QString& path);
+    
+    /**
+     * @brief Map a dictionary written by compile()
+     */
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return m_edges != nullptr; }
+    
+    int wordCount() const { return int(m_wordCount); }
+    bool contains(QStringView word) const;
+
+private:
+    Q_DISABLE_COPY(SpellDictionary)
+    
+    int labelOf(char16_t c) const;
+    
+    QFile m_file;
+    uchar *m_map;
+    const uchar *m_edges;
+    quint32 m_edgeCount;
+    quint32 m_root;
+    quint32 m_wordCount;
+    
+    // Alphabet index of each character; Latin-1 through a table
+    qint16 m_latin1Labels[256];
+    QHash<char16_t, quint8> m_otherLabels;
+};
+
+#endif // SPELLDICTIONARY_H
@@ -0,0 +1,54 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <QString>
+#include <QStringList>
+#include "journalentry.h"
+
+/**
+ * @brief Interface for persisting journal entries
+ * 
+ * FileManager delegates all reads and writes to a backend. Entries are
+ * addressed by keys, which are paths relative to the journal directory
+ * (e.g. "2026/01/2026-01-07_first-day.md"), so every backend shares the
+ * same naming and entries keep their identity when moved between them.
+ */
+class StorageBackend
+{
+public:
+    virtual ~StorageBackend() = default;
+    
+    /**
+     * @brief Store an entry under the given key, replacing any previous one
+     * @return true if the entry was written
+     */
+    virtual bool writeEntry(const QString& key, const JournalEntry& entry) = 0;
+    
+    /**
+     * @brief Read the entry stored under the given key
+     * @return The entry, or an empty entry if it does not exist
+     */
+    virtual JournalEntry readEntry(const QString& key) = 0;
+    
+    /**
+     * @brief Remove the entry stored under the given key
+     * @return true if the entry existed and was removed
+     */
+    virtual bool removeEntry(const QString& key) = 0;
+    
+    /**
+     * @brief List the keys of all stored entries, oldest first
+     */
+    virtual QStringList listKeys() = 0;
+    
+protected:
+    /**
+     * @brief Order keys oldest first by their date-prefixed file names
+     * 
+     * Generated names begin with yyyy-MM-dd, so this needs no stat() or
+     * parsing; the directory part of sharded keys is ignored.
+     */
+    static void sortKeysByName(QStringList& keys);
+};
+
+#endif // STORAGEBACKEND_H
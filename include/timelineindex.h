@@ -0,0 +1,68 @@
+#ifndef TIMELINEINDEX_H
+#define TIMELINEINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QHash>
+#include <vector>
+
+/**
+ * @brief Entries ordered by their creation date
+ * 
+ * Keeps entry ids in a sorted array keyed by creation time, so date
+ * range queries are two binary searches plus the size of the result.
+ * Inserts append and the array is sorted once on the next query, so
+ * indexing a whole journal costs a single sort rather than a shift of
+ * the array per entry.
+ * The number of entries created on each day is maintained alongside for
+ * the calendar view.
+ */
+class TimelineIndex
+{
+public:
+    TimelineIndex();
+    
+    /**
+     * @brief Add an entry, or move it if its creation date changed
+     */
+    void insert(const QString& entryId, const QDateTime& createdAt);
+    void remove(const QString& entryId);
+    void clear();
+    
+    int size() const { return int(m_items.size()); }
+    bool contains(const QString& entryId) const { return m_createdAt.contains(entryId); }
+    QStringList entries() const { return m_createdAt.keys(); }
+    
+    /**
+     * @brief Ids of entries created within [from, to], oldest first
+     * 
+     * An invalid bound leaves that end of the range open.
+     */
+    QStringList range(const QDateTime& from, const QDateTime& to) const;
+    
+    /**
+     * @brief Number of entries created on a calendar day
+     */
+    int countOn(const QDate& date) const { return m_dayCounts.value(date.toJulianDay()); }
+    
+private:
+    struct Item {
+        qint64 time;      // Creation time in ms since epoch
+        QString entryId;
+        
+        bool operator<(const Item& other) const
+        {
+            return time != other.time ? time < other.time : entryId < other.entryId;
+        }
+    };
+    
+    void ensureSorted() const;
+    
+    mutable std::vector<Item> m_items;
+    mutable bool m_sorted;            // False while appended items await sorting
+    QHash<QString, QDateTime> m_createdAt;
+    QHash<qint64, int> m_dayCounts;   // Julian day -> entries created that day
+};
+
+#endif // TIMELINEINDEX_H
@@ -0,0 +1,88 @@
+#ifndef TITLEINDEX_H
+#define TITLEINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <vector>
+
+/**
+ * @brief Fuzzy search over entry titles and file names
+ *
+ * Every title and file name is lowercased once into contiguous arenas.
+ * A query matches an entry when its characters appear in order in
+ * the title or the file name. Each entry also carries a 64-bit mask of the
+ * characters it contains, so most non-matches are rejected by one AND
+ * over a packed array before any text is looked at; that loop is
+ * branch-free and the compiler vectorises it. Large candidate sets are
+ * scored in parallel chunks that each keep only their own best rows.
+ *
+ * The index is immutable once built and can be searched from any thread.
+ */
+class TitleIndex
+{
+public:
+    struct Match {
+        int entry;
+        int score;
+    };
+    
+    /**
+     * @param titles Display title for each entry path
+     */
+    explicit TitleIndex(const QHash<QString, QString>& titles);
+    
+    /**
+     * @brief The form queries are matched in: lowercase, without spaces
+     */
+    static QString foldQuery(const QString& query);
+    
+    int size() const { return int(m_paths.size()); }
+    QString path(int entry) const { return m_paths.at(entry); }
+    QString title(int entry) const { return m_titles.at(entry); }
+    
+    /**
+     * @brief Best matches for @p query, highest score first
+     *
+     * @param within   If set, only these entries are considered. Pass the
+     *                 matches of a query that @p query extends to narrow the
+     *                 previous result instead of scanning everything.
+     * @param matched  If set, receives every matching entry, unranked
+     */
+    QList<Match> search(const QString& query, int limit,
+                        const QVector<int> *within = nullptr,
+                        QVector<int> *matched = nullptr) const;
+
+private:
+    struct Span {
+        quint32 offset;
+        quint32 length;
+    };
+    
+    struct ChunkResult {
+        std::vector<Match> best;
+        QVector<int> matched;
+    };
+    
+    static quint64 charMask(const char16_t *text, int length);
+    static int score(const char16_t *query, int queryLength,
+                     const std::vector<char16_t>& arena, const Span& span);
+    ChunkResult scoreChunk(const char16_t *query, int queryLength,
+                           const int *candidates, int count, int limit) const;
+    bool ranksBefore(const Match& a, const Match& b) const;
+    
+    QStringList m_paths;
+    QStringList m_titles;
+    
+    // Titles and file names live in separate arenas so a scan that only
+    // needs titles streams through titles alone
+    std::vector<char16_t> m_titleArena;
+    std::vector<char16_t> m_nameArena;
+    std::vector<Span> m_titleSpans;
+    std::vector<Span> m_nameSpans;
+    std::vector<quint64> m_masks;
+};
+
+#endif // TITLEINDEX_H
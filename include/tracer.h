@@ -0,0 +1,108 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct TraceRing;
+struct TraceThread;
+
+/**
+ * @brief Process-wide recorder of timed spans
+ *
+ * Each thread appends finished spans to its own fixed-size ring buffer,
+ * so recording takes no lock and old spans are overwritten once a ring
+ * is full. A thread's ring is handed on to the next new thread once it
+ * exits, spans and all, so pools that retire and recreate threads do
+ * not grow the tracer. When tracing is off a span costs one relaxed
+ * atomic load.
+ * The collected spans are written out in the Chrome trace-event format,
+ * which chrome://tracing and Perfetto open directly.
+ */
+class Tracer
+{
+public:
+    static Tracer& instance();
+    
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    
+    /**
+     * @brief Start or stop recording
+     *
+     * Starting discards anything recorded by an earlier session.
+     */
+    void setEnabled(bool enabled);
+    
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    
+    /**
+     * @brief Append a finished span to the calling thread's ring
+     *
+     * @p name and @p category must outlive the tracer; pass string
+     * literals.
+     */
+    void record(const char *name, const char *category, qint64 start, qint64 duration);
+    
+    /**
+     * @brief Write every span still held in the rings as Chrome trace JSON
+     */
+    bool writeChromeTrace(const QString& fileName) const;
+
+private:
+    Tracer();
+    ~Tracer();
+    Q_DISABLE_COPY(Tracer)
+    friend struct TraceThread;
+    
+    TraceRing *registerThread();
+    void releaseThread(TraceRing *ring);
+    
+    static std::atomic<bool> s_enabled;
+    
+    QElapsedTimer m_clock;
+    std::atomic<qint64> m_since;
+    
+    // Guards registration only; recording never takes it
+    mutable QMutex m_ringsMutex;
+    std::vector<std::unique_ptr<TraceRing>> m_rings;
+    std::vector<TraceRing *> m_freeRings;     // Rings of threads that have exited
+};
+
+/**
+ * @brief Records the lifetime of a scope as one span
+ *
+ * @code
+ * TraceSpan span("FileManager::loadAllEntries", "io");
+ * @endcode
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name, const char *category)
+        : m_name(name)
+        , m_category(category)
+        , m_start(Tracer::isEnabled() ? Tracer::instance().now() : -1)
+    {
+    }
+    
+    ~TraceSpan()
+    {
+        if (m_start >= 0) {
+            Tracer &tracer = Tracer::instance();
+            tracer.record(m_name, m_category, m_start, tracer.now() - m_start);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+    
+    const char *m_name;
+    const char *m_category;
+    qint64 m_start;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,302 @@
+#include "archivestore.h"
+#include "tracer.h"
+#include "markdownformat.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+// Archive layout: 16-byte header, compressed entry blocks, the index
+// written with QDataStream, then a 16-byte trailer pointing at the index.
+static const char ARCHIVE_MAGIC[8] = { 'J', 'R', 'N', 'L', 'A', 'R', 'C', '1' };
+static const char INDEX_MAGIC[8] = { 'J', 'R', 'N', 'L', 'A', 'I', 'D', '2' };
+// Index of archives written before entry ids were recorded in it
+static const char INDEX_MAGIC_V1[8] = { 'J', 'R', 'N', 'L', 'A', 'I', 'D', 'X' };
+static const qint64 ARCHIVE_HEADER_SIZE = 16;
+static const qint64 ARCHIVE_TRAILER_SIZE = 16;
+static const int COMPRESSION_LEVEL = 9;
+
+ArchiveStore::ArchiveStore(const QString& directory)
+    : m_directory(directory)
+{
+}
+
+void ArchiveStore::load()
+{
+    QMutexLocker locker(&m_mutex);
+    m_index.clear();
+    
+    QDir dir(m_directory);
+    const QStringList files = dir.entryList(QStringList() << "*.jarc", QDir::Files, QDir::Name);
+    for (const QString& fileName : files) {
+        loadArchive(fileName.chopped(5));
+    }
+}
+
+bool ArchiveStore::contains(const QString& key) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.contains(key);
+}
+
+QList<ArchiveStore::ArchivedEntry> ArchiveStore::entries() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.values();
+}
+
+JournalEntry ArchiveStore::readEntry(const QString& key) const
+{
+    TraceSpan span("ArchiveStore::readEntry", "io");
+    
+    ArchivedEntry meta;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_index.constFind(key);
+        if (it == m_index.constEnd()) {
+            return JournalEntry();
+        }
+        meta = *it;
+    }
+    
+    QByteArray text = qUncompress(readBlock(meta));
+    if (text.isEmpty()) {
+        qWarning() << "Failed to decompress archived entry:" << key;
+        return JournalEntry();
+    }
+    
+    return MarkdownFormat::parse(QString::fromUtf8(text));
+}
+
+bool ArchiveStore::addEntries(const QHash<QString, JournalEntry>& entries)
+{
+    TraceSpan span("ArchiveStore::addEntries", "io");
+    
+    QMutexLocker locker(&m_mutex);
+    
+    // Group new blocks by the month archive they belong to, and note the
+    // entries that move to another month because their date changed
+    QHash<QString, QList<Block>> added;
+    QHash<QString, QSet<QString>> moved;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        const JournalEntry& entry = it.value();
+        
+        Block block;
+        block.meta.key = it.key();
+        block.meta.id = entry.id();
+        block.meta.title = entry.title();
+        block.meta.createdAt = entry.createdAt();
+        block.meta.modifiedAt = entry.modifiedAt();
+        block.meta.month = entry.createdAt().toString("yyyy-MM");
+        block.data = qCompress(MarkdownFormat::serialize(entry).toUtf8(), COMPRESSION_LEVEL);
+        
+        auto archived = m_index.constFind(block.meta.key);
+        if (archived != m_index.constEnd() && archived->month != block.meta.month) {
+            moved[archived->month].insert(block.meta.key);
+        }
+        added[block.meta.month].append(block);
+    }
+    
+    if (!QDir().mkpath(m_directory)) {
+        qWarning() << "Failed to create archive directory:" << m_directory;
+        return false;
+    }
+    
+    bool success = true;
+    for (auto it = added.begin(); it != added.end(); ++it) {
+        // Keys being re-archived replace their previous blocks
+        QSet<QString> replaced;
+        for (const Block& block : it.value()) {
+            replaced.insert(block.meta.key);
+        }
+        
+        QList<Block> blocks;
+        if (!readBlocksExcept(it.key(), replaced, &blocks)) {
+            success = false;
+            continue;
+        }
+        blocks += it.value();
+        success = writeArchive(it.key(), blocks) && success;
+    }
+    
+    // Moved entries leave their old archive only once the new one holds
+    // them; an entry whose new archive failed still points at the old one
+    for (auto it = moved.constBegin(); it != moved.constEnd(); ++it) {
+        QSet<QString> keys;
+        for (const QString& key : it.value()) {
+            if (m_index.value(key).month != it.key()) {
+                keys.insert(key);
+            }
+        }
+        if (!keys.isEmpty()) {
+            success = rewriteWithout(it.key(), keys) && success;
+        }
+    }
+    
+    return success;
+}
+
+bool ArchiveStore::removeEntry(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    auto it = m_index.constFind(key);
+    if (it == m_index.constEnd()) {
+        return false;
+    }
+    
+    if (!rewriteWithout(it->month, QSet<QString>{ key })) {
+        return false;
+    }
+    m_index.remove(key);
+    return true;
+}
+
+QString ArchiveStore::archivePath(const QString& month) const
+{
+    return m_directory + "/" + month + ".jarc";
+}
+
+bool ArchiveStore::loadArchive(const QString& month)
+{
+    QFile file(archivePath(month));
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open archive:" << file.fileName();
+        return false;
+    }
+    
+    const qint64 size = file.size();
+    if (size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE ||
+        file.read(sizeof(ARCHIVE_MAGIC)) != QByteArray(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC))) {
+        qWarning() << "Not a jrnl archive:" << file.fileName();
+        return false;
+    }
+    
+    // Only the trailer and index are read; entry blocks stay compressed
+    file.seek(size - ARCHIVE_TRAILER_SIZE);
+    QDataStream trailer(&file);
+    qint64 indexOffset = 0;
+    trailer >> indexOffset;
+    const QByteArray indexMagic = file.read(sizeof(INDEX_MAGIC));
+    const bool hasIds = indexMagic == QByteArray(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    if ((!hasIds && indexMagic != QByteArray(INDEX_MAGIC_V1, sizeof(INDEX_MAGIC_V1))) ||
+        indexOffset < ARCHIVE_HEADER_SIZE || indexOffset > size - ARCHIVE_TRAILER_SIZE) {
+        qWarning() << "Archive index is damaged:" << file.fileName();
+        return false;
+    }
+    
+    file.seek(indexOffset);
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    
+    quint32 count = 0;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        ArchivedEntry meta;
+        in >> meta.key;
+        if (hasIds) {
+            in >> meta.id;
+        }
+        in >> meta.title >> meta.createdAt >> meta.modifiedAt >> meta.offset >> meta.size;
+        meta.month = month;
+        
+        // Older archives only have the id in the entry text. It is read
+        // from there until the archive is next rewritten
+        if (!hasIds && in.status() == QDataStream::Ok) {
+            const QByteArray text = qUncompress(readBlock(meta));
+            meta.id = MarkdownFormat::parse(QString::fromUtf8(text)).id();
+        }
+        m_index.insert(meta.key, meta);
+    }
+    
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray ArchiveStore::readBlock(const ArchivedEntry& meta) const
+{
+    QFile file(archivePath(meta.month));
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(meta.offset)) {
+        qWarning() << "Failed to read archive:" << file.fileName();
+        return QByteArray();
+    }
+    return file.read(meta.size);
+}
+
+bool ArchiveStore::readBlocksExcept(const QString& month, const QSet<QString>& excluded,
+                                    QList<Block> *blocks) const
+{
+    for (const ArchivedEntry& meta : m_index) {
+        if (meta.month == month && !excluded.contains(meta.key)) {
+            const QByteArray data = readBlock(meta);
+            if (data.size() != meta.size) {
+                qWarning() << "Failed to read archived entry, leaving archive unchanged:" << meta.key;
+                return false;
+            }
+            blocks->append(Block{ meta, data });
+        }
+    }
+    return true;
+}
+
+bool ArchiveStore::rewriteWithout(const QString& month, const QSet<QString>& keys)
+{
+    QList<Block> blocks;
+    if (!readBlocksExcept(month, keys, &blocks)) {
+        return false;
+    }
+    
+    if (blocks.isEmpty()) {
+        return QFile::remove(archivePath(month));
+    }
+    return writeArchive(month, blocks);
+}
+
+bool ArchiveStore::writeArchive(const QString& month, QList<Block>& blocks)
+{
+    // Keep blocks in creation order so neighbouring entries sit together
+    std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) {
+        return a.meta.createdAt < b.meta.createdAt;
+    });
+    
+    QSaveFile file(archivePath(month));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write archive:" << file.fileName();
+        return false;
+    }
+    
+    QByteArray header(ARCHIVE_HEADER_SIZE, '\0');
+    std::copy(ARCHIVE_MAGIC, ARCHIVE_MAGIC + sizeof(ARCHIVE_MAGIC), header.begin());
+    file.write(header);
+    
+    qint64 pos = ARCHIVE_HEADER_SIZE;
+    for (Block& block : blocks) {
+        block.meta.month = month;
+        block.meta.offset = pos;
+        block.meta.size = block.data.size();
+        file.write(block.data);
+        pos += block.data.size();
+    }
+    
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << quint32(blocks.size());
+    for (const Block& block : blocks) {
+        const ArchivedEntry& meta = block.meta;
+        out << meta.key << meta.id << meta.title << meta.createdAt << meta.modifiedAt << meta.offset << meta.size;
+    }
+    out << pos;
+    out.writeRawData(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    
+    if (!file.commit()) {
+        qWarning() << "Failed to commit archive:" << file.fileName();
+        return false;
+    }
+    
+    for (const Block& block : blocks) {
+        m_index.insert(block.meta.key, block.meta);
+    }
+    return true;
+}
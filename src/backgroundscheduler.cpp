@@ -0,0 +1,168 @@
+#include "backgroundscheduler.h"
+#include "tracer.h"
+#include <QMutexLocker>
+#include <QThread>
+
+// Workers that background journals may occupy at the same time
+static const int MAX_BACKGROUND_WORKERS = 1;
+
+BackgroundScheduler& BackgroundScheduler::instance()
+{
+    static BackgroundScheduler scheduler;
+    return scheduler;
+}
+
+BackgroundScheduler::BackgroundScheduler()
+    : m_activeOwner(nullptr)
+    , m_workers(0)
+    , m_foregroundRunning(0)
+    , m_backgroundRunning(0)
+    , m_yielding(0)
+{
+    m_pool.setObjectName("BackgroundScheduler");
+    
+    // A background task paused in yield() holds its worker, so keep at
+    // least one more for the foreground
+    m_pool.setMaxThreadCount(qMax(MAX_BACKGROUND_WORKERS + 1, QThread::idealThreadCount()));
+}
+
+BackgroundScheduler::~BackgroundScheduler()
+{
+    m_pool.waitForDone();
+}
+
+void BackgroundScheduler::setActiveOwner(const void *owner)
+{
+    QMutexLocker locker(&m_mutex);
+    m_activeOwner = owner;
+    
+    // Tasks held back as background work may be runnable now
+    startWorkers();
+    m_changed.wakeAll();
+}
+
+bool BackgroundScheduler::isActive(const void *owner) const
+{
+    QMutexLocker locker(&m_mutex);
+    return owner == m_activeOwner;
+}
+
+void BackgroundScheduler::submit(const void *owner, std::function<void()> task)
+{
+    QMutexLocker locker(&m_mutex);
+    m_queue.append(Task{ owner, std::move(task) });
+    startWorkers();
+}
+
+bool BackgroundScheduler::yield(const void *owner)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_cancelled.contains(owner) || owner == m_activeOwner || !foregroundPending()) {
+        return !m_cancelled.contains(owner);
+    }
+    
+    // This worker is parked until the foreground is done, so the tasks
+    // it was counted on to pick up may need a worker of their own
+    ++m_yielding;
+    startWorkers();
+    while (!m_cancelled.contains(owner) && owner != m_activeOwner && foregroundPending()) {
+        m_changed.wait(&m_mutex);
+    }
+    --m_yielding;
+    return !m_cancelled.contains(owner);
+}
+
+void BackgroundScheduler::cancel(const void *owner)
+{
+    QList<Task> dropped;
+    
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_queue.size() - 1; i >= 0; --i) {
+        if (m_queue.at(i).owner == owner) {
+            dropped.append(m_queue.takeAt(i));
+        }
+    }
+    
+    m_cancelled.insert(owner);
+    m_changed.wakeAll();
+    while (m_running.contains(owner)) {
+        m_changed.wait(&m_mutex);
+    }
+    m_cancelled.remove(owner);
+    locker.unlock();
+    
+    // Dropped tasks cancel their futures as they are destroyed; do that
+    // outside the lock since it may run continuations
+    dropped.clear();
+}
+
+int BackgroundScheduler::nextTaskIndex() const
+{
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue.at(i).owner == m_activeOwner) {
+            return i;
+        }
+    }
+    
+    // Oldest background task, if the background share is not used up
+    if (!m_queue.isEmpty() && m_backgroundRunning < MAX_BACKGROUND_WORKERS) {
+        return 0;
+    }
+    return -1;
+}
+
+bool BackgroundScheduler::foregroundPending() const
+{
+    if (m_foregroundRunning > 0) {
+        return true;
+    }
+    for (const Task& task : m_queue) {
+        if (task.owner == m_activeOwner) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BackgroundScheduler::startWorkers()
+{
+    // Workers parked in yield() will not pick up anything until the
+    // queued foreground work has run
+    while (m_workers < m_pool.maxThreadCount() && m_workers - m_yielding < m_queue.size()) {
+        ++m_workers;
+        m_pool.start([this]() { workerLoop(); });
+    }
+}
+
+void BackgroundScheduler::workerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    forever {
+        int index = nextTaskIndex();
+        if (index < 0) {
+            --m_workers;
+            return;
+        }
+        
+        Task task = m_queue.takeAt(index);
+        bool foreground = task.owner == m_activeOwner;
+        ++(foreground ? m_foregroundRunning : m_backgroundRunning);
+        ++m_running[task.owner];
+        locker.unlock();
+        
+        {
+            TraceSpan span(foreground ? "BackgroundScheduler::foreground"
+                                      : "BackgroundScheduler::background", "scheduler");
+            task.run();
+            task.run = nullptr;
+        }
+        
+        locker.relock();
+        --(foreground ? m_foregroundRunning : m_backgroundRunning);
+        if (--m_running[task.owner] == 0) {
+            m_running.remove(task.owner);
+        }
+        m_changed.wakeAll();
+    }
+}
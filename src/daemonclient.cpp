@@ -0,0 +1,202 @@
+#include "daemonclient.h"
+#include <QElapsedTimer>
+#include <QDebug>
+
+using DaemonProtocol::Message;
+
+// Connecting fails at once when no daemon is listening; this only
+// bounds a daemon that is wedged
+static const int CONNECT_TIMEOUT_MS = 200;
+
+// Covers the daemon loading a large journal for the first time
+static const int REPLY_TIMEOUT_MS = 30000;
+
+DaemonClient::DaemonClient()
+    : m_nextRequestId(1)
+{
+}
+
+DaemonClient::~DaemonClient()
+{
+    m_socket.abort();
+}
+
+bool DaemonClient::connectToDaemon()
+{
+    m_buffer.clear();
+    m_socket.connectToServer(DaemonProtocol::serverName());
+    if (!m_socket.waitForConnected(CONNECT_TIMEOUT_MS)) {
+        m_socket.abort();
+        return false;
+    }
+    
+    QByteArray results;
+    if (!request(Message::Hello, DaemonProtocol::encode(DaemonProtocol::VERSION), &results, nullptr)) {
+        return false;
+    }
+    
+    QDataStream in(results);
+    in.setVersion(DaemonProtocol::STREAM_VERSION);
+    quint32 version = 0;
+    in >> version;
+    if (version != DaemonProtocol::VERSION) {
+        qWarning() << "Ignoring jrnl daemon with protocol version" << version;
+        m_socket.abort();
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::isConnected() const
+{
+    return m_socket.state() == QLocalSocket::ConnectedState;
+}
+
+bool DaemonClient::listEntries(const QString& journal, const QString& filter,
+                               QList<EntrySummary> *entries, QString *error)
+{
+    QByteArray results;
+    if (!request(Message::ListEntries, DaemonProtocol::encode(journal, filter), &results, error)) {
+        return false;
+    }
+    
+    QDataStream in(results);
+    in.setVersion(DaemonProtocol::STREAM_VERSION);
+    quint32 count = 0;
+    in >> count;
+    
+    entries->clear();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        EntrySummary entry;
+        in >> entry.id >> entry.filePath >> entry.title >> entry.createdAt;
+        entries->append(entry);
+    }
+    
+    if (in.status() != QDataStream::Ok) {
+        if (error) {
+            *error = tr("The jrnl daemon sent an invalid reply");
+        }
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::readEntry(const QString& journal, const QString& entry,
+                             QString *filePath, QString *text, QString *error)
+{
+    QByteArray results;
+    if (!request(Message::ReadEntry, DaemonProtocol::encode(journal, entry), &results, error)) {
+        return false;
+    }
+    
+    QDataStream in(results);
+    in.setVersion(DaemonProtocol::STREAM_VERSION);
+    in >> *filePath >> *text;
+    if (in.status() != QDataStream::Ok) {
+        if (error) {
+            *error = tr("The jrnl daemon sent an invalid reply");
+        }
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::snapshot(const QString& journal, QHash<QString, SnapshotEntry> *entries)
+{
+    QByteArray results;
+    QString error;
+    if (!request(Message::Snapshot, DaemonProtocol::encode(journal), &results, &error)) {
+        qWarning() << "Failed to fetch entries from the jrnl daemon:" << error;
+        return false;
+    }
+    
+    QDataStream in(results);
+    in.setVersion(DaemonProtocol::STREAM_VERSION);
+    quint32 count = 0;
+    in >> count;
+    
+    entries->clear();
+    entries->reserve(count);
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString key;
+        SnapshotEntry entry;
+        in >> key >> entry.version >> entry.text;
+        entries->insert(key, entry);
+    }
+    
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Failed to read entries from the jrnl daemon";
+        entries->clear();
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::shutdown()
+{
+    QByteArray results;
+    return request(Message::Shutdown, QByteArray(), &results, nullptr);
+}
+
+bool DaemonClient::request(Message type, const QByteArray& arguments,
+                           QByteArray *results, QString *error)
+{
+    auto fail = [error](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    };
+    
+    if (!isConnected()) {
+        return fail(tr("Not connected to the jrnl daemon"));
+    }
+    
+    const quint32 requestId = m_nextRequestId++;
+    QByteArray payload = DaemonProtocol::encode(quint8(type), requestId);
+    payload.append(arguments);
+    m_socket.write(DaemonProtocol::frame(payload));
+    
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        QByteArray reply;
+        const DaemonProtocol::FrameStatus status = DaemonProtocol::takeFrame(&m_buffer, &reply);
+        if (status == DaemonProtocol::FrameStatus::Invalid) {
+            m_socket.abort();
+            return fail(tr("The jrnl daemon sent an invalid reply"));
+        }
+        
+        if (status == DaemonProtocol::FrameStatus::Complete) {
+            QDataStream in(reply);
+            in.setVersion(DaemonProtocol::STREAM_VERSION);
+            quint8 replyType = 0;
+            quint32 replyId = 0;
+            in >> replyType >> replyId;
+            
+            // Requests are answered in order, one at a time
+            if (in.status() != QDataStream::Ok || replyId != requestId) {
+                m_socket.abort();
+                return fail(tr("The jrnl daemon sent an invalid reply"));
+            }
+            
+            if (Message(replyType) == Message::Failure) {
+                QString message;
+                in >> message;
+                return fail(message);
+            }
+            
+            // The results follow the type and id
+            *results = reply.mid(sizeof(quint8) + sizeof(quint32));
+            return true;
+        }
+        
+        // Waiting for the reply also flushes the request
+        const qint64 remaining = REPLY_TIMEOUT_MS - timer.elapsed();
+        if (remaining <= 0 || !m_socket.waitForReadyRead(int(remaining))) {
+            m_socket.abort();
+            return fail(tr("The jrnl daemon did not answer"));
+        }
+        m_buffer.append(m_socket.readAll());
+    }
+}
@@ -0,0 +1,49 @@
+#include "daemonprotocol.h"
+#include <QStandardPaths>
+#include <QtEndian>
+
+// Larger frames mean a confused peer, not a journal
+static const quint32 MAX_FRAME_SIZE = 1u << 30;
+
+namespace DaemonProtocol {
+
+QString serverName()
+{
+#ifdef Q_OS_UNIX
+    // The runtime directory is private to the user
+    const QString runtime = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (!runtime.isEmpty()) {
+        return runtime + "/jrnl-daemon";
+    }
+#endif
+    return "jrnl-daemon-" + qEnvironmentVariable("USER", qEnvironmentVariable("USERNAME"));
+}
+
+QByteArray frame(const QByteArray& payload)
+{
+    QByteArray data(4, '\0');
+    qToLittleEndian<quint32>(quint32(payload.size()), data.data());
+    data.append(payload);
+    return data;
+}
+
+FrameStatus takeFrame(QByteArray *buffer, QByteArray *payload)
+{
+    if (buffer->size() < 4) {
+        return FrameStatus::Incomplete;
+    }
+    
+    const quint32 size = qFromLittleEndian<quint32>(buffer->constData());
+    if (size > MAX_FRAME_SIZE) {
+        return FrameStatus::Invalid;
+    }
+    if (buffer->size() - 4 < qsizetype(size)) {
+        return FrameStatus::Incomplete;
+    }
+    
+    *payload = buffer->mid(4, size);
+    buffer->remove(0, 4 + size);
+    return FrameStatus::Complete;
+}
+
+} // namespace DaemonProtocol
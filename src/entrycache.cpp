@@ -0,0 +1,68 @@
+#include "entrycache.h"
+#include <QMutexLocker>
+
+// Rough fixed cost of an entry beyond its text
+static const qint64 ENTRY_OVERHEAD_BYTES = 256;
+
+EntryCache::EntryCache(qint64 maxBytes)
+    : m_cache(maxBytes)
+{
+}
+
+bool EntryCache::find(const QString& key, const QDateTime& version, JournalEntry *entry)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // object() also marks the entry as most recently used
+    Item *item = m_cache.object(key);
+    if (!item || item->version != version) {
+        return false;
+    }
+    
+    *entry = item->entry;
+    return true;
+}
+
+bool EntryCache::contains(const QString& key, const QDateTime& version) const
+{
+    QMutexLocker locker(&m_mutex);
+    const Item *item = m_cache.object(key);
+    return item && item->version == version;
+}
+
+void EntryCache::insert(const QString& key, const JournalEntry& entry, const QDateTime& version,
+                        bool replace)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // Without replace, only an older version gives way, such as one a
+    // prefetch finds changed on disk
+    if (!replace) {
+        const Item *cached = m_cache.object(key);
+        if (cached && !(cached->version < version)) {
+            return;
+        }
+    }
+    
+    const qint64 cost = ENTRY_OVERHEAD_BYTES
+        + (entry.title().size() + entry.content().size() + entry.filePath().size()) * qint64(sizeof(QChar));
+    m_cache.insert(key, new Item{ entry, version }, cost);
+}
+
+void EntryCache::remove(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(key);
+}
+
+void EntryCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+}
+
+void EntryCache::setMaxBytes(qint64 maxBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(maxBytes);
+}
@@ -0,0 +1,90 @@
+#include "entryidindex.h"
+#include <QUuid>
+
+EntryIdIndex::EntryIdIndex()
+{
+}
+
+QString EntryIdIndex::insert(const QString& key, const QString& id, bool claim)
+{
+    const QString known = idForKey(key);
+    if (id.isEmpty() || id == known) {
+        return known.isEmpty() ? assign(key, createId()) : known;
+    }
+    
+    // Another entry already answers to this id, so one of them is a copy
+    const QString holder = conflictingKey(key, id);
+    if (!holder.isEmpty()) {
+        if (!claim) {
+            return known.isEmpty() ? assign(key, createId()) : known;
+        }
+        release(holder, id);
+    }
+    return assign(key, id);
+}
+
+QString EntryIdIndex::conflictingKey(const QString& key, const QString& id) const
+{
+    const QString holder = m_keysById.value(id);
+    return holder != key ? holder : QString();
+}
+
+void EntryIdIndex::removeKey(const QString& key)
+{
+    const QStringList ids = m_idsByKey.take(key);
+    for (const QString& id : ids) {
+        m_keysById.remove(id);
+    }
+}
+
+void EntryIdIndex::renameKey(const QString& from, const QString& to)
+{
+    if (from == to || !m_idsByKey.contains(from)) {
+        return;
+    }
+    
+    removeKey(to);
+    const QStringList ids = m_idsByKey.take(from);
+    for (const QString& id : ids) {
+        m_keysById.insert(id, to);
+    }
+    m_idsByKey.insert(to, ids);
+}
+
+void EntryIdIndex::clear()
+{
+    m_keysById.clear();
+    m_idsByKey.clear();
+}
+
+QString EntryIdIndex::idForKey(const QString& key) const
+{
+    auto ids = m_idsByKey.constFind(key);
+    return ids != m_idsByKey.constEnd() ? ids->first() : QString();
+}
+
+QString EntryIdIndex::createId()
+{
+    return QUuid::createUuid().toString(QUuid::WithoutBraces);
+}
+
+QString EntryIdIndex::assign(const QString& key, const QString& id)
+{
+    m_keysById.insert(id, key);
+    QStringList& ids = m_idsByKey[key];
+    ids.removeAll(id);
+    ids.prepend(id);
+    return id;
+}
+
+void EntryIdIndex::release(const QString& key, const QString& id)
+{
+    m_keysById.remove(id);
+    QStringList& ids = m_idsByKey[key];
+    ids.removeAll(id);
+    
+    // An entry is never left without an id
+    if (ids.isEmpty()) {
+        assign(key, createId());
+    }
+}
@@ -1,26 +1,62 @@
 #include "filemanager.h"
+#include "tracer.h"
+#include "markdownbackend.h"
+#include "packedbackend.h"
+#include "archivestore.h"
+#include "markdownformat.h"
+#include "backgroundscheduler.h"
+#include "daemonclient.h"
 #include <QFile>
-#include <QTextStream>
 #include <QFileInfo>
 #include <QRegularExpression>
+#include <QSettings>
+#include <QSet>
+#include <QMutexLocker>
 #include <QDebug>
+#include <algorithm>
+
+// Per-journal metadata lives in a hidden directory next to the entries
+static const char *METADATA_DIR = ".jrnl-meta";
+static const char *CONFIG_FILE = "journal.ini";
+static const char *PACK_FILE = "journal.jpack";
+static const char *PACK_LOCK_FILE = "pack.lock";
+static const char *ARCHIVE_DIR = "archive";
+static const char *REVISIONS_DIR = "revisions";
+static const int DEFAULT_ARCHIVE_AGE_DAYS = 365;
+static const int DEFAULT_CACHE_MB = 64;
 
 FileManager::FileManager()
     : m_journalDir(QDir::homePath() + "/.jrnl")
+    , m_layout(Layout::Flat)
+    , m_backendType(Backend::Markdown)
+    , m_cache(qint64(DEFAULT_CACHE_MB) * 1024 * 1024)
+    , m_prefetchActive(false)
 {
     ensureDirectoryExists();
+    loadJournalConfig();
 }
 
 FileManager::FileManager(const QString& journalDirectory)
     : m_journalDir(journalDirectory)
+    , m_layout(Layout::Flat)
+    , m_backendType(Backend::Markdown)
+    , m_cache(qint64(DEFAULT_CACHE_MB) * 1024 * 1024)
+    , m_prefetchActive(false)
 {
     ensureDirectoryExists();
+    loadJournalConfig();
+}
+
+FileManager::~FileManager()
+{
+    cancelBackgroundWork();
 }
 
 void FileManager::setJournalDirectory(const QString& path)
 {
     m_journalDir.setPath(path);
     ensureDirectoryExists();
+    loadJournalConfig();
 }
 
 bool FileManager::ensureDirectoryExists()
@@ -31,8 +67,179 @@ bool FileManager::ensureDirectoryExists()
     return true;
 }
 
+void FileManager::setLayout(Layout layout)
+{
+    m_layout = layout;
+    if (m_backendType == Backend::Markdown) {
+        static_cast<MarkdownBackend *>(m_backend.get())->setSharded(layout == Layout::Sharded);
+    }
+    
+    m_journalDir.mkpath(METADATA_DIR);
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    config.setValue("storage/layout", layout == Layout::Sharded ? "sharded" : "flat");
+    config.sync();
+}
+
+bool FileManager::setBackend(Backend backend)
+{
+    TraceSpan span("FileManager::setBackend", "io");
+    
+    if (backend == m_backendType) {
+        return true;
+    }
+    
+    std::unique_ptr<StorageBackend> target = createBackend(backend);
+    if (!target) {
+        return false;
+    }
+    
+    // Copy every entry across before touching the source
+    const QStringList keys = m_backend->listKeys();
+    QStringList copied;
+    for (const QString& key : keys) {
+        JournalEntry entry = m_backend->readEntry(key);
+        if (entry.isEmpty()) {
+            // It may still hold something, so it is never deleted below
+            qWarning() << "Failed to read entry, leaving it in the old storage:" << key;
+            continue;
+        }
+        if (!target->writeEntry(key, entry)) {
+            qWarning() << "Failed to convert entry, keeping current storage:" << key;
+            return false;
+        }
+        copied.append(key);
+    }
+    
+    // Record the switch first so a crash below never loses the new copy
+    m_journalDir.mkpath(METADATA_DIR);
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    config.setValue("storage/backend", backend == Backend::Packed ? "packed" : "markdown");
+    config.sync();
+    
+    waitForPrefetch();
+    m_cache.clear();
+    
+    std::unique_ptr<StorageBackend> source = std::move(m_backend);
+    m_backend = std::move(target);
+    m_backendType = backend;
+    
+    // Drop the old representation of every entry that was copied
+    if (backend == Backend::Packed) {
+        for (const QString& key : std::as_const(copied)) {
+            source->removeEntry(key);
+        }
+    } else {
+        source.reset();
+        const QString packPath = m_journalDir.absoluteFilePath(PACK_FILE);
+        if (copied.size() == keys.size()) {
+            QFile::remove(packPath);
+        } else {
+            // Set aside rather than deleted, and out of the way of a later
+            // switch back to the packed store
+            const QString keptPath = packPath + "." + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss");
+            QFile::rename(packPath, keptPath);
+            qWarning() << "Kept pack file with entries that could not be converted:" << keptPath;
+        }
+    }
+    
+    return true;
+}
+
+bool FileManager::exportToMarkdown(const QString& directory)
+{
+    TraceSpan span("FileManager::exportToMarkdown", "io");
+    
+    bool success = true;
+    
+    // Packed records already hold the Markdown text, so copy it verbatim
+    if (m_backendType == Backend::Packed) {
+        success = static_cast<PackedBackend *>(m_backend.get())->exportToMarkdown(directory);
+    } else {
+        MarkdownBackend target(directory);
+        const QStringList keys = m_backend->listKeys();
+        for (const QString& key : keys) {
+            success = target.writeEntry(key, m_backend->readEntry(key)) && success;
+        }
+    }
+    
+    // Archived entries are part of the journal too
+    MarkdownBackend target(directory);
+    const QList<ArchiveStore::ArchivedEntry> archived = m_archive->entries();
+    for (const ArchiveStore::ArchivedEntry& meta : archived) {
+        success = target.writeEntry(meta.key, m_archive->readEntry(meta.key)) && success;
+    }
+    
+    return success;
+}
+
+int FileManager::migrateToShardedLayout(const std::function<bool(int, int)>& progress)
+{
+    TraceSpan span("FileManager::migrateToShardedLayout", "io");
+    
+    // New entries go straight into shards while the old ones are moved
+    setLayout(Layout::Sharded);
+    
+    // Only the Markdown backend keeps entries in directories
+    if (m_backendType != Backend::Markdown) {
+        return 0;
+    }
+    
+    QStringList nameFilters;
+    nameFilters << "*.md";
+    const QStringList flatFiles = m_journalDir.entryList(nameFilters, QDir::Files, QDir::Unsorted);
+    const int total = flatFiles.size();
+    
+    int moved = 0;
+    int done = 0;
+    for (const QString& fileName : flatFiles) {
+        if (progress && !progress(done, total)) {
+            break;
+        }
+        ++done;
+        
+        QString shard = shardForFileName(fileName);
+        if (shard.isEmpty()) {
+            // Not a generated name, fall back to the entry's own creation date
+            JournalEntry entry = m_backend->readEntry(fileName);
+            if (!entry.createdAt().isValid()) {
+                continue;
+            }
+            shard = entry.createdAt().toString("yyyy/MM");
+        }
+        
+        if (!m_journalDir.mkpath(shard)) {
+            qWarning() << "Failed to create shard directory:" << shard;
+            continue;
+        }
+        
+        const QString target = shard + "/" + fileName;
+        if (m_journalDir.exists(target)) {
+            qWarning() << "Skipping migration, target already exists:" << target;
+            continue;
+        }
+        
+        // Rename within the same filesystem is atomic, so readers see the
+        // entry either at its old or its new location
+        if (m_journalDir.rename(fileName, target)) {
+            m_entryIds.renameKey(fileName, target);
+            m_cache.remove(fileName);
+            ++moved;
+        } else {
+            qWarning() << "Failed to move entry into shard:" << fileName;
+        }
+    }
+    
+    if (progress) {
+        progress(done, total);
+    }
+    
+    return moved;
+}
+
 bool FileManager::saveEntry(JournalEntry& entry)
 {
+    TraceSpan span("FileManager::saveEntry", "io");
+    
     QString filePath = entry.filePath();
     
     // Generate filename if not set
@@ -41,41 +248,401 @@ bool FileManager::saveEntry(JournalEntry& entry)
         filePath = m_journalDir.absoluteFilePath(fileName);
     }
     
-    bool success = writeMarkdownFile(filePath, entry);
+    const QString key = entryKey(filePath);
+    
+    // New entries, and ones written before ids existed, get their id now.
+    // An entry loaded before its file was found to be a copy still
+    // carries the original's id; the index has the one it goes by now
+    const QString known = m_entryIds.idForKey(key);
+    if (entry.id().isEmpty()
+        || (!known.isEmpty() && m_entryIds.keyForId(entry.id()) != key)) {
+        entry.setId(known.isEmpty() ? EntryIdIndex::createId() : known);
+    }
+    
+    if (!m_backend->writeEntry(key, entry)) {
+        return false;
+    }
     
     // Update entry's file path after successful save
-    if (success) {
-        entry.setFilePath(filePath);
+    entry.setFilePath(filePath);
+    
+    // Editing an archived entry brings it back into the hot store
+    if (m_archive->contains(key)) {
+        m_archive->removeEntry(key);
     }
     
-    return success;
+    // History follows the id, so it survives renames and moves
+    if (!m_revisions->recordRevision(entry.id(), revisionText(entry))) {
+        qWarning() << "Failed to record revision for:" << filePath;
+    }
+    
+    indexEntry(key, entry);
+    m_cache.insert(key, entry, entryVersion(filePath));
+    
+    return true;
 }
 
 JournalEntry FileManager::loadEntry(const QString& filePath)
 {
-    return parseMarkdownFile(filePath);
+    TraceSpan span("FileManager::loadEntry", "io");
+    
+    const QString key = entryKey(filePath);
+    const QDateTime version = entryVersion(filePath);
+    
+    // Prefetched entries carry the id from their frontmatter, which a
+    // copied file shares with its original
+    JournalEntry entry;
+    if (m_cache.find(key, version, &entry)) {
+        entry.setId(resolveId(key, entry));
+        return entry;
+    }
+    
+    entry = readEntry(key);
+    entry.setFilePath(filePath);
+    if (!entry.isEmpty()) {
+        entry.setId(resolveId(key, entry));
+        m_cache.insert(key, entry, version);
+    }
+    return entry;
+}
+
+QString FileManager::entryPath(const QString& id) const
+{
+    const QString key = m_entryIds.keyForId(id);
+    return key.isEmpty() ? QString() : m_journalDir.absoluteFilePath(key);
+}
+
+QString FileManager::findEntry(const QString& reference) const
+{
+    const QString byId = entryPath(reference);
+    if (!byId.isEmpty()) {
+        return byId;
+    }
+    
+    const QString key = QDir::cleanPath(entryKey(m_journalDir.absoluteFilePath(reference)));
+    return m_entryIds.containsKey(key) ? m_journalDir.absoluteFilePath(key) : QString();
 }
 
-QList<JournalEntry> FileManager::loadAllEntries()
+QString FileManager::entryId(const QString& filePath) const
 {
+    return m_entryIds.idForKey(entryKey(filePath));
+}
+
+QStringList FileManager::entryPaths(const QStringList& ids) const
+{
+    QStringList paths;
+    paths.reserve(ids.size());
+    for (const QString& id : ids) {
+        const QString key = m_entryIds.keyForId(id);
+        if (!key.isEmpty()) {
+            paths.append(m_journalDir.absoluteFilePath(key));
+        }
+    }
+    return paths;
+}
+
+void FileManager::prefetch(const QStringList& filePaths)
+{
+    QList<PrefetchItem> items;
+    for (const QString& filePath : filePaths) {
+        items.append(PrefetchItem{ entryKey(filePath), filePath });
+    }
+    
+    QMutexLocker locker(&m_prefetchMutex);
+    
+    // Only the latest neighbourhood matters; drop anything still queued
+    m_prefetchQueue = items;
+    if (!m_prefetchActive && !m_prefetchQueue.isEmpty()) {
+        m_prefetchActive = true;
+        m_prefetchFuture = BackgroundScheduler::instance().run(this, [this]() { runPrefetch(); });
+    }
+}
+
+QList<JournalEntry> FileManager::loadAllEntries(bool fromDaemon)
+{
+    TraceSpan span("FileManager::loadAllEntries", "io");
+    
     QList<JournalEntry> entries;
+    
+    // Archived entries are listed from the archive index without
+    // decompressing them; their content is loaded by loadEntry()
+    QList<ArchiveStore::ArchivedEntry> archived = m_archive->entries();
+    std::sort(archived.begin(), archived.end(),
+              [](const ArchiveStore::ArchivedEntry& a, const ArchiveStore::ArchivedEntry& b) {
+        return a.createdAt < b.createdAt;
+    });
+    for (const ArchiveStore::ArchivedEntry& meta : archived) {
+        JournalEntry entry;
+        entry.setTitle(meta.title);
+        entry.setCreatedAt(meta.createdAt);
+        entry.setModifiedAt(meta.modifiedAt);
+        entry.setFilePath(m_journalDir.absoluteFilePath(meta.key));
+        
+        // Dates are known without decompressing, content is indexed later
+        entry.setId(m_entryIds.insert(meta.key, meta.id));
+        m_timeline.insert(entry.id(), meta.createdAt);
+        entries.append(entry);
+    }
+    
     QStringList files = listEntryFiles();
+    QSet<QString> seen;
+    
+    // Drop entries that are gone before indexing the rest, so a file
+    // moved by another program keeps its id at the new name
+    const QSet<QString> listed(files.begin(), files.end());
+    const QStringList known = m_timeline.entries();
+    for (const QString& id : known) {
+        const QString key = m_entryIds.keyForId(id);
+        if (key.isEmpty()) {
+            removeFromIndexes(id);
+        } else if (!listed.contains(key) && !m_archive->contains(key)) {
+            unindexEntry(key);
+        }
+    }
+    
+    // A running daemon has already read the files; one message replaces
+    // a file open and read per entry
+    QHash<QString, DaemonClient::SnapshotEntry> snapshot;
+    if (fromDaemon && m_backendType == Backend::Markdown) {
+        DaemonClient client;
+        if (client.connectToDaemon()) {
+            client.snapshot(journalDirectory(), &snapshot);
+        }
+    }
     
     for (const QString& fileName : files) {
-        QString fullPath = m_journalDir.absoluteFilePath(fileName);
-        JournalEntry entry = loadEntry(fullPath);
+        // Scans of hidden journals give way to the one being shown
+        if (!BackgroundScheduler::instance().yield(this)) {
+            return entries;
+        }
+        
+        // Bulk scans bypass the cache so they don't evict recently viewed entries
+        const QString filePath = m_journalDir.absoluteFilePath(fileName);
+        auto cached = snapshot.constFind(fileName);
+        JournalEntry entry;
+        if (cached != snapshot.constEnd()
+            && cached->version == entryVersion(filePath).toMSecsSinceEpoch()) {
+            entry = MarkdownFormat::parse(QString::fromUtf8(cached->text));
+        } else {
+            entry = m_backend->readEntry(fileName);
+        }
+        entry.setFilePath(filePath);
         if (!entry.isEmpty()) {
+            indexEntry(fileName, entry);
             entries.append(entry);
+            seen.insert(fileName);
         }
     }
     
+    // Forget entries that could not be read
+    const QStringList indexed = m_timeline.entries();
+    for (const QString& id : indexed) {
+        const QString key = m_entryIds.keyForId(id);
+        if (key.isEmpty()) {
+            removeFromIndexes(id);
+        } else if (!seen.contains(key) && !m_archive->contains(key)) {
+            unindexEntry(key);
+        }
+    }
+    
+    // Ids are settled only once every file is indexed, since a copy may
+    // be listed before its original
+    for (JournalEntry& entry : entries) {
+        entry.setId(m_entryIds.idForKey(entryKey(entry.filePath())));
+    }
+    
+    return entries;
+}
+
+QList<JournalEntry> FileManager::loadArchivedEntries() const
+{
+    TraceSpan span("FileManager::loadArchivedEntries", "io");
+    
+    QList<JournalEntry> entries;
+    const QList<ArchiveStore::ArchivedEntry> archived = m_archive->entries();
+    for (const ArchiveStore::ArchivedEntry& meta : archived) {
+        // Step aside while the visible journal has work queued
+        if (!BackgroundScheduler::instance().yield(this)) {
+            break;
+        }
+        
+        JournalEntry entry = m_archive->readEntry(meta.key);
+        entry.setFilePath(m_journalDir.absoluteFilePath(meta.key));
+        entries.append(entry);
+    }
     return entries;
 }
 
+void FileManager::indexEntries(const QList<JournalEntry>& entries)
+{
+    TraceSpan span("FileManager::indexEntries", "index");
+    
+    for (const JournalEntry& entry : entries) {
+        indexEntry(entryKey(entry.filePath()), entry);
+    }
+}
+
+QStringList FileManager::backlinks(const QString& filePath) const
+{
+    return entryPaths(m_linkGraph.backlinks(entryId(filePath)));
+}
+
+QStringList FileManager::relatedEntries(const QString& filePath, int count)
+{
+    QStringList ids;
+    const QList<SimilarityIndex::Match> matches = m_similarity.related(entryId(filePath), count);
+    for (const SimilarityIndex::Match& match : matches) {
+        ids.append(match.entryId);
+    }
+    return entryPaths(ids);
+}
+
+bool FileManager::entriesMatching(const QString& filter, QStringList *paths, QString *error) const
+{
+    QStringList ids;
+    if (!m_metadata.select(filter, &ids, error)) {
+        return false;
+    }
+    
+    *paths = entryPaths(ids);
+    return true;
+}
+
+QStringList FileManager::metadataFields() const
+{
+    return m_metadata.fieldNames();
+}
+
+QStringList FileManager::entriesInRange(const QDateTime& from, const QDateTime& to) const
+{
+    return entryPaths(m_timeline.range(from, to));
+}
+
+int FileManager::entryCountOn(const QDate& date) const
+{
+    return m_timeline.countOn(date);
+}
+
+QStringList FileManager::tags() const
+{
+    return m_linkGraph.tags();
+}
+
+QStringList FileManager::entriesWithTag(const QString& tag) const
+{
+    return entryPaths(m_linkGraph.entriesWithTag(tag));
+}
+
 bool FileManager::deleteEntry(const QString& filePath)
 {
-    QFile file(filePath);
-    return file.remove();
+    TraceSpan span("FileManager::deleteEntry", "io");
+    
+    const QString key = entryKey(filePath);
+    bool success = m_archive->contains(key)
+        ? m_archive->removeEntry(key)
+        : m_backend->removeEntry(key);
+    
+    if (success) {
+        unindexEntry(key);
+        m_cache.remove(key);
+    }
+    return success;
+}
+
+QList<RevisionStore::Revision> FileManager::revisions(const QString& filePath) const
+{
+    // Revisions saved before entries had ids are kept under the key
+    const QString key = entryKey(filePath);
+    QList<RevisionStore::Revision> result = m_revisions->revisions(key);
+    const QString id = m_entryIds.idForKey(key);
+    if (!id.isEmpty()) {
+        result += m_revisions->revisions(id);
+        std::stable_sort(result.begin(), result.end(),
+                         [](const RevisionStore::Revision& a, const RevisionStore::Revision& b) {
+            return a.timestamp < b.timestamp;
+        });
+    }
+    return result;
+}
+
+bool FileManager::loadRevision(const RevisionStore::Revision& revision, JournalEntry *entry) const
+{
+    QByteArray text;
+    if (!m_revisions->readRevision(revision, &text)) {
+        return false;
+    }
+    
+    *entry = MarkdownFormat::parse(QString::fromUtf8(text));
+    if (!entry->modifiedAt().isValid()) {
+        entry->setModifiedAt(revision.timestamp);
+    }
+    return true;
+}
+
+int FileManager::archiveAgeDays() const
+{
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    return config.value("archive/ageDays", DEFAULT_ARCHIVE_AGE_DAYS).toInt();
+}
+
+void FileManager::setArchiveAgeDays(int days)
+{
+    m_journalDir.mkpath(METADATA_DIR);
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    config.setValue("archive/ageDays", days);
+    config.sync();
+}
+
+QString FileManager::mirrorDirectory() const
+{
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    return config.value("mirror/directory").toString();
+}
+
+void FileManager::setMirrorDirectory(const QString& directory)
+{
+    m_journalDir.mkpath(METADATA_DIR);
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    config.setValue("mirror/directory", directory);
+    config.sync();
+}
+
+int FileManager::archiveOldEntries()
+{
+    TraceSpan span("FileManager::archiveOldEntries", "io");
+    
+    const QDateTime cutoff = QDateTime::currentDateTime().addDays(-archiveAgeDays());
+    
+    QHash<QString, JournalEntry> expired;
+    const QStringList keys = m_backend->listKeys();
+    for (const QString& key : keys) {
+        JournalEntry entry = m_backend->readEntry(key);
+        if (!entry.isEmpty() && entry.createdAt().isValid() && entry.createdAt() < cutoff) {
+            // Archived under the id the journal knows it by, so it keeps
+            // that id when listed from the archive
+            const QString id = m_entryIds.idForKey(key);
+            if (!id.isEmpty()) {
+                entry.setId(id);
+            }
+            expired.insert(key, entry);
+        }
+    }
+    
+    if (expired.isEmpty()) {
+        return 0;
+    }
+    
+    // Only drop hot copies once the archives are safely written
+    if (!m_archive->addEntries(expired)) {
+        qWarning() << "Failed to archive entries, leaving them in place";
+        return 0;
+    }
+    
+    for (auto it = expired.constBegin(); it != expired.constEnd(); ++it) {
+        m_backend->removeEntry(it.key());
+    }
+    
+    return expired.size();
 }
 
 QString FileManager::generateFileName(const QString& title, const QDateTime& dateTime)
@@ -92,143 +659,307 @@ QString FileManager::generateFileName(const QString& title, const QDateTime& dat
         sanitizedTitle = sanitizedTitle.left(50);
     }
     
-    return QString("%1_%2.md").arg(dateStr, sanitizedTitle);
+    QString stem = QString("%1_%2").arg(dateStr, sanitizedTitle);
+    
+    if (m_layout == Layout::Sharded) {
+        stem.prepend(dateTime.toString("yyyy/MM") + "/");
+    }
+    
+    // Every stored entry is in the id index or the archive, so collisions
+    // are resolved without looking at the disk
+    QString fileName = stem + ".md";
+    for (int n = 2; m_entryIds.containsKey(fileName) || m_archive->contains(fileName); ++n) {
+        fileName = QString("%1-%2.md").arg(stem).arg(n);
+    }
+    
+    return fileName;
 }
 
 QStringList FileManager::listEntryFiles()
 {
-    QStringList nameFilters;
-    nameFilters << "*.md";
-    return m_journalDir.entryList(nameFilters, QDir::Files, QDir::Time | QDir::Reversed);
+    return m_backend->listKeys();
 }
 
-QString FileManager::sanitizeFileName(const QString& name)
+QString FileManager::shardForFileName(const QString& fileName) const
 {
-    // Use simple string replace for better performance
-    QString sanitized = name.toLower();
-    
-    // Replace non-alphanumeric characters with hyphens
-    for (int i = 0; i < sanitized.length(); ++i) {
-        QChar c = sanitized[i];
-        if (!c.isLetterOrNumber()) {
-            sanitized[i] = '-';
-        }
+    // Generated names look like yyyy-MM-dd_title.md
+    static const QRegularExpression datePrefix("^(\\d{4})-(\\d{2})-\\d{2}_");
+    QRegularExpressionMatch match = datePrefix.match(fileName);
+    if (!match.hasMatch()) {
+        return QString();
     }
+    return match.captured(1) + "/" + match.captured(2);
+}
+
+QString FileManager::metadataFilePath(const QString& name) const
+{
+    return m_journalDir.absoluteFilePath(QString(METADATA_DIR) + "/" + name);
+}
+
+QString FileManager::entryKey(const QString& filePath) const
+{
+    return m_journalDir.relativeFilePath(filePath);
+}
+
+JournalEntry FileManager::readEntry(const QString& key) const
+{
+    TraceSpan span("FileManager::readEntry", "io");
     
-    // Remove leading/trailing hyphens and collapse multiple hyphens
-    sanitized = sanitized.trimmed();
-    while (sanitized.contains("--")) {
-        sanitized.replace("--", "-");
-    }
-    if (sanitized.startsWith('-')) {
-        sanitized = sanitized.mid(1);
+    return m_archive->contains(key)
+        ? m_archive->readEntry(key)
+        : m_backend->readEntry(key);
+}
+
+QDateTime FileManager::entryVersion(const QString& filePath) const
+{
+    // Other stores are only written through this class, which keeps the
+    // cache current itself
+    if (m_backendType == Backend::Markdown) {
+        return QFileInfo(filePath).lastModified();
     }
-    if (sanitized.endsWith('-')) {
-        sanitized.chop(1);
+    return QDateTime();
+}
+
+QDateTime FileManager::entryCreated(const QString& key) const
+{
+    // Packed entries have no file of their own
+    if (m_backendType != Backend::Markdown) {
+        return QDateTime();
     }
     
-    return sanitized;
+    // Not every file system records a birth time; a copy is usually
+    // modified later than its original as well
+    const QFileInfo info(m_journalDir.absoluteFilePath(key));
+    const QDateTime born = info.birthTime();
+    return born.isValid() ? born : info.lastModified();
 }
 
-bool FileManager::writeMarkdownFile(const QString& filePath, const JournalEntry& entry)
+QString FileManager::resolveId(const QString& key, const JournalEntry& entry)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qWarning() << "Failed to open file for writing:" << filePath;
-        return false;
+    const QString other = m_entryIds.conflictingKey(key, entry.id());
+    if (other.isEmpty() || !isOriginal(key, entry, other)) {
+        return m_entryIds.insert(key, entry.id());
     }
     
-    QTextStream out(&file);
-    out.setEncoding(QStringConverter::Utf8);
-    
-    // Write metadata as YAML frontmatter
-    out << "---\n";
-    out << "title: " << entry.title() << "\n";
-    out << "created: " << entry.createdAt().toString(Qt::ISODate) << "\n";
-    out << "modified: " << entry.modifiedAt().toString(Qt::ISODate) << "\n";
-    out << "---\n\n";
-    
-    // Write title as H1 if present
-    if (!entry.title().isEmpty()) {
-        out << "# " << entry.title() << "\n\n";
+    // The indexes hold the other file under the id it loses; it is
+    // indexed again under the fresh one it gets
+    const JournalEntry copy = readEntry(other);
+    removeFromIndexes(entry.id());
+    const QString id = m_entryIds.insert(key, entry.id(), true);
+    if (!copy.isEmpty()) {
+        addToIndexes(m_entryIds.idForKey(other), copy);
     }
-    
-    // Write content
-    out << entry.content();
-    
-    file.close();
-    return true;
+    addToIndexes(id, entry);
+    return id;
 }
 
-JournalEntry FileManager::parseMarkdownFile(const QString& filePath)
+bool FileManager::isOriginal(const QString& key, const JournalEntry& entry, const QString& other) const
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qWarning() << "Failed to open file for reading:" << filePath;
-        return JournalEntry();
-    }
-    
-    QTextStream in(&file);
-    in.setEncoding(QStringConverter::Utf8);
-    QString content = in.readAll();
-    file.close();
+    TraceSpan span("FileManager::isOriginal", "index");
     
-    JournalEntry entry;
-    entry.setFilePath(filePath);
+    // The file that matches the id's last recorded revision is the one
+    // this journal saved; the other was copied from it
+    const QList<RevisionStore::Revision> revisions = m_revisions->revisions(entry.id());
+    QByteArray recorded;
+    if (!revisions.isEmpty() && m_revisions->readRevision(revisions.last(), &recorded)) {
+        const bool matches = revisionText(entry) == recorded;
+        if (matches != (revisionText(readEntry(other)) == recorded)) {
+            return matches;
+        }
+    }
     
-    // Parse YAML frontmatter if present
-    if (content.startsWith("---\n")) {
-        int endPos = content.indexOf("\n---\n", 4);
-        if (endPos != -1) {
-            QString frontmatter = content.mid(4, endPos - 4);
-            QString mainContent = content.mid(endPos + 5).trimmed();
+    // Otherwise, as with a copy neither file has been saved since, the
+    // older file. Saves replace the file, so this is only a fallback
+    const QDateTime created = entryCreated(key);
+    const QDateTime otherCreated = entryCreated(other);
+    return created.isValid() && otherCreated.isValid() && created < otherCreated;
+}
+
+QByteArray FileManager::revisionText(const JournalEntry& entry)
+{
+    // The modified time changes on every save and is left out, so an
+    // unchanged entry records nothing and its header chunk is shared;
+    // the revision's own timestamp stands in for it
+    JournalEntry revision = entry;
+    revision.setModifiedAt(QDateTime());
+    return MarkdownFormat::serialize(revision).toUtf8();
+}
+
+void FileManager::runPrefetch()
+{
+    // Runs on a pool thread; only touches thread-safe members
+    forever {
+        PrefetchItem item;
+        {
+            QMutexLocker locker(&m_prefetchMutex);
             
-            // Parse frontmatter fields
-            QStringList lines = frontmatter.split('\n');
-            for (const QString& line : lines) {
-                if (line.startsWith("title: ")) {
-                    entry.setTitle(line.mid(7).trimmed());
-                } else if (line.startsWith("created: ")) {
-                    entry.setCreatedAt(QDateTime::fromString(line.mid(9).trimmed(), Qt::ISODate));
-                } else if (line.startsWith("modified: ")) {
-                    entry.setModifiedAt(QDateTime::fromString(line.mid(10).trimmed(), Qt::ISODate));
-                }
+            // Nobody is browsing a journal that is not being shown
+            if (!BackgroundScheduler::instance().isActive(this)) {
+                m_prefetchQueue.clear();
             }
             
-            // Remove H1 title if it matches the frontmatter title exactly
-            if (!entry.title().isEmpty() && 
-                mainContent.startsWith("# " + entry.title() + "\n")) {
-                // Find the end of the title line
-                int newlinePos = mainContent.indexOf('\n');
-                if (newlinePos != -1) {
-                    mainContent = mainContent.mid(newlinePos + 1).trimmed();
-                }
+            if (m_prefetchQueue.isEmpty()) {
+                m_prefetchActive = false;
+                return;
             }
-            
-            entry.setContent(mainContent);
+            item = m_prefetchQueue.takeFirst();
         }
-    } else {
-        // No frontmatter, try to extract title from H1
-        if (content.startsWith("# ")) {
-            int newlinePos = content.indexOf('\n');
-            if (newlinePos != -1) {
-                entry.setTitle(content.mid(2, newlinePos - 2).trimmed());
-                entry.setContent(content.mid(newlinePos + 1).trimmed());
-            }
-        } else {
-            entry.setContent(content);
+        
+        const QDateTime version = entryVersion(item.filePath);
+        if (m_cache.contains(item.key, version)) {
+            continue;
         }
         
-        // Use file metadata for dates
-        QFileInfo fileInfo(filePath);
-        // birthTime() may not work on all filesystems, use lastModified() as fallback
-        QDateTime created = fileInfo.birthTime();
-        if (!created.isValid()) {
-            created = fileInfo.lastModified();
+        JournalEntry entry = readEntry(item.key);
+        entry.setFilePath(item.filePath);
+        if (!entry.isEmpty()) {
+            m_cache.insert(item.key, entry, version, false);
         }
-        entry.setCreatedAt(created);
-        entry.setModifiedAt(fileInfo.lastModified());
+    }
+}
+
+void FileManager::waitForPrefetch()
+{
+    {
+        QMutexLocker locker(&m_prefetchMutex);
+        m_prefetchQueue.clear();
+    }
+    m_prefetchFuture.waitForFinished();
+}
+
+void FileManager::cancelBackgroundWork()
+{
+    {
+        QMutexLocker locker(&m_prefetchMutex);
+        m_prefetchQueue.clear();
     }
     
-    return entry;
+    BackgroundScheduler::instance().cancel(this);
+    
+    // A prefetch dropped before it started never clears the flag itself
+    QMutexLocker locker(&m_prefetchMutex);
+    m_prefetchActive = false;
+}
+
+void FileManager::indexEntry(const QString& key, const JournalEntry& entry)
+{
+    TraceSpan span("FileManager::indexEntry", "index");
+    
+    // Indexes follow the entry's id, so renames and moves leave them be.
+    // An entry that adopts the id from its frontmatter, or is found to
+    // be a copy, moves to a different id.
+    const QString previous = m_entryIds.idForKey(key);
+    const QString id = resolveId(key, entry);
+    if (!previous.isEmpty() && previous != id) {
+        removeFromIndexes(previous);
+    }
+    addToIndexes(id, entry);
+}
+
+void FileManager::unindexEntry(const QString& key)
+{
+    const QString id = m_entryIds.idForKey(key);
+    if (!id.isEmpty()) {
+        removeFromIndexes(id);
+    }
+    m_entryIds.removeKey(key);
+}
+
+void FileManager::addToIndexes(const QString& id, const JournalEntry& entry)
+{
+    m_linkGraph.updateEntry(id, entry.title(), entry.content());
+    m_timeline.insert(id, entry.createdAt());
+    m_similarity.updateEntry(id, entry.title(), entry.content());
+    m_metadata.updateEntry(id, entry);
+}
+
+void FileManager::removeFromIndexes(const QString& id)
+{
+    m_linkGraph.removeEntry(id);
+    m_timeline.remove(id);
+    m_similarity.removeEntry(id);
+    m_metadata.removeEntry(id);
+}
+
+void FileManager::loadJournalConfig()
+{
+    // Background reads must not outlive the stores they read from
+    cancelBackgroundWork();
+    m_cache.clear();
+    
+    QSettings config(metadataFilePath(CONFIG_FILE), QSettings::IniFormat);
+    m_cache.setMaxBytes(config.value("cache/budgetMB", DEFAULT_CACHE_MB).toLongLong() * 1024 * 1024);
+    m_layout = config.value("storage/layout").toString() == "sharded"
+        ? Layout::Sharded : Layout::Flat;
+    m_backendType = journalBackend(m_journalDir.absolutePath());
+    
+    m_backend = createBackend(m_backendType);
+    if (!m_backend) {
+        // An unreadable pack must not take the whole journal down
+        m_backendType = Backend::Markdown;
+        m_backend = createBackend(m_backendType);
+    }
+    
+    m_archive = std::make_unique<ArchiveStore>(metadataFilePath(ARCHIVE_DIR));
+    m_archive->load();
+    
+    m_revisions = std::make_unique<RevisionStore>(metadataFilePath(REVISIONS_DIR));
+    
+    m_linkGraph.clear();
+    m_timeline.clear();
+    m_similarity.clear();
+    m_metadata.clear();
+    m_entryIds.clear();
+}
+
+FileManager::Backend FileManager::journalBackend(const QString& journalDirectory)
+{
+    const QString path = QDir(journalDirectory).absoluteFilePath(QString(METADATA_DIR) + "/" + CONFIG_FILE);
+    QSettings config(path, QSettings::IniFormat);
+    return config.value("storage/backend").toString() == "packed"
+        ? Backend::Packed : Backend::Markdown;
+}
+
+std::unique_ptr<StorageBackend> FileManager::createBackend(Backend backend) const
+{
+    if (backend == Backend::Packed) {
+        auto packed = std::make_unique<PackedBackend>(m_journalDir.absoluteFilePath(PACK_FILE),
+                                                      metadataFilePath(PACK_LOCK_FILE));
+        if (!packed->isOpen()) {
+            return nullptr;
+        }
+        return packed;
+    }
+    
+    auto markdown = std::make_unique<MarkdownBackend>(m_journalDir.absolutePath());
+    markdown->setSharded(m_layout == Layout::Sharded);
+    return markdown;
+}
+
+QString FileManager::sanitizeFileName(const QString& name)
+{
+    // Use simple string replace for better performance
+    QString sanitized = name.toLower();
+    
+    // Replace non-alphanumeric characters with hyphens
+    for (int i = 0; i < sanitized.length(); ++i) {
+        QChar c = sanitized[i];
+        if (!c.isLetterOrNumber()) {
+            sanitized[i] = '-';
+        }
+    }
+    
+    // Remove leading/trailing hyphens and collapse multiple hyphens
+    sanitized = sanitized.trimmed();
+    while (sanitized.contains("--")) {
+        sanitized.replace("--", "-");
+    }
+    if (sanitized.startsWith('-')) {
+        sanitized = sanitized.mid(1);
+    }
+    if (sanitized.endsWith('-')) {
+        sanitized.chop(1);
+    }
+    
+    return sanitized;
 }
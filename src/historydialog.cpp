@@ -0,0 +1,232 @@
+#include "historydialog.h"
+#include <QVBoxLayout>
+#include <QSplitter>
+#include <QDialogButtonBox>
+#include <QPushButton>
+#include <QTextCursor>
+#include <QTextCharFormat>
+#include <QColor>
+#include <QLocale>
+#include <vector>
+
+// Unchanged lines shown around each change
+static const int DIFF_CONTEXT_LINES = 3;
+// Beyond this many cells the LCS table is skipped in favour of a plain replace
+static const qint64 MAX_DIFF_CELLS = 4000000;
+
+namespace {
+
+enum class DiffOp { Same, Removed, Added };
+
+struct DiffLine {
+    DiffOp op;
+    QString text;
+};
+
+QList<DiffLine> diffLines(const QStringList& a, const QStringList& b)
+{
+    // Strip the common prefix and suffix, which covers most edits cheaply
+    int prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) {
+        ++prefix;
+    }
+    int suffix = 0;
+    while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+           a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    
+    QList<DiffLine> result;
+    for (int i = 0; i < prefix; ++i) {
+        result.append(DiffLine{ DiffOp::Same, a[i] });
+    }
+    
+    const int n = a.size() - prefix - suffix;
+    const int m = b.size() - prefix - suffix;
+    
+    if (qint64(n + 1) * (m + 1) <= MAX_DIFF_CELLS) {
+        // Longest common subsequence over the changed middle section
+        std::vector<int> lcs(size_t(n + 1) * (m + 1), 0);
+        auto cell = [&lcs, m](int i, int j) -> int& { return lcs[size_t(i) * (m + 1) + j]; };
+        for (int i = n - 1; i >= 0; --i) {
+            for (int j = m - 1; j >= 0; --j) {
+                cell(i, j) = a[prefix + i] == b[prefix + j]
+                    ? cell(i + 1, j + 1) + 1
+                    : qMax(cell(i + 1, j), cell(i, j + 1));
+            }
+        }
+        
+        int i = 0;
+        int j = 0;
+        while (i < n && j < m) {
+            if (a[prefix + i] == b[prefix + j]) {
+                result.append(DiffLine{ DiffOp::Same, a[prefix + i] });
+                ++i;
+                ++j;
+            } else if (cell(i + 1, j) >= cell(i, j + 1)) {
+                result.append(DiffLine{ DiffOp::Removed, a[prefix + i++] });
+            } else {
+                result.append(DiffLine{ DiffOp::Added, b[prefix + j++] });
+            }
+        }
+        while (i < n) {
+            result.append(DiffLine{ DiffOp::Removed, a[prefix + i++] });
+        }
+        while (j < m) {
+            result.append(DiffLine{ DiffOp::Added, b[prefix + j++] });
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            result.append(DiffLine{ DiffOp::Removed, a[prefix + i] });
+        }
+        for (int j = 0; j < m; ++j) {
+            result.append(DiffLine{ DiffOp::Added, b[prefix + j] });
+        }
+    }
+    
+    for (int i = a.size() - suffix; i < a.size(); ++i) {
+        result.append(DiffLine{ DiffOp::Same, a[i] });
+    }
+    
+    return result;
+}
+
+} // namespace
+
+HistoryDialog::HistoryDialog(FileManager *fileManager, const QString& filePath, QWidget *parent)
+    : QDialog(parent)
+    , m_fileManager(fileManager)
+    , m_revisionList(nullptr)
+    , m_diffView(nullptr)
+    , m_restoreButton(nullptr)
+{
+    setWindowTitle(tr("Entry History"));
+    resize(900, 600);
+    
+    m_revisions = m_fileManager->revisions(filePath);
+    
+    QSplitter *splitter = new QSplitter(Qt::Horizontal, this);
+    
+    m_revisionList = new QListWidget(splitter);
+    m_revisionList->setMaximumWidth(260);
+    
+    // Newest first
+    QLocale locale;
+    for (int i = m_revisions.size() - 1; i >= 0; --i) {
+        const RevisionStore::Revision& revision = m_revisions[i];
+        QListWidgetItem *item = new QListWidgetItem(
+            tr("%1 (%2)").arg(revision.timestamp.toString("yyyy-MM-dd hh:mm:ss"),
+                              locale.formattedDataSize(revision.size)));
+        item->setData(Qt::UserRole, i);
+        m_revisionList->addItem(item);
+    }
+    
+    m_diffView = new QPlainTextEdit(splitter);
+    m_diffView->setReadOnly(true);
+    m_diffView->setLineWrapMode(QPlainTextEdit::NoWrap);
+    
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    m_restoreButton = buttons->addButton(tr("Restore"), QDialogButtonBox::AcceptRole);
+    m_restoreButton->setEnabled(false);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    
+    connect(m_revisionList, &QListWidget::currentRowChanged, this, &HistoryDialog::onRevisionSelected);
+    
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(splitter);
+    layout->addWidget(buttons);
+    
+    if (m_revisionList->count() > 0) {
+        m_revisionList->setCurrentRow(0);
+    } else {
+        m_diffView->setPlainText(tr("No revisions have been recorded for this entry yet."));
+    }
+}
+
+void HistoryDialog::onRevisionSelected(int row)
+{
+    if (row < 0) {
+        m_restoreButton->setEnabled(false);
+        return;
+    }
+    
+    const int index = m_revisionList->item(row)->data(Qt::UserRole).toInt();
+    m_selected = JournalEntry();
+    const bool loaded = m_fileManager->loadRevision(m_revisions[index], &m_selected);
+    m_restoreButton->setEnabled(loaded);
+    if (!loaded) {
+        m_diffView->setPlainText(tr("This revision cannot be read; its stored history is damaged."));
+        return;
+    }
+    
+    // Compare against the revision saved before this one
+    QString before;
+    JournalEntry previous;
+    if (index > 0 && m_fileManager->loadRevision(m_revisions[index - 1], &previous)) {
+        before = previous.content();
+    }
+    
+    showDiff(before, m_selected.content());
+}
+
+void HistoryDialog::showDiff(const QString& before, const QString& after)
+{
+    m_diffView->clear();
+    
+    const QList<DiffLine> lines = diffLines(before.split('\n'), after.split('\n'));
+    
+    // Only show unchanged lines close to a change
+    QVector<bool> visible(lines.size(), false);
+    for (int i = 0; i < lines.size(); ++i) {
+        if (lines[i].op != DiffOp::Same) {
+            for (int j = qMax(0, i - DIFF_CONTEXT_LINES);
+                 j <= qMin(int(lines.size()) - 1, i + DIFF_CONTEXT_LINES); ++j) {
+                visible[j] = true;
+            }
+        }
+    }
+    
+    QTextCharFormat sameFormat;
+    QTextCharFormat removedFormat;
+    removedFormat.setBackground(QColor(255, 220, 220));
+    QTextCharFormat addedFormat;
+    addedFormat.setBackground(QColor(220, 255, 220));
+    QTextCharFormat gapFormat;
+    gapFormat.setForeground(Qt::gray);
+    
+    QTextCursor cursor(m_diffView->document());
+    bool skipped = false;
+    bool anyChange = false;
+    for (int i = 0; i < lines.size(); ++i) {
+        if (!visible[i]) {
+            skipped = true;
+            continue;
+        }
+        if (skipped) {
+            cursor.insertText("...\n", gapFormat);
+            skipped = false;
+        }
+        
+        const DiffLine& line = lines[i];
+        switch (line.op) {
+        case DiffOp::Same:
+            cursor.insertText("  " + line.text + "\n", sameFormat);
+            break;
+        case DiffOp::Removed:
+            cursor.insertText("- " + line.text + "\n", removedFormat);
+            anyChange = true;
+            break;
+        case DiffOp::Added:
+            cursor.insertText("+ " + line.text + "\n", addedFormat);
+            anyChange = true;
+            break;
+        }
+    }
+    
+    if (!anyChange) {
+        cursor.insertText(tr("No content changes in this revision."), gapFormat);
+    }
+    
+    m_diffView->moveCursor(QTextCursor::Start);
+}
@@ -0,0 +1,418 @@
+#include "journaldaemon.h"
+#include "daemonprotocol.h"
+#include "markdownformat.h"
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
+#include <QDebug>
+#include <algorithm>
+
+using DaemonProtocol::Message;
+
+// Let a burst of changes (a sync client, a checkout) finish before rescanning
+static const int RESCAN_DELAY_MS = 500;
+
+// Long enough for a live daemon to accept, short enough not to delay startup
+static const int PROBE_TIMEOUT_MS = 200;
+
+// Files another jrnl process changes when it saves, relative to the journal
+static const char *METADATA_DIR = ".jrnl-meta";
+static const char *CONFIG_FILE = ".jrnl-meta/journal.ini";
+static const char *ARCHIVE_DIR = ".jrnl-meta/archive";
+
+JournalDaemon::JournalDaemon(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+    , m_rescanTimer(new QTimer(this))
+    , m_shuttingDown(false)
+{
+    m_rescanTimer->setSingleShot(true);
+    m_rescanTimer->setInterval(RESCAN_DELAY_MS);
+    connect(m_rescanTimer, &QTimer::timeout, this, &JournalDaemon::rescanStaleJournals);
+    connect(m_server, &QLocalServer::newConnection, this, &JournalDaemon::onNewConnection);
+}
+
+JournalDaemon::~JournalDaemon()
+{
+    m_server->close();
+    qDeleteAll(m_journals);
+}
+
+bool JournalDaemon::start(QString *error)
+{
+    const QString name = DaemonProtocol::serverName();
+    
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(PROBE_TIMEOUT_MS)) {
+        *error = tr("A jrnl daemon is already running");
+        return false;
+    }
+    
+    // Nobody answers, so the socket is left over from a daemon that crashed
+    QLocalServer::removeServer(name);
+    
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(name)) {
+        *error = tr("Failed to listen on %1: %2").arg(name, m_server->errorString());
+        return false;
+    }
+    return true;
+}
+
+void JournalDaemon::preload(const QString& directory)
+{
+    QString error;
+    if (!journal(directory, &error)) {
+        qWarning() << "Failed to preload journal:" << error;
+    }
+}
+
+void JournalDaemon::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QLocalSocket::readyRead, this, &JournalDaemon::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void JournalDaemon::onReadyRead()
+{
+    auto *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket || !m_buffers.contains(socket)) {
+        return;
+    }
+    
+    QByteArray& buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+    
+    forever {
+        QByteArray payload;
+        const DaemonProtocol::FrameStatus status = DaemonProtocol::takeFrame(&buffer, &payload);
+        if (status == DaemonProtocol::FrameStatus::Incomplete) {
+            return;
+        }
+        
+        const QByteArray reply = status == DaemonProtocol::FrameStatus::Complete
+            ? handleRequest(payload) : QByteArray();
+        if (reply.isEmpty()) {
+            qWarning() << "Dropping jrnl client after a malformed request";
+            socket->abort();
+            return;
+        }
+        socket->write(DaemonProtocol::frame(reply));
+        
+        if (m_shuttingDown) {
+            socket->waitForBytesWritten();
+            QCoreApplication::quit();
+            return;
+        }
+    }
+}
+
+void JournalDaemon::rescanStaleJournals()
+{
+    QStringList packed;
+    for (auto it = m_journals.constBegin(); it != m_journals.constEnd(); ++it) {
+        if (it.value()->stale && !scan(it.value())) {
+            packed << it.key();
+        }
+    }
+    for (const QString& path : std::as_const(packed)) {
+        dropJournal(path);
+    }
+}
+
+JournalDaemon::Journal *JournalDaemon::journal(const QString& directory, QString *error)
+{
+    const QString path = QDir(directory).absolutePath();
+    Journal *journal = m_journals.value(path);
+    if (journal) {
+        // Never answer from an index that misses changes already seen
+        if (!journal->stale || scan(journal)) {
+            return journal;
+        }
+        dropJournal(path);
+    }
+    
+    // FileManager would create a missing directory; clients get an error
+    if (!QFileInfo(path).isDir()) {
+        *error = tr("No journal at %1").arg(directory);
+        return nullptr;
+    }
+    
+    const QString packedError = tr("%1 is a packed journal, which is read directly and not through the daemon")
+        .arg(directory);
+    if (FileManager::journalBackend(path) == FileManager::Backend::Packed) {
+        *error = packedError;
+        return nullptr;
+    }
+    
+    journal = new Journal;
+    journal->fileManager = std::make_unique<FileManager>(path);
+    journal->watcher = new QFileSystemWatcher(this);
+    journal->stale = true;
+    m_journals.insert(path, journal);
+    
+    auto markStale = [this, journal]() {
+        journal->stale = true;
+        m_rescanTimer->start();
+    };
+    connect(journal->watcher, &QFileSystemWatcher::directoryChanged, this, markStale);
+    connect(journal->watcher, &QFileSystemWatcher::fileChanged, this, markStale);
+    
+    if (!scan(journal)) {
+        dropJournal(path);
+        *error = packedError;
+        return nullptr;
+    }
+    return journal;
+}
+
+void JournalDaemon::dropJournal(const QString& path)
+{
+    Journal *journal = m_journals.take(path);
+    delete journal->watcher;
+    delete journal;
+}
+
+bool JournalDaemon::scan(Journal *journal)
+{
+    TraceSpan span("JournalDaemon::scan", "io");
+    
+    FileManager *fileManager = journal->fileManager.get();
+    const QDir root(fileManager->journalDirectory());
+    
+    // Another jrnl process may have changed the layout or backend, or
+    // archived entries; start over with a fresh view of the journal
+    const QDateTime configModified = QFileInfo(root.filePath(CONFIG_FILE)).lastModified();
+    const QDateTime archiveModified = QFileInfo(root.filePath(ARCHIVE_DIR)).lastModified();
+    const bool reload = configModified != journal->configModified
+        || archiveModified != journal->archiveModified;
+    if (reload) {
+        // Checked before reloading so the pack is never opened here
+        if (FileManager::journalBackend(root.absolutePath()) == FileManager::Backend::Packed) {
+            return false;
+        }
+        fileManager->setJournalDirectory(root.absolutePath());
+        journal->configModified = configModified;
+        journal->archiveModified = archiveModified;
+    }
+    
+    // Each file's time is taken before it is read, so a file that changes
+    // during the scan looks out of date to clients rather than current
+    journal->versions.clear();
+    const QStringList keys = fileManager->listEntryFiles();
+    for (const QString& key : keys) {
+        const QDateTime modified = QFileInfo(root.filePath(key)).lastModified();
+        if (modified.isValid()) {
+            journal->versions.insert(key, modified.toMSecsSinceEpoch());
+        }
+    }
+    
+    journal->entries = fileManager->loadAllEntries();
+    std::stable_sort(journal->entries.begin(), journal->entries.end(),
+                     [](const JournalEntry& a, const JournalEntry& b) {
+        return a.createdAt() < b.createdAt();
+    });
+    
+    // Filters cover archived entries too
+    if (reload) {
+        fileManager->indexEntries(fileManager->loadArchivedEntries());
+    }
+    
+    journal->stale = false;
+    watch(journal);
+    return true;
+}
+
+void JournalDaemon::watch(Journal *journal)
+{
+    QFileSystemWatcher *watcher = journal->watcher;
+    if (!watcher->directories().isEmpty()) {
+        watcher->removePaths(watcher->directories());
+    }
+    if (!watcher->files().isEmpty()) {
+        watcher->removePaths(watcher->files());
+    }
+    
+    // The journal directory plus its YYYY/MM shards
+    const QString root = journal->fileManager->journalDirectory();
+    QStringList paths;
+    paths << root;
+    if (journal->fileManager->layout() == FileManager::Layout::Sharded) {
+        QDirIterator it(root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            paths << it.next();
+        }
+    }
+    
+    for (const char *name : { METADATA_DIR, ARCHIVE_DIR }) {
+        const QString path = QDir(root).filePath(name);
+        if (QFileInfo::exists(path)) {
+            paths << path;
+        }
+    }
+    watcher->addPaths(paths);
+}
+
+QByteArray JournalDaemon::handleRequest(const QByteArray& payload)
+{
+    TraceSpan span("JournalDaemon::handleRequest", "ipc");
+    
+    QDataStream in(payload);
+    in.setVersion(DaemonProtocol::STREAM_VERSION);
+    quint8 type = 0;
+    quint32 requestId = 0;
+    in >> type >> requestId;
+    if (in.status() != QDataStream::Ok) {
+        return QByteArray();
+    }
+    
+    QString error;
+    QByteArray results;
+    switch (Message(type)) {
+    case Message::Hello:
+        results = DaemonProtocol::encode(DaemonProtocol::VERSION);
+        break;
+    case Message::ListEntries:
+        results = listEntries(in, &error);
+        break;
+    case Message::ReadEntry:
+        results = readEntry(in, &error);
+        break;
+    case Message::Snapshot:
+        results = snapshot(in, &error);
+        break;
+    case Message::Shutdown:
+        m_shuttingDown = true;
+        break;
+    default:
+        error = tr("Unknown request type %1").arg(type);
+        break;
+    }
+    
+    if (!error.isEmpty()) {
+        return DaemonProtocol::encode(quint8(Message::Failure), requestId, error);
+    }
+    
+    QByteArray reply = DaemonProtocol::encode(quint8(Message::Reply), requestId);
+    reply.append(results);
+    return reply;
+}
+
+QByteArray JournalDaemon::listEntries(QDataStream& in, QString *error)
+{
+    QString directory;
+    QString filter;
+    in >> directory >> filter;
+    if (in.status() != QDataStream::Ok) {
+        *error = tr("Malformed request");
+        return QByteArray();
+    }
+    
+    Journal *journal = this->journal(directory, error);
+    if (!journal) {
+        return QByteArray();
+    }
+    
+    QSet<QString> matching;
+    if (!filter.isEmpty()) {
+        QStringList paths;
+        if (!journal->fileManager->entriesMatching(filter, &paths, error)) {
+            if (error->isEmpty()) {
+                *error = tr("Invalid filter");
+            }
+            return QByteArray();
+        }
+        matching = QSet<QString>(paths.begin(), paths.end());
+    }
+    
+    QList<const JournalEntry *> selected;
+    for (const JournalEntry& entry : std::as_const(journal->entries)) {
+        if (filter.isEmpty() || matching.contains(entry.filePath())) {
+            selected.append(&entry);
+        }
+    }
+    
+    QByteArray results;
+    QDataStream out(&results, QIODevice::WriteOnly);
+    out.setVersion(DaemonProtocol::STREAM_VERSION);
+    out << quint32(selected.size());
+    for (const JournalEntry *entry : std::as_const(selected)) {
+        out << entry->id() << entry->filePath() << entry->title() << entry->createdAt();
+    }
+    return results;
+}
+
+QByteArray JournalDaemon::readEntry(QDataStream& in, QString *error)
+{
+    QString directory;
+    QString reference;
+    in >> directory >> reference;
+    if (in.status() != QDataStream::Ok) {
+        *error = tr("Malformed request");
+        return QByteArray();
+    }
+    
+    Journal *journal = this->journal(directory, error);
+    if (!journal) {
+        return QByteArray();
+    }
+    
+    const QString filePath = journal->fileManager->findEntry(reference);
+    if (filePath.isEmpty()) {
+        *error = tr("No entry %1").arg(reference);
+        return QByteArray();
+    }
+    
+    const JournalEntry entry = journal->fileManager->loadEntry(filePath);
+    if (entry.isEmpty()) {
+        *error = tr("Failed to read %1").arg(filePath);
+        return QByteArray();
+    }
+    return DaemonProtocol::encode(filePath, MarkdownFormat::serialize(entry));
+}
+
+QByteArray JournalDaemon::snapshot(QDataStream& in, QString *error)
+{
+    QString directory;
+    in >> directory;
+    if (in.status() != QDataStream::Ok) {
+        *error = tr("Malformed request");
+        return QByteArray();
+    }
+    
+    Journal *journal = this->journal(directory, error);
+    if (!journal) {
+        return QByteArray();
+    }
+    
+    // Only entry files have a time clients can check them against;
+    // archived entries are left out
+    const QDir root(journal->fileManager->journalDirectory());
+    QList<QPair<QString, const JournalEntry *>> files;
+    for (const JournalEntry& entry : std::as_const(journal->entries)) {
+        const QString key = root.relativeFilePath(entry.filePath());
+        if (journal->versions.contains(key)) {
+            files.append(qMakePair(key, &entry));
+        }
+    }
+    
+    QByteArray results;
+    QDataStream out(&results, QIODevice::WriteOnly);
+    out.setVersion(DaemonProtocol::STREAM_VERSION);
+    out << quint32(files.size());
+    for (const auto& file : std::as_const(files)) {
+        out << file.first << journal->versions.value(file.first)
+            << MarkdownFormat::serialize(*file.second).toUtf8();
+    }
+    return results;
+}
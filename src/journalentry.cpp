@@ -35,3 +35,30 @@ void JournalEntry::updateModifiedTime()
 {
     m_modifiedAt = QDateTime::currentDateTime();
 }
+
+QString JournalEntry::field(const QString& name) const
+{
+    for (const Field& field : m_fields) {
+        if (field.first == name) {
+            return field.second;
+        }
+    }
+    return QString();
+}
+
+void JournalEntry::setField(const QString& name, const QString& value)
+{
+    for (int i = 0; i < m_fields.size(); ++i) {
+        if (m_fields[i].first == name) {
+            if (value.isEmpty()) {
+                m_fields.removeAt(i);
+            } else {
+                m_fields[i].second = value;
+            }
+            return;
+        }
+    }
+    if (!value.isEmpty()) {
+        m_fields.append(Field(name, value));
+    }
+}
@@ -0,0 +1,544 @@
+#include "journalmirror.h"
+#include "tracer.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QBitArray>
+#include <QSet>
+#include <QThread>
+#include <QtConcurrent>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+
+// The manifest lives in the mirror, so a mirror describes itself
+static const char *MIRROR_META_DIR = ".jrnl-mirror";
+static const char *MANIFEST_FILE = "manifest";
+static const char MANIFEST_MAGIC[8] = { 'J', 'R', 'N', 'L', 'M', 'I', 'R', 'R' };
+static const quint32 MANIFEST_VERSION = 1;
+
+// Blocks grow with the square root of the file size, as rsync's do
+static const quint32 MIN_BLOCK_SIZE = 2048;
+static const quint32 MAX_BLOCK_SIZE = 64 * 1024;
+static const int STRONG_SIZE = 16;
+
+// Smaller files are rewritten whole rather than patched in place
+static const qint64 IN_PLACE_MIN_SIZE = 256 * 1024;
+
+// Bytes of one file checked by a single verify task
+static const qint64 VERIFY_PIECE_SIZE = 4 * 1024 * 1024;
+
+JournalMirror::JournalMirror(const QString& journalDirectory, const QString& mirrorDirectory)
+    : m_journalDir(journalDirectory)
+    , m_mirrorDir(mirrorDirectory)
+{
+}
+
+quint32 JournalMirror::blockSizeFor(qint64 size)
+{
+    quint32 block = MIN_BLOCK_SIZE;
+    const double root = std::sqrt(double(size));
+    while (block < MAX_BLOCK_SIZE && block < root) {
+        block *= 2;
+    }
+    return block;
+}
+
+quint32 JournalMirror::weakChecksum(const uchar *data, qint64 length)
+{
+    // a is the byte sum, b weights each byte by its distance from the
+    // end; both can be rolled forward a byte at a time in computeDelta()
+    quint32 a = 0;
+    quint32 b = 0;
+    for (qint64 i = 0; i < length; ++i) {
+        a += data[i];
+        b += quint32(length - i) * data[i];
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+QByteArray JournalMirror::strongChecksum(const uchar *data, qint64 length)
+{
+    return QCryptographicHash::hash(QByteArrayView(reinterpret_cast<const char *>(data), length),
+                                    QCryptographicHash::Md5);
+}
+
+JournalMirror::FileRecord JournalMirror::signature(const uchar *data, qint64 size)
+{
+    FileRecord record;
+    record.size = size;
+    record.blockSize = blockSizeFor(size);
+    
+    const qint64 blocks = (size + record.blockSize - 1) / record.blockSize;
+    record.weak.reserve(blocks);
+    record.strong.reserve(blocks * STRONG_SIZE);
+    for (qint64 offset = 0; offset < size; offset += record.blockSize) {
+        const qint64 length = qMin<qint64>(record.blockSize, size - offset);
+        record.weak.append(weakChecksum(data + offset, length));
+        record.strong.append(strongChecksum(data + offset, length));
+    }
+    return record;
+}
+
+QList<JournalMirror::Segment> JournalMirror::computeDelta(const uchar *data, qint64 size,
+                                                          const FileRecord& old)
+{
+    QList<Segment> segments;
+    auto addLiteral = [&segments](qint64 from, qint64 to) {
+        if (to <= from) {
+            return;
+        }
+        if (!segments.isEmpty() && segments.last().oldOffset < 0) {
+            segments.last().length += to - from;
+        } else {
+            segments.append(Segment{ from, to - from, -1 });
+        }
+    };
+    
+    // Only whole blocks of the old copy are matched; a short last block
+    // is rarely worth finding again
+    const qint64 block = old.blockSize;
+    const int oldBlocks = block > 0 && old.size > 0 ? int(old.size / block) : 0;
+    if (oldBlocks == 0 || size < block) {
+        addLiteral(0, size);
+        return segments;
+    }
+    
+    // Most offsets match nothing, so a 64 Kbit filter on the weak
+    // checksum screens them out before the hash lookup
+    QHash<quint32, QVector<int>> blocksByWeak;
+    QBitArray filter(1 << 16);
+    for (int i = 0; i < oldBlocks; ++i) {
+        blocksByWeak[old.weak[i]].append(i);
+        filter.setBit(int((old.weak[i] ^ (old.weak[i] >> 16)) & 0xffff));
+    }
+    
+    qint64 literalStart = 0;
+    qint64 pos = 0;
+    quint32 a = 0;
+    quint32 b = 0;
+    bool fresh = true;
+    while (pos + block <= size) {
+        if (fresh) {
+            const quint32 weak = weakChecksum(data + pos, block);
+            a = weak & 0xffff;
+            b = weak >> 16;
+            fresh = false;
+        }
+        
+        const quint32 weak = (a & 0xffff) | (b << 16);
+        int match = -1;
+        if (filter.testBit(int((weak ^ (weak >> 16)) & 0xffff))) {
+            auto candidates = blocksByWeak.constFind(weak);
+            if (candidates != blocksByWeak.constEnd()) {
+                const QByteArray strong = strongChecksum(data + pos, block);
+                for (int index : *candidates) {
+                    if (std::memcmp(old.strong.constData() + qint64(index) * STRONG_SIZE,
+                                    strong.constData(), STRONG_SIZE) != 0) {
+                        continue;
+                    }
+                    // Prefer the block at the same offset, which keeps an
+                    // in-place update possible
+                    if (match < 0 || qint64(index) * block == pos) {
+                        match = index;
+                    }
+                }
+            }
+        }
+        
+        if (match >= 0) {
+            addLiteral(literalStart, pos);
+            segments.append(Segment{ pos, block, qint64(match) * block });
+            pos += block;
+            literalStart = pos;
+            fresh = true;
+            continue;
+        }
+        
+        // Roll the window one byte forward
+        if (pos + block < size) {
+            const quint32 out = data[pos];
+            const quint32 in = data[pos + block];
+            a = (a - out + in) & 0xffff;
+            b = (b - quint32(block) * out + a) & 0xffff;
+        }
+        ++pos;
+    }
+    addLiteral(literalStart, size);
+    return segments;
+}
+
+QString JournalMirror::manifestPath() const
+{
+    return m_mirrorDir.absoluteFilePath(QString(MIRROR_META_DIR) + "/" + MANIFEST_FILE);
+}
+
+bool JournalMirror::loadManifest()
+{
+    m_records.clear();
+    
+    QFile file(manifestPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    char magic[sizeof(MANIFEST_MAGIC)];
+    if (file.read(magic, sizeof(magic)) != qint64(sizeof(magic))
+        || std::memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) != 0) {
+        qWarning() << "Mirror manifest is damaged:" << file.fileName();
+        return false;
+    }
+    
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 version;
+    quint32 count;
+    in >> version >> count;
+    if (version != MANIFEST_VERSION) {
+        qWarning() << "Mirror manifest is from another version:" << file.fileName();
+        return false;
+    }
+    
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        FileRecord record;
+        in >> path >> record.size >> record.modified >> record.blockSize >> record.weak >> record.strong;
+        if (record.strong.size() != qsizetype(record.weak.size()) * STRONG_SIZE) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+        m_records.insert(path, record);
+    }
+    
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Mirror manifest is damaged:" << file.fileName();
+        m_records.clear();
+        return false;
+    }
+    return true;
+}
+
+bool JournalMirror::saveManifest() const
+{
+    m_mirrorDir.mkpath(MIRROR_META_DIR);
+    
+    QSaveFile file(manifestPath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write mirror manifest:" << file.fileName();
+        return false;
+    }
+    
+    file.write(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << MANIFEST_VERSION << quint32(m_records.size());
+    for (auto it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+        const FileRecord& record = it.value();
+        out << it.key() << record.size << record.modified << record.blockSize
+            << record.weak << record.strong;
+    }
+    
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "Failed to write mirror manifest:" << file.fileName();
+        return false;
+    }
+    return true;
+}
+
+QStringList JournalMirror::journalFiles() const
+{
+    // A mirror kept inside the journal must not mirror itself
+    const QString mirrorPrefix = m_journalDir.relativeFilePath(m_mirrorDir.absolutePath()) + "/";
+    const bool mirrorInside = !mirrorPrefix.startsWith("../");
+    
+    QStringList files;
+    QDirIterator it(m_journalDir.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = m_journalDir.relativeFilePath(it.next());
+        if (!mirrorInside || !path.startsWith(mirrorPrefix)) {
+            files << path;
+        }
+    }
+    files.sort();
+    return files;
+}
+
+JournalMirror::SyncStats JournalMirror::sync(const std::function<bool(int done, int total)>& progress)
+{
+    TraceSpan span("JournalMirror::sync", "io");
+    
+    SyncStats stats;
+    if (m_journalDir.absolutePath() == m_mirrorDir.absolutePath()) {
+        stats.errors << tr("The mirror cannot be the journal itself");
+        return stats;
+    }
+    if (!m_mirrorDir.mkpath(".")) {
+        stats.errors << tr("Cannot create %1").arg(m_mirrorDir.absolutePath());
+        return stats;
+    }
+    
+    loadManifest();
+    
+    const QStringList files = journalFiles();
+    stats.files = files.size();
+    bool stopped = false;
+    for (int i = 0; i < files.size(); ++i) {
+        if (!syncFile(files[i], QFileInfo(m_journalDir.absoluteFilePath(files[i])), &stats)) {
+            stats.errors << files[i];
+        }
+        if (progress && !progress(i + 1, files.size())) {
+            stopped = true;
+            break;
+        }
+    }
+    
+    // A stopped sync has not seen every file, so nothing is known to be gone
+    if (!stopped) {
+        const QSet<QString> present(files.begin(), files.end());
+        for (auto it = m_records.begin(); it != m_records.end(); ) {
+            if (present.contains(it.key())) {
+                ++it;
+                continue;
+            }
+            const QString target = m_mirrorDir.absoluteFilePath(it.key());
+            if (QFile::exists(target) && !QFile::remove(target)) {
+                qWarning() << "Failed to remove mirrored file:" << target;
+                stats.errors << it.key();
+                ++it;
+                continue;
+            }
+            it = m_records.erase(it);
+            ++stats.removed;
+        }
+    }
+    
+    if (!saveManifest()) {
+        stats.errors << QString(MIRROR_META_DIR) + "/" + MANIFEST_FILE;
+    }
+    return stats;
+}
+
+bool JournalMirror::syncFile(const QString& path, const QFileInfo& info, SyncStats *stats)
+{
+    const QString target = m_mirrorDir.absoluteFilePath(path);
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    
+    auto existing = m_records.constFind(path);
+    if (existing != m_records.constEnd() && existing->size == info.size()
+        && existing->modified == modified && QFile::exists(target)) {
+        ++stats->unchanged;
+        return true;
+    }
+    
+    QFile source(info.absoluteFilePath());
+    if (!source.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open journal file:" << source.fileName();
+        return false;
+    }
+    const qint64 size = source.size();
+    const uchar *data = size > 0 ? source.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        qWarning() << "Failed to map journal file:" << source.fileName();
+        return false;
+    }
+    
+    // The old copy can only be reused if it is still what the manifest
+    // describes
+    FileRecord old;
+    const bool hadRecord = existing != m_records.constEnd();
+    if (hadRecord && QFileInfo(target).size() == existing->size) {
+        old = *existing;
+    }
+    
+    const QList<Segment> delta = computeDelta(data, size, old);
+    bool inPlace = old.size >= 0 && size >= IN_PLACE_MIN_SIZE;
+    for (const Segment& segment : delta) {
+        if (segment.oldOffset >= 0 && segment.oldOffset != segment.offset) {
+            inPlace = false;
+        }
+    }
+    
+    // Forget the old copy before touching it, so an interrupted update
+    // is redone in full next time instead of trusting half-written blocks
+    m_records.remove(path);
+    if (inPlace && !saveManifest()) {
+        inPlace = false;
+    }
+    
+    bool written = false;
+    if (inPlace) {
+        QFile out(target);
+        written = out.open(QIODevice::ReadWrite);
+        for (const Segment& segment : delta) {
+            if (written && segment.oldOffset < 0) {
+                written = out.seek(segment.offset)
+                       && out.write(reinterpret_cast<const char *>(data + segment.offset),
+                                    segment.length) == segment.length;
+            }
+        }
+        written = written && out.resize(size);
+    } else {
+        QDir().mkpath(QFileInfo(target).absolutePath());
+        
+        // The old copy is read while the new one is written beside it
+        QFile oldCopy(target);
+        QSaveFile out(target);
+        written = out.open(QIODevice::WriteOnly);
+        for (const Segment& segment : delta) {
+            if (!written) {
+                break;
+            }
+            if (segment.oldOffset < 0) {
+                written = out.write(reinterpret_cast<const char *>(data + segment.offset),
+                                    segment.length) == segment.length;
+                continue;
+            }
+            if (!oldCopy.isOpen() && !oldCopy.open(QIODevice::ReadOnly)) {
+                written = false;
+                break;
+            }
+            const QByteArray block = oldCopy.seek(segment.oldOffset) ? oldCopy.read(segment.length)
+                                                                     : QByteArray();
+            written = block.size() == segment.length && out.write(block) == segment.length;
+        }
+        oldCopy.close();
+        written = written && out.commit();
+    }
+    
+    if (!written) {
+        qWarning() << "Failed to write mirrored file:" << target;
+        if (data) {
+            source.unmap(const_cast<uchar *>(data));
+        }
+        return false;
+    }
+    
+    for (const Segment& segment : delta) {
+        if (segment.oldOffset < 0) {
+            stats->literalBytes += segment.length;
+        } else {
+            stats->reusedBytes += segment.length;
+        }
+    }
+    if (hadRecord) {
+        ++stats->updated;
+    } else {
+        ++stats->copied;
+    }
+    
+    // Only record the file if it did not change while it was copied;
+    // otherwise it is picked up again on the next sync
+    FileRecord record = signature(data, size);
+    record.modified = modified;
+    if (data) {
+        source.unmap(const_cast<uchar *>(data));
+    }
+    const QFileInfo after(info.absoluteFilePath());
+    if (after.size() == size && after.lastModified().toMSecsSinceEpoch() == modified) {
+        m_records.insert(path, record);
+    }
+    
+    QFile copy(target);
+    if (copy.open(QIODevice::ReadWrite)) {
+        copy.setFileTime(info.lastModified(), QFileDevice::FileModificationTime);
+    }
+    return true;
+}
+
+JournalMirror::VerifyResult JournalMirror::verify(const std::function<bool(int done, int total)>& progress)
+{
+    TraceSpan span("JournalMirror::verify", "io");
+    
+    VerifyResult result;
+    if (!loadManifest()) {
+        result.errors << tr("No readable manifest in %1").arg(m_mirrorDir.absolutePath());
+        return result;
+    }
+    result.files = m_records.size();
+    
+    // Large files are split so that one big pack does not keep a single
+    // core busy while the others sit idle
+    QList<Piece> pieces;
+    for (auto it = m_records.constBegin(); it != m_records.constEnd(); ++it) {
+        const FileRecord& record = it.value();
+        const QFileInfo target(m_mirrorDir.absoluteFilePath(it.key()));
+        if (!target.exists()) {
+            result.missing << it.key();
+            continue;
+        }
+        if (target.size() != record.size) {
+            result.damaged << it.key();
+            continue;
+        }
+        
+        const QFileInfo source(m_journalDir.absoluteFilePath(it.key()));
+        if (!source.exists() || source.size() != record.size
+            || source.lastModified().toMSecsSinceEpoch() != record.modified) {
+            result.outdated << it.key();
+        }
+        
+        const int blocksPerPiece = int(qMax<qint64>(1, VERIFY_PIECE_SIZE / record.blockSize));
+        for (int first = 0; first < record.weak.size(); first += blocksPerPiece) {
+            pieces.append(Piece{ it.key(), &record, first,
+                                 int(qMin<qsizetype>(blocksPerPiece, record.weak.size() - first)) });
+        }
+    }
+    
+    // Pieces go to the pool in batches so that progress can be reported
+    // and the check stopped between them
+    const int batchSize = qMax(1, QThread::idealThreadCount()) * 4;
+    QSet<QString> damaged;
+    for (int start = 0; start < pieces.size(); start += batchSize) {
+        const QList<Piece> batch = pieces.mid(start, batchSize);
+        const QList<bool> intact = QtConcurrent::blockingMapped<QList<bool>>(batch,
+            [this](const Piece& piece) { return verifyPiece(piece); });
+        for (int i = 0; i < batch.size(); ++i) {
+            if (!intact[i]) {
+                damaged.insert(batch[i].path);
+            }
+        }
+        if (progress && !progress(int(qMin<qsizetype>(start + batchSize, pieces.size())), int(pieces.size()))) {
+            result.errors << tr("Verification stopped");
+            break;
+        }
+    }
+    
+    result.damaged += QStringList(damaged.begin(), damaged.end());
+    
+    // Damaged copies are forgotten so that the next sync rewrites them
+    if (!result.damaged.isEmpty()) {
+        for (const QString& path : std::as_const(result.damaged)) {
+            m_records.remove(path);
+        }
+        saveManifest();
+    }
+    result.missing.sort();
+    result.damaged.sort();
+    result.outdated.sort();
+    return result;
+}
+
+bool JournalMirror::verifyPiece(const Piece& piece) const
+{
+    QFile file(m_mirrorDir.absoluteFilePath(piece.path));
+    const qint64 block = piece.record->blockSize;
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(qint64(piece.firstBlock) * block)) {
+        return false;
+    }
+    
+    for (int i = piece.firstBlock; i < piece.firstBlock + piece.blockCount; ++i) {
+        const qint64 length = qMin(block, piece.record->size - qint64(i) * block);
+        const QByteArray data = file.read(length);
+        if (data.size() != length
+            || strongChecksum(reinterpret_cast<const uchar *>(data.constData()), length)
+               != piece.record->strong.mid(qsizetype(i) * STRONG_SIZE, STRONG_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
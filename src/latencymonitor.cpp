@@ -0,0 +1,201 @@
+#include "latencymonitor.h"
+#include <QtAlgorithms>
+#include <QStringList>
+#include <cmath>
+
+// Values below 2^SUB_BITS get a bucket each; above, every power of two
+// gets SUB_HALF buckets
+static const int SUB_BITS = 7;
+static const int SUB_COUNT = 1 << SUB_BITS;
+static const int SUB_HALF = SUB_COUNT / 2;
+
+// Longest duration kept apart from the rest, about 68 seconds
+static const int MAX_BITS = 36;
+static const qint64 MAX_VALUE = (qint64(1) << MAX_BITS) - 1;
+static const int BUCKET_COUNT = SUB_COUNT + (MAX_BITS - SUB_BITS) * SUB_HALF;
+
+static QString formatMs(qint64 nanoseconds)
+{
+    return QString::number(nanoseconds / 1e6, 'f', 3);
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_buckets(BUCKET_COUNT, 0)
+    , m_count(0)
+    , m_max(0)
+    , m_sum(0)
+{
+}
+
+int LatencyHistogram::bucketFor(qint64 value)
+{
+    if (value < SUB_COUNT) {
+        return int(value);
+    }
+    
+    int msb = 63 - qCountLeadingZeroBits(quint64(value));
+    int shift = msb - (SUB_BITS - 1);
+    int sub = int(value >> shift);
+    return SUB_COUNT + (shift - 1) * SUB_HALF + (sub - SUB_HALF);
+}
+
+qint64 LatencyHistogram::valueFor(int bucket)
+{
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    
+    // Highest value that lands in this bucket
+    int offset = bucket - SUB_COUNT;
+    int shift = offset / SUB_HALF + 1;
+    qint64 sub = offset % SUB_HALF + SUB_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(qint64 nanoseconds)
+{
+    qint64 value = qBound(qint64(0), nanoseconds, MAX_VALUE);
+    
+    ++m_buckets[bucketFor(value)];
+    ++m_count;
+    m_sum += double(nanoseconds);
+    m_max = qMax(m_max, nanoseconds);
+}
+
+void LatencyHistogram::reset()
+{
+    std::fill(m_buckets.begin(), m_buckets.end(), 0);
+    m_count = 0;
+    m_max = 0;
+    m_sum = 0;
+}
+
+double LatencyHistogram::mean() const
+{
+    return m_count > 0 ? m_sum / double(m_count) : 0.0;
+}
+
+qint64 LatencyHistogram::percentile(double percentile) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    
+    quint64 target = quint64(std::ceil(qBound(0.0, percentile, 100.0) / 100.0 * double(m_count)));
+    target = qMax<quint64>(target, 1);
+    
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen >= target) {
+            return qMin(valueFor(bucket), m_max);
+        }
+    }
+    return m_max;
+}
+
+LatencyMonitor::LatencyMonitor()
+    : m_pendingInput(-1)
+{
+    m_clock.start();
+}
+
+void LatencyMonitor::record(Stage stage, qint64 nanoseconds)
+{
+    m_histograms[stage].record(nanoseconds);
+}
+
+void LatencyMonitor::markInput(qint64 receivedAt)
+{
+    // Key repeat can outrun painting; measure from the oldest unpainted key
+    if (m_pendingInput < 0) {
+        m_pendingInput = receivedAt;
+    }
+}
+
+void LatencyMonitor::markPainted()
+{
+    if (m_pendingInput >= 0) {
+        record(KeyToPaint, now() - m_pendingInput);
+        m_pendingInput = -1;
+    }
+}
+
+void LatencyMonitor::reset()
+{
+    for (LatencyHistogram &histogram : m_histograms) {
+        histogram.reset();
+    }
+    m_pendingInput = -1;
+}
+
+QString LatencyMonitor::stageName(Stage stage)
+{
+    switch (stage) {
+    case Input:
+        return QStringLiteral("input");
+    case Highlight:
+        return QStringLiteral("highlight");
+    case Layout:
+        return QStringLiteral("layout");
+    case Paint:
+        return QStringLiteral("paint");
+    case KeyToPaint:
+        return QStringLiteral("key-to-paint");
+    case StageCount:
+        break;
+    }
+    return QString();
+}
+
+QString LatencyMonitor::summary() const
+{
+    QStringList lines;
+    lines << QStringLiteral("%1 %2 %3 %4")
+                 .arg(QString(), -12)
+                 .arg(QStringLiteral("p50"), 7)
+                 .arg(QStringLiteral("p99"), 7)
+                 .arg(QStringLiteral("max"), 7);
+    
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const LatencyHistogram &histogram = m_histograms[stage];
+        lines << QStringLiteral("%1 %2 %3 %4")
+                     .arg(stageName(Stage(stage)), -12)
+                     .arg(formatMs(histogram.percentile(50)), 7)
+                     .arg(formatMs(histogram.percentile(99)), 7)
+                     .arg(formatMs(histogram.max()), 7);
+    }
+    lines << QStringLiteral("(ms, %1 keys)").arg(m_histograms[KeyToPaint].count());
+    
+    return lines.join('\n');
+}
+
+QString LatencyMonitor::report() const
+{
+    QStringList lines;
+    lines << QStringLiteral("jrnl editor latency (milliseconds)");
+    lines << QStringLiteral("%1 %2 %3 %4 %5 %6 %7 %8")
+                 .arg(QStringLiteral("stage"), -12)
+                 .arg(QStringLiteral("count"), 9)
+                 .arg(QStringLiteral("mean"), 9)
+                 .arg(QStringLiteral("p50"), 9)
+                 .arg(QStringLiteral("p90"), 9)
+                 .arg(QStringLiteral("p99"), 9)
+                 .arg(QStringLiteral("p99.9"), 9)
+                 .arg(QStringLiteral("max"), 9);
+    
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const LatencyHistogram &histogram = m_histograms[stage];
+        lines << QStringLiteral("%1 %2 %3 %4 %5 %6 %7 %8")
+                     .arg(stageName(Stage(stage)), -12)
+                     .arg(histogram.count(), 9)
+                     .arg(formatMs(qint64(histogram.mean())), 9)
+                     .arg(formatMs(histogram.percentile(50)), 9)
+                     .arg(formatMs(histogram.percentile(90)), 9)
+                     .arg(formatMs(histogram.percentile(99)), 9)
+                     .arg(formatMs(histogram.percentile(99.9)), 9)
+                     .arg(formatMs(histogram.max()), 9);
+    }
+    
+    return lines.join('\n') + '\n';
+}
@@ -0,0 +1,199 @@
+#include "linkgraph.h"
+#include <QRegularExpression>
+#include <algorithm>
+
+LinkGraph::LinkGraph()
+{
+}
+
+void LinkGraph::updateEntry(const QString& entryId, const QString& title, const QString& content)
+{
+    quint32 node;
+    auto it = m_entryIds.constFind(entryId);
+    if (it != m_entryIds.constEnd()) {
+        node = *it;
+        unlinkNode(node);
+    } else if (!m_freeNodes.isEmpty()) {
+        node = m_freeNodes.takeLast();
+        m_entryIds.insert(entryId, node);
+    } else {
+        node = m_nodes.size();
+        m_nodes.append(Node());
+        m_entryIds.insert(entryId, node);
+    }
+    
+    Node& n = m_nodes[node];
+    n.entryId = entryId;
+    n.used = true;
+    n.title = internTitle(title);
+    
+    const QStringList links = extractLinks(content);
+    for (const QString& link : links) {
+        quint32 target = internTitle(link);
+        if (!n.links.contains(target)) {
+            n.links.append(target);
+            m_linkedFrom[target].insert(node);
+        }
+    }
+    
+    const QStringList tags = extractTags(content);
+    for (const QString& tag : tags) {
+        quint32 id = internTag(tag);
+        if (!n.tags.contains(id)) {
+            n.tags.append(id);
+            m_taggedWith[id].insert(node);
+        }
+    }
+}
+
+void LinkGraph::removeEntry(const QString& entryId)
+{
+    auto it = m_entryIds.find(entryId);
+    if (it == m_entryIds.end()) {
+        return;
+    }
+    
+    quint32 node = *it;
+    unlinkNode(node);
+    m_nodes[node] = Node();
+    m_freeNodes.append(node);
+    m_entryIds.erase(it);
+}
+
+void LinkGraph::clear()
+{
+    m_nodes.clear();
+    m_freeNodes.clear();
+    m_entryIds.clear();
+    m_titleIds.clear();
+    m_linkedFrom.clear();
+    m_tagIds.clear();
+    m_tagNames.clear();
+    m_taggedWith.clear();
+}
+
+QStringList LinkGraph::backlinks(const QString& entryId) const
+{
+    QStringList result;
+    
+    auto it = m_entryIds.constFind(entryId);
+    if (it == m_entryIds.constEnd()) {
+        return result;
+    }
+    
+    const Node& target = m_nodes[*it];
+    for (quint32 node : m_linkedFrom[target.title]) {
+        if (node != *it) {
+            result.append(m_nodes[node].entryId);
+        }
+    }
+    return result;
+}
+
+QStringList LinkGraph::entriesWithTag(const QString& tag) const
+{
+    QStringList result;
+    
+    auto it = m_tagIds.constFind(normalize(tag));
+    if (it == m_tagIds.constEnd()) {
+        return result;
+    }
+    
+    for (quint32 node : m_taggedWith[*it]) {
+        result.append(m_nodes[node].entryId);
+    }
+    return result;
+}
+
+QStringList LinkGraph::tags() const
+{
+    QStringList result;
+    for (int id = 0; id < m_tagNames.size(); ++id) {
+        if (!m_taggedWith[id].isEmpty()) {
+            result.append(m_tagNames[id]);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+QStringList LinkGraph::extractLinks(const QString& content)
+{
+    // [[Title]] or [[Title|shown text]]
+    static const QRegularExpression linkPattern("\\[\\[([^\\[\\]|\\n]+)(?:\\|[^\\[\\]\\n]*)?\\]\\]");
+    
+    QStringList links;
+    QRegularExpressionMatchIterator it = linkPattern.globalMatch(content);
+    while (it.hasNext()) {
+        QString target = it.next().captured(1).trimmed();
+        if (!target.isEmpty()) {
+            links.append(target);
+        }
+    }
+    return links;
+}
+
+QStringList LinkGraph::extractTags(const QString& content)
+{
+    // #tag at a word start; needs a letter so "#1" and "# Heading" don't count
+    static const QRegularExpression tagPattern(
+        "(?:^|(?<=\\s))#([\\p{L}\\p{N}_/-]*\\p{L}[\\p{L}\\p{N}_/-]*)",
+        QRegularExpression::MultilineOption);
+    
+    QStringList tags;
+    QRegularExpressionMatchIterator it = tagPattern.globalMatch(content);
+    while (it.hasNext()) {
+        tags.append(normalize(it.next().captured(1)));
+    }
+    return tags;
+}
+
+quint32 LinkGraph::internTitle(const QString& title)
+{
+    const QString key = normalize(title);
+    auto it = m_titleIds.constFind(key);
+    if (it != m_titleIds.constEnd()) {
+        return *it;
+    }
+    
+    quint32 id = m_linkedFrom.size();
+    m_titleIds.insert(key, id);
+    m_linkedFrom.append(QSet<quint32>());
+    return id;
+}
+
+quint32 LinkGraph::internTag(const QString& tag)
+{
+    auto it = m_tagIds.constFind(tag);
+    if (it != m_tagIds.constEnd()) {
+        return *it;
+    }
+    
+    quint32 id = m_tagNames.size();
+    m_tagIds.insert(tag, id);
+    m_tagNames.append(tag);
+    m_taggedWith.append(QSet<quint32>());
+    return id;
+}
+
+void LinkGraph::unlinkNode(quint32 node)
+{
+    Node& n = m_nodes[node];
+    if (!n.used) {
+        return;
+    }
+    
+    for (quint32 target : n.links) {
+        m_linkedFrom[target].remove(node);
+    }
+    for (quint32 tag : n.tags) {
+        m_taggedWith[tag].remove(node);
+    }
+    n.links.clear();
+    n.tags.clear();
+}
+
+QString LinkGraph::normalize(const QString& text)
+{
+    return text.trimmed().toCaseFolded();
+}
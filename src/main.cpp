@@ -1,19 +1,283 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QDir>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QSet>
+#include <algorithm>
 #include "mainwindow.h"
+#include "journalmirror.h"
+#include "journaldaemon.h"
+#include "daemonclient.h"
+#include "filemanager.h"
+#include "markdownformat.h"
+#include "tracer.h"
 
-int main(int argc, char *argv[])
+static void setApplicationInfo(QCoreApplication& app)
 {
-    QApplication app(argc, argv);
-    
-    // Set application information
     app.setApplicationName("jrnl");
     app.setApplicationVersion("1.0.0");
     app.setOrganizationName("jrnl");
     app.setOrganizationDomain("jrnl.app");
+}
+
+static bool isHeadless(int argc, char *argv[])
+{
+    static const char *const commands[] = {
+        "--mirror", "--verify-mirror", "--daemon", "--stop-daemon", "--list", "--show"
+    };
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        for (const char *command : commands) {
+            if (arg.startsWith(command)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Serves until stopped with --stop-daemon; the journals the window had
+// open are loaded up front
+static int runDaemon(const QString& journal)
+{
+    JournalDaemon daemon;
+    QString error;
+    if (!daemon.start(&error)) {
+        QTextStream(stderr) << error << "\n";
+        return 1;
+    }
+    
+    QSettings settings;
+    QStringList journals = settings.value("journals/open").toStringList();
+    journals << settings.value("journals/active").toString() << journal;
+    journals.removeAll(QString());
+    journals.removeDuplicates();
+    for (const QString& directory : std::as_const(journals)) {
+        daemon.preload(directory);
+    }
+    
+    return QCoreApplication::exec();
+}
+
+// The daemon does not serve packed journals, so those are always read here
+static bool useDaemon(DaemonClient& client, const QString& journal)
+{
+    return FileManager::journalBackend(journal) == FileManager::Backend::Markdown
+        && client.connectToDaemon();
+}
+
+// Entries are asked of the daemon when one runs, else the journal is
+// loaded here
+static bool listEntries(const QString& journal, const QString& filter)
+{
+    QTextStream err(stderr);
+    QList<DaemonClient::EntrySummary> entries;
+    QString error;
+    
+    DaemonClient client;
+    if (useDaemon(client, journal)) {
+        if (!client.listEntries(journal, filter, &entries, &error)) {
+            err << error << "\n";
+            return false;
+        }
+    } else {
+        FileManager fileManager(journal);
+        const QList<JournalEntry> all = fileManager.loadAllEntries();
+        
+        QSet<QString> matching;
+        if (!filter.isEmpty()) {
+            fileManager.indexEntries(fileManager.loadArchivedEntries());
+            QStringList paths;
+            if (!fileManager.entriesMatching(filter, &paths, &error)) {
+                err << error << "\n";
+                return false;
+            }
+            matching = QSet<QString>(paths.begin(), paths.end());
+        }
+        
+        for (const JournalEntry& entry : all) {
+            if (filter.isEmpty() || matching.contains(entry.filePath())) {
+                entries.append(DaemonClient::EntrySummary{ entry.id(), entry.filePath(), entry.title(), entry.createdAt() });
+            }
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const DaemonClient::EntrySummary& a, const DaemonClient::EntrySummary& b) {
+            return a.createdAt < b.createdAt;
+        });
+    }
+    
+    QTextStream out(stdout);
+    const QDir directory(journal);
+    for (const DaemonClient::EntrySummary& entry : std::as_const(entries)) {
+        out << entry.id << "\t" << entry.createdAt.toString("yyyy-MM-dd HH:mm") << "\t"
+            << directory.relativeFilePath(entry.filePath) << "\t" << entry.title << "\n";
+    }
+    return true;
+}
+
+// The entry is named by its id or its file, so that entries without an
+// id in their frontmatter can be shown the same way in every run
+static bool showEntry(const QString& journal, const QString& reference)
+{
+    QTextStream err(stderr);
+    QString filePath;
+    QString text;
+    QString error;
+    
+    DaemonClient client;
+    if (useDaemon(client, journal)) {
+        if (!client.readEntry(journal, reference, &filePath, &text, &error)) {
+            err << error << "\n";
+            return false;
+        }
+    } else {
+        FileManager fileManager(journal);
+        fileManager.loadAllEntries();
+        filePath = fileManager.findEntry(reference);
+        if (filePath.isEmpty()) {
+            err << "No entry " << reference << "\n";
+            return false;
+        }
+        
+        const JournalEntry entry = fileManager.loadEntry(filePath);
+        if (entry.isEmpty()) {
+            err << "Failed to read " << filePath << "\n";
+            return false;
+        }
+        text = MarkdownFormat::serialize(entry);
+    }
+    
+    QTextStream(stdout) << text;
+    return true;
+}
+
+// jrnl --mirror <dir> | --verify-mirror <dir> | --list | --show <entry> |
+// --daemon | --stop-daemon [--journal <dir>], for cron jobs and scripts;
+// no window is created
+static int runHeadless(QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Query, mirror or serve a journal without opening a window.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption mirrorOption("mirror", "Bring the mirror in <dir> up to date.", "dir");
+    QCommandLineOption verifyOption("verify-mirror", "Check the mirror in <dir> for damage.", "dir");
+    QCommandLineOption listOption("list", "List entries: id, creation time, file and title.");
+    QCommandLineOption filterOption("filter", "With --list, only entries whose frontmatter matches <expr>.", "expr");
+    QCommandLineOption showOption("show", "Print the entry with the given <id> or file path.", "entry");
+    QCommandLineOption daemonOption("daemon", "Keep journals loaded in the background for quick access.");
+    QCommandLineOption stopDaemonOption("stop-daemon", "Stop the background daemon.");
+    QCommandLineOption journalOption("journal", "Journal to use (default: the active one).", "dir");
+    parser.addOption(mirrorOption);
+    parser.addOption(verifyOption);
+    parser.addOption(listOption);
+    parser.addOption(filterOption);
+    parser.addOption(showOption);
+    parser.addOption(daemonOption);
+    parser.addOption(stopDaemonOption);
+    parser.addOption(journalOption);
+    parser.process(app);
+    
+    QString journal = parser.value(journalOption);
+    if (journal.isEmpty()) {
+        journal = QSettings().value("journals/active", QDir::homePath() + "/.jrnl").toString();
+    }
+    journal = QDir(journal).absolutePath();
+    
+    if (parser.isSet(daemonOption)) {
+        return runDaemon(journal);
+    }
+    
+    if (parser.isSet(stopDaemonOption)) {
+        DaemonClient client;
+        if (!client.connectToDaemon()) {
+            QTextStream(stderr) << "No jrnl daemon is running\n";
+            return 1;
+        }
+        return client.shutdown() ? 0 : 1;
+    }
+    
+    QTextStream out(stdout);
+    bool ok = true;
+    
+    if (parser.isSet(listOption) || parser.isSet(showOption)) {
+        // Loading would create a missing journal directory
+        if (!QFileInfo(journal).isDir()) {
+            QTextStream(stderr) << "No journal at " << journal << "\n";
+            return 1;
+        }
+        if (parser.isSet(listOption)) {
+            ok = listEntries(journal, parser.value(filterOption));
+        }
+        if (parser.isSet(showOption)) {
+            ok = showEntry(journal, parser.value(showOption)) && ok;
+        }
+    }
+    
+    if (parser.isSet(mirrorOption)) {
+        JournalMirror mirror(journal, parser.value(mirrorOption));
+        JournalMirror::SyncStats stats = mirror.sync();
+        out << "Mirrored " << stats.files << " files: " << stats.unchanged << " unchanged, "
+            << stats.copied << " new, " << stats.updated << " updated, " << stats.removed << " removed\n"
+            << stats.literalBytes << " bytes written, " << stats.reusedBytes << " bytes reused\n";
+        for (const QString& error : std::as_const(stats.errors)) {
+            out << "Failed: " << error << "\n";
+        }
+        ok = stats.errors.isEmpty() && ok;
+    }
+    
+    if (parser.isSet(verifyOption)) {
+        JournalMirror mirror(journal, parser.value(verifyOption));
+        JournalMirror::VerifyResult result = mirror.verify();
+        out << "Verified " << result.files << " files\n";
+        for (const QString& path : std::as_const(result.missing)) {
+            out << "Missing: " << path << "\n";
+        }
+        for (const QString& path : std::as_const(result.damaged)) {
+            out << "Damaged: " << path << "\n";
+        }
+        for (const QString& path : std::as_const(result.outdated)) {
+            out << "Changed since last mirror: " << path << "\n";
+        }
+        for (const QString& error : std::as_const(result.errors)) {
+            out << error << "\n";
+        }
+        ok = ok && result.isClean();
+    }
+    
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (isHeadless(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        setApplicationInfo(app);
+        return runHeadless(app);
+    }
+    
+    QApplication app(argc, argv);
+    
+    // Set application information
+    setApplicationInfo(app);
+    
+    // JRNL_TRACE=<file> traces the whole session and writes it on exit
+    const QString traceFile = qEnvironmentVariable("JRNL_TRACE");
+    if (!traceFile.isEmpty()) {
+        Tracer::instance().setEnabled(true);
+    }
     
     // Create and show main window
     MainWindow window;
     window.show();
     
-    return app.exec();
+    int result = app.exec();
+    
+    if (!traceFile.isEmpty()) {
+        Tracer::instance().writeChromeTrace(traceFile);
+    }
+    
+    return result;
 }
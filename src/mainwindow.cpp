@@ -1,4 +1,9 @@
 #include "mainwindow.h"
+#include "tracer.h"
+#include "historydialog.h"
+#include "quickswitcher.h"
+#include "backgroundscheduler.h"
+#include "journalmirror.h"
 #include <QMenuBar>
 #include <QToolBar>
 #include <QStatusBar>
@@ -10,34 +15,68 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QPushButton>
+#include <QProgressDialog>
+#include <QSignalBlocker>
+#include <QFutureWatcher>
+#include <QDirIterator>
+#include <QSettings>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QTextCharFormat>
+#include <QFont>
+
+// Entries on each side of the selection to load ahead of time
+static const int PREFETCH_RADIUS = 2;
+
+// Entries listed under "Related"
+static const int RELATED_ENTRY_COUNT = 10;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_editor(nullptr)
+    , m_sidebar(nullptr)
+    , m_tagFilter(nullptr)
+    , m_fieldFilter(nullptr)
+    , m_calendarPanel(nullptr)
+    , m_calendar(nullptr)
     , m_entryList(nullptr)
+    , m_backlinkList(nullptr)
+    , m_relatedList(nullptr)
     , m_splitter(nullptr)
     , m_statusLabel(nullptr)
+    , m_journalSelector(nullptr)
     , m_fileManager(nullptr)
+    , m_journal(nullptr)
+    , m_nextJournalId(1)
+    , m_reloadTimer(nullptr)
+    , m_filterTimer(nullptr)
 {
-    // Initialize file manager with default directory
-    m_fileManager = new FileManager();
-    
     setupUi();
     setupMenus();
     setupToolbar();
     setupStatusBar();
     
-    // Load existing entries
-    loadEntryList();
+    // Coalesce bursts of changes (e.g. a sync client) into one reload
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(500);
+    connect(m_reloadTimer, &QTimer::timeout, this, &MainWindow::onJournalChangedOnDisk);
+    
+    // Reopen the journals from the last session
+    restoreJournals();
     
     // Set window properties
-    setWindowTitle("jrnl - Journaling Application");
     resize(1200, 800);
 }
 
 MainWindow::~MainWindow()
 {
-    delete m_fileManager;
+    // Each file manager cancels its own background work on destruction
+    for (OpenJournal *journal : m_journals) {
+        delete journal->fileManager;
+        delete journal;
+    }
 }
 
 void MainWindow::setupUi()
@@ -50,17 +89,78 @@ void MainWindow::setupUi()
     // Create splitter for sidebar and editor
     m_splitter = new QSplitter(Qt::Horizontal, this);
     
-    // Create entry list (sidebar)
-    m_entryList = new QListWidget(this);
-    m_entryList->setMaximumWidth(300);
-    m_entryList->setMinimumWidth(200);
-    connect(m_entryList, &QListWidget::itemClicked, this, &MainWindow::onEntrySelected);
+    // Create sidebar with tag filter, entry list and backlinks
+    m_sidebar = new QWidget(this);
+    m_sidebar->setMaximumWidth(300);
+    m_sidebar->setMinimumWidth(200);
+    QVBoxLayout *sidebarLayout = new QVBoxLayout(m_sidebar);
+    sidebarLayout->setContentsMargins(0, 0, 0, 0);
+    
+    // Switches between open journals
+    m_journalSelector = new QComboBox(m_sidebar);
+    connect(m_journalSelector, &QComboBox::currentIndexChanged, this, &MainWindow::onJournalSelected);
+    
+    // Calendar for jumping to a day or month, hidden until requested
+    m_calendarPanel = new QWidget(m_sidebar);
+    QVBoxLayout *calendarLayout = new QVBoxLayout(m_calendarPanel);
+    calendarLayout->setContentsMargins(0, 0, 0, 0);
+    
+    m_calendar = new QCalendarWidget(m_calendarPanel);
+    m_calendar->setVerticalHeaderFormat(QCalendarWidget::NoVerticalHeader);
+    connect(m_calendar, &QCalendarWidget::clicked, this, &MainWindow::onCalendarDayClicked);
+    connect(m_calendar, &QCalendarWidget::currentPageChanged, this, &MainWindow::updateCalendarMarks);
+    
+    QHBoxLayout *rangeButtons = new QHBoxLayout();
+    QPushButton *monthButton = new QPushButton(tr("Whole Month"), m_calendarPanel);
+    connect(monthButton, &QPushButton::clicked, this, &MainWindow::showCalendarMonth);
+    QPushButton *allButton = new QPushButton(tr("All Dates"), m_calendarPanel);
+    connect(allButton, &QPushButton::clicked, this, &MainWindow::clearDateRange);
+    rangeButtons->addWidget(monthButton);
+    rangeButtons->addWidget(allButton);
+    
+    calendarLayout->addWidget(m_calendar);
+    calendarLayout->addLayout(rangeButtons);
+    m_calendarPanel->hide();
+    
+    m_tagFilter = new QComboBox(m_sidebar);
+    connect(m_tagFilter, &QComboBox::currentIndexChanged, this, &MainWindow::onTagFilterChanged);
+    
+    m_fieldFilter = new QLineEdit(m_sidebar);
+    m_fieldFilter->setPlaceholderText(tr("Filter, e.g. project=alpha AND mood>=4"));
+    m_fieldFilter->setClearButtonEnabled(true);
+    m_filterTimer = new QTimer(this);
+    m_filterTimer->setSingleShot(true);
+    m_filterTimer->setInterval(200);
+    connect(m_fieldFilter, &QLineEdit::textChanged, m_filterTimer, qOverload<>(&QTimer::start));
+    connect(m_filterTimer, &QTimer::timeout, this, &MainWindow::populateEntryList);
+    
+    // Follows the current item so arrow keys browse entries too
+    m_entryList = new QListWidget(m_sidebar);
+    connect(m_entryList, &QListWidget::currentItemChanged, this, &MainWindow::onEntrySelected);
+    
+    m_backlinkList = new QListWidget(m_sidebar);
+    m_backlinkList->setMaximumHeight(150);
+    connect(m_backlinkList, &QListWidget::itemClicked, this, &MainWindow::onEntrySelected);
+    
+    m_relatedList = new QListWidget(m_sidebar);
+    m_relatedList->setMaximumHeight(150);
+    connect(m_relatedList, &QListWidget::itemClicked, this, &MainWindow::onEntrySelected);
+    
+    sidebarLayout->addWidget(m_journalSelector);
+    sidebarLayout->addWidget(m_calendarPanel);
+    sidebarLayout->addWidget(m_tagFilter);
+    sidebarLayout->addWidget(m_fieldFilter);
+    sidebarLayout->addWidget(m_entryList);
+    sidebarLayout->addWidget(new QLabel(tr("Linked from:"), m_sidebar));
+    sidebarLayout->addWidget(m_backlinkList);
+    sidebarLayout->addWidget(new QLabel(tr("Related:"), m_sidebar));
+    sidebarLayout->addWidget(m_relatedList);
     
     // Create editor
     m_editor = new MarkdownEditor(this);
     
     // Add to splitter
-    m_splitter->addWidget(m_entryList);
+    m_splitter->addWidget(m_sidebar);
     m_splitter->addWidget(m_editor);
     m_splitter->setStretchFactor(0, 0);
     m_splitter->setStretchFactor(1, 1);
@@ -86,9 +186,26 @@ void MainWindow::setupMenus()
     
     fileMenu->addSeparator();
     
+    QAction *openJournalAction = fileMenu->addAction(tr("&Open Journal..."));
+    openJournalAction->setShortcut(QKeySequence::Open);
+    connect(openJournalAction, &QAction::triggered, this, &MainWindow::openJournalDialog);
+    
+    QAction *closeJournalAction = fileMenu->addAction(tr("&Close Journal"));
+    connect(closeJournalAction, &QAction::triggered, this, &MainWindow::closeJournal);
+    
+    fileMenu->addSeparator();
+    
     QAction *deleteAction = fileMenu->addAction(tr("&Delete Entry"));
     connect(deleteAction, &QAction::triggered, this, &MainWindow::deleteEntry);
     
+    QAction *historyAction = fileMenu->addAction(tr("Entry &History..."));
+    historyAction->setShortcut(Qt::CTRL | Qt::Key_H);
+    connect(historyAction, &QAction::triggered, this, &MainWindow::showHistory);
+    
+    QAction *quickSwitchAction = fileMenu->addAction(tr("&Go to Entry..."));
+    quickSwitchAction->setShortcut(Qt::CTRL | Qt::Key_P);
+    connect(quickSwitchAction, &QAction::triggered, this, &MainWindow::showQuickSwitcher);
+    
     fileMenu->addSeparator();
     
     QAction *quitAction = fileMenu->addAction(tr("&Quit"));
@@ -103,6 +220,65 @@ void MainWindow::setupMenus()
     distractionFreeAction->setShortcut(Qt::CTRL | Qt::Key_D);
     connect(distractionFreeAction, &QAction::triggered, this, &MainWindow::toggleDistractionFree);
     
+    QAction *calendarAction = viewMenu->addAction(tr("&Calendar"));
+    calendarAction->setCheckable(true);
+    calendarAction->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_C);
+    connect(calendarAction, &QAction::toggled, this, &MainWindow::toggleCalendar);
+    
+    QAction *latencyAction = viewMenu->addAction(tr("&Latency Overlay"));
+    latencyAction->setCheckable(true);
+    latencyAction->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_L);
+    connect(latencyAction, &QAction::toggled, this, &MainWindow::toggleLatencyOverlay);
+    
+    QAction *spellAction = viewMenu->addAction(tr("Check &Spelling"));
+    spellAction->setCheckable(true);
+    spellAction->setShortcut(Qt::Key_F7);
+    spellAction->setChecked(QSettings().value("editor/spellCheck", true).toBool());
+    m_editor->setSpellCheckEnabled(spellAction->isChecked());
+    connect(spellAction, &QAction::toggled, this, &MainWindow::toggleSpellCheck);
+    connect(m_editor->spellChecker(), &SpellChecker::dictionaryReady, this, [this](bool found) {
+        if (!found) {
+            m_statusLabel->setText(tr("No dictionary found; spell checking is off"));
+        }
+    });
+    
+    // Tools menu
+    QMenu *toolsMenu = menuBar()->addMenu(tr("&Tools"));
+    
+    QAction *migrateAction = toolsMenu->addAction(tr("&Migrate to Sharded Layout..."));
+    connect(migrateAction, &QAction::triggered, this, &MainWindow::migrateToShardedLayout);
+    
+    QAction *backendAction = toolsMenu->addAction(tr("Storage &Backend..."));
+    connect(backendAction, &QAction::triggered, this, &MainWindow::changeStorageBackend);
+    
+    QAction *exportAction = toolsMenu->addAction(tr("&Export as Markdown..."));
+    connect(exportAction, &QAction::triggered, this, &MainWindow::exportToMarkdown);
+    
+    QAction *archiveAction = toolsMenu->addAction(tr("&Archive Old Entries..."));
+    connect(archiveAction, &QAction::triggered, this, &MainWindow::archiveOldEntries);
+    
+    QAction *mirrorAction = toolsMenu->addAction(tr("M&irror Journal..."));
+    connect(mirrorAction, &QAction::triggered, this, &MainWindow::mirrorJournal);
+    
+    QAction *verifyMirrorAction = toolsMenu->addAction(tr("&Verify Mirror..."));
+    connect(verifyMirrorAction, &QAction::triggered, this, &MainWindow::verifyMirror);
+    
+    toolsMenu->addSeparator();
+    
+    QAction *latencyReportAction = toolsMenu->addAction(tr("Dump &Latency Report..."));
+    connect(latencyReportAction, &QAction::triggered, this, &MainWindow::dumpLatencyReport);
+    
+    QAction *latencyResetAction = toolsMenu->addAction(tr("&Reset Latency Statistics"));
+    connect(latencyResetAction, &QAction::triggered, this, [this]() {
+        m_editor->latencyMonitor().reset();
+        m_statusLabel->setText(tr("Latency statistics reset"));
+    });
+    
+    QAction *traceAction = toolsMenu->addAction(tr("Record &Trace"));
+    traceAction->setCheckable(true);
+    traceAction->setChecked(Tracer::isEnabled());
+    connect(traceAction, &QAction::toggled, this, &MainWindow::toggleTracing);
+    
     // Settings menu
     QMenu *settingsMenu = menuBar()->addMenu(tr("&Settings"));
     
@@ -154,6 +330,8 @@ void MainWindow::newEntry()
 
 void MainWindow::saveEntry()
 {
+    TraceSpan span("MainWindow::saveEntry", "ui");
+    
     // Get title from user if not set
     QString title = m_currentEntry.title();
     if (title.isEmpty()) {
@@ -211,29 +389,121 @@ void MainWindow::deleteEntry()
     }
 }
 
+void MainWindow::showHistory()
+{
+    if (m_currentEntry.filePath().isEmpty()) {
+        QMessageBox::information(this, tr("Entry History"),
+                               tr("Save the entry first to start its history."));
+        return;
+    }
+    
+    HistoryDialog dialog(m_fileManager, m_currentEntry.filePath(), this);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    // Restoring edits the open entry; the user saves it as a new revision
+    JournalEntry revision = dialog.selectedRevision();
+    m_currentEntry.setTitle(revision.title());
+    m_editor->setPlainText(revision.content());
+    m_editor->setModified(true);
+    m_statusLabel->setText(tr("Restored earlier revision (unsaved)"));
+}
+
 void MainWindow::onEntrySelected(QListWidgetItem *item)
 {
+    TraceSpan span("MainWindow::onEntrySelected", "ui");
+    
     if (!item) {
         return;
     }
     
+    // Items hold entry ids, which stay valid when files are renamed or
+    // moved; read it first, as saving rebuilds the list and frees the item
+    openEntry(m_fileManager->entryPath(item->data(Qt::UserRole).toString()));
+}
+
+void MainWindow::showQuickSwitcher()
+{
+    if (!m_journal) {
+        return;
+    }
+    
+    // Titles only change on a rescan or a journal switch, which drop the index
+    if (!m_titleIndex) {
+        m_titleIndex = std::make_shared<const TitleIndex>(m_entryTitles);
+    }
+    
+    QuickSwitcher switcher(m_titleIndex, m_fileManager, this);
+    if (switcher.exec() != QDialog::Accepted) {
+        return;
+    }
+    
+    openEntry(switcher.selectedPath());
+}
+
+void MainWindow::openEntry(const QString& filePath)
+{
+    if (filePath.isEmpty() || filePath == m_currentEntry.filePath()) {
+        return;
+    }
+    
     // Check if current entry needs saving
     if (!maybeSave()) {
+        // Keep the list pointing at the entry still being edited
+        selectCurrentEntryInList();
         return;
     }
     
     // Load selected entry
-    QString filePath = item->data(Qt::UserRole).toString();
     JournalEntry entry = m_fileManager->loadEntry(filePath);
     
     if (!entry.isEmpty()) {
         displayEntry(entry);
         setCurrentEntry(entry);
     }
+    
+    selectCurrentEntryInList();
+    prefetchNeighbours();
+}
+
+void MainWindow::selectCurrentEntryInList()
+{
+    QSignalBlocker blocker(m_entryList);
+    
+    const QString id = m_currentEntry.id();
+    for (int row = 0; !id.isEmpty() && row < m_entryList->count(); ++row) {
+        if (m_entryList->item(row)->data(Qt::UserRole).toString() == id) {
+            m_entryList->setCurrentRow(row);
+            return;
+        }
+    }
+    m_entryList->setCurrentItem(nullptr);
+}
+
+void MainWindow::prefetchNeighbours()
+{
+    int row = m_entryList->currentRow();
+    if (row < 0) {
+        return;
+    }
+    
+    // Nearest first, so arrow-key browsing in either direction hits the cache
+    QStringList paths;
+    for (int distance = 1; distance <= PREFETCH_RADIUS; ++distance) {
+        for (int neighbour : { row + distance, row - distance }) {
+            if (neighbour >= 0 && neighbour < m_entryList->count()) {
+                paths << m_fileManager->entryPath(m_entryList->item(neighbour)->data(Qt::UserRole).toString());
+            }
+        }
+    }
+    m_fileManager->prefetch(paths);
 }
 
 void MainWindow::displayEntry(const JournalEntry& entry)
 {
+    TraceSpan span("MainWindow::displayEntry", "ui");
+    
     m_editor->setPlainText(entry.content());
     m_editor->setModified(false);
     m_statusLabel->setText(tr("Viewing: %1").arg(entry.title()));
@@ -242,27 +512,558 @@ void MainWindow::displayEntry(const JournalEntry& entry)
 void MainWindow::setCurrentEntry(const JournalEntry& entry)
 {
     m_currentEntry = entry;
+    updateBacklinks();
+    updateRelated();
 }
 
 void MainWindow::loadEntryList()
 {
-    m_entryList->clear();
+    TraceSpan span("MainWindow::loadEntryList", "ui");
     
-    QList<JournalEntry> entries = m_fileManager->loadAllEntries();
+    const QList<JournalEntry> entries = m_fileManager->loadAllEntries();
+    m_journal->loaded = true;
+    m_journal->stale = false;
     
+    m_entryTitles.clear();
+    m_titleIndex.reset();
     for (const JournalEntry& entry : entries) {
-        QString displayText = entry.title();
-        if (displayText.isEmpty()) {
-            displayText = tr("Untitled - %1").arg(
-                entry.createdAt().toString("yyyy-MM-dd hh:mm"));
+        m_entryTitles.insert(entry.filePath(), entryDisplayText(entry));
+    }
+    
+    refreshTagFilter();
+    populateEntryList();
+    updateBacklinks();
+    updateRelated();
+    updateCalendarMarks();
+    
+    m_statusLabel->setText(tr("%1 entries loaded").arg(entries.size()));
+}
+
+void MainWindow::populateEntryList()
+{
+    TraceSpan span("MainWindow::populateEntryList", "ui");
+    
+    QSignalBlocker blocker(m_entryList);
+    m_entryList->clear();
+    
+    // Restrict to the selected tag, if any
+    QString tag = m_tagFilter->currentData().toString();
+    QSet<QString> tagged;
+    if (!tag.isEmpty()) {
+        const QStringList paths = m_fileManager->entriesWithTag(tag);
+        tagged = QSet<QString>(paths.begin(), paths.end());
+    }
+    
+    // Restrict to entries whose frontmatter matches the field filter
+    const QString filter = m_fieldFilter->text().trimmed();
+    QSet<QString> matching;
+    bool filtering = false;
+    if (!filter.isEmpty()) {
+        QStringList matches;
+        QString error;
+        filtering = m_fileManager->entriesMatching(filter, &matches, &error);
+        if (filtering) {
+            matching = QSet<QString>(matches.begin(), matches.end());
+        } else {
+            m_statusLabel->setText(tr("Filter not applied: %1").arg(error));
+        }
+    }
+    
+    // The timeline index answers the date range in creation order
+    const QStringList paths = m_fileManager->entriesInRange(m_rangeFrom, m_rangeTo);
+    for (const QString& path : paths) {
+        if (!tag.isEmpty() && !tagged.contains(path)) {
+            continue;
+        }
+        if (filtering && !matching.contains(path)) {
+            continue;
+        }
+        
+        auto title = m_entryTitles.constFind(path);
+        if (title == m_entryTitles.constEnd()) {
+            continue;
         }
         
-        QListWidgetItem *item = new QListWidgetItem(displayText);
-        item->setData(Qt::UserRole, entry.filePath());
+        QListWidgetItem *item = new QListWidgetItem(*title);
+        item->setData(Qt::UserRole, m_fileManager->entryId(path));
         m_entryList->addItem(item);
     }
     
-    m_statusLabel->setText(tr("%1 entries loaded").arg(entries.size()));
+    selectCurrentEntryInList();
+}
+
+void MainWindow::refreshTagFilter()
+{
+    TraceSpan span("MainWindow::refreshTagFilter", "ui");
+    
+    // Rebuild the choices without firing a filter change
+    QSignalBlocker blocker(m_tagFilter);
+    QString current = m_tagFilter->currentData().toString();
+    
+    m_tagFilter->clear();
+    m_tagFilter->addItem(tr("All entries"), QString());
+    const QStringList tags = m_fileManager->tags();
+    for (const QString& tag : tags) {
+        m_tagFilter->addItem("#" + tag, tag);
+    }
+    
+    int index = m_tagFilter->findData(current);
+    m_tagFilter->setCurrentIndex(index >= 0 ? index : 0);
+    
+    m_fieldFilter->setToolTip(tr("Fields: %1").arg(m_fileManager->metadataFields().join(", ")));
+}
+
+void MainWindow::onTagFilterChanged()
+{
+    populateEntryList();
+}
+
+void MainWindow::setDateRange(const QDateTime& from, const QDateTime& to)
+{
+    m_rangeFrom = from;
+    m_rangeTo = to;
+    populateEntryList();
+    
+    if (from.isValid()) {
+        m_statusLabel->setText(tr("Showing %1 to %2 (%3 entries)")
+                               .arg(from.date().toString("yyyy-MM-dd"),
+                                    to.date().toString("yyyy-MM-dd"))
+                               .arg(m_entryList->count()));
+    } else {
+        m_statusLabel->setText(tr("Showing all %1 entries").arg(m_entryList->count()));
+    }
+}
+
+void MainWindow::onCalendarDayClicked(const QDate& date)
+{
+    setDateRange(date.startOfDay(), date.endOfDay());
+}
+
+void MainWindow::showCalendarMonth()
+{
+    QDate first(m_calendar->yearShown(), m_calendar->monthShown(), 1);
+    QDate last = first.addMonths(1).addDays(-1);
+    setDateRange(first.startOfDay(), last.endOfDay());
+}
+
+void MainWindow::clearDateRange()
+{
+    setDateRange(QDateTime(), QDateTime());
+}
+
+void MainWindow::toggleCalendar(bool visible)
+{
+    m_calendarPanel->setVisible(visible);
+    if (visible) {
+        updateCalendarMarks();
+    } else {
+        clearDateRange();
+    }
+}
+
+void MainWindow::toggleLatencyOverlay(bool visible)
+{
+    m_editor->setLatencyHudVisible(visible);
+}
+
+void MainWindow::toggleSpellCheck(bool enabled)
+{
+    m_editor->setSpellCheckEnabled(enabled);
+    QSettings().setValue("editor/spellCheck", enabled);
+}
+
+void MainWindow::updateCalendarMarks()
+{
+    TraceSpan span("MainWindow::updateCalendarMarks", "ui");
+    
+    if (!m_calendarPanel->isVisible()) {
+        return;
+    }
+    
+    // Day counts are precomputed by the timeline index, so marking the
+    // visible month is one lookup per day
+    m_calendar->setDateTextFormat(QDate(), QTextCharFormat());
+    
+    QDate first(m_calendar->yearShown(), m_calendar->monthShown(), 1);
+    for (QDate day = first.addDays(-7); day < first.addMonths(1).addDays(14); day = day.addDays(1)) {
+        int count = m_fileManager->entryCountOn(day);
+        if (count > 0) {
+            QTextCharFormat format;
+            format.setFontWeight(QFont::Bold);
+            format.setForeground(Qt::darkBlue);
+            format.setToolTip(tr("%n entries", nullptr, count));
+            m_calendar->setDateTextFormat(day, format);
+        }
+    }
+}
+
+void MainWindow::updateBacklinks()
+{
+    TraceSpan span("MainWindow::updateBacklinks", "ui");
+    
+    m_backlinkList->clear();
+    if (m_currentEntry.filePath().isEmpty()) {
+        return;
+    }
+    
+    const QStringList paths = m_fileManager->backlinks(m_currentEntry.filePath());
+    for (const QString& path : paths) {
+        QListWidgetItem *item = new QListWidgetItem(m_entryTitles.value(path, QFileInfo(path).fileName()));
+        item->setData(Qt::UserRole, m_fileManager->entryId(path));
+        m_backlinkList->addItem(item);
+    }
+}
+
+void MainWindow::updateRelated()
+{
+    TraceSpan span("MainWindow::updateRelated", "ui");
+    
+    m_relatedList->clear();
+    if (m_currentEntry.filePath().isEmpty()) {
+        return;
+    }
+    
+    const QStringList paths = m_fileManager->relatedEntries(m_currentEntry.filePath(), RELATED_ENTRY_COUNT);
+    for (const QString& path : paths) {
+        QListWidgetItem *item = new QListWidgetItem(m_entryTitles.value(path, QFileInfo(path).fileName()));
+        item->setData(Qt::UserRole, m_fileManager->entryId(path));
+        m_relatedList->addItem(item);
+    }
+}
+
+void MainWindow::indexArchivedEntries(OpenJournal *journal)
+{
+    // Decompress archived entries off the UI thread, then index them here
+    FileManager *fileManager = journal->fileManager;
+    int id = journal->id;
+    
+    auto *watcher = new QFutureWatcher<QList<JournalEntry>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, id]() {
+        OpenJournal *journal = journalById(id);
+        if (journal && !watcher->isCanceled()) {
+            journal->fileManager->indexEntries(watcher->result());
+            if (journal == m_journal) {
+                refreshTagFilter();
+                populateEntryList();
+                updateBacklinks();
+                updateRelated();
+            }
+        }
+        watcher->deleteLater();
+    });
+    watcher->setFuture(BackgroundScheduler::instance().run(fileManager, [fileManager]() {
+        return fileManager->loadArchivedEntries();
+    }));
+}
+
+void MainWindow::watchJournal(OpenJournal *journal)
+{
+    if (!journal->watcher) {
+        journal->watcher = new QFileSystemWatcher(this);
+        int id = journal->id;
+        connect(journal->watcher, &QFileSystemWatcher::directoryChanged, this, [this, id]() {
+            OpenJournal *journal = journalById(id);
+            if (journal == m_journal && journal->loaded) {
+                m_reloadTimer->start();
+            } else if (journal) {
+                // Rescanned when it is next shown, or once its scan ends
+                journal->stale = true;
+            }
+        });
+    }
+    
+    QFileSystemWatcher *watcher = journal->watcher;
+    if (!watcher->directories().isEmpty()) {
+        watcher->removePaths(watcher->directories());
+    }
+    
+    // The journal directory plus its YYYY/MM shards
+    const QString root = journal->fileManager->journalDirectory();
+    QStringList directories;
+    directories << root;
+    if (journal->fileManager->layout() == FileManager::Layout::Sharded) {
+        QDirIterator it(root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            directories << it.next();
+        }
+    }
+    watcher->addPaths(directories);
+}
+
+void MainWindow::onJournalChangedOnDisk()
+{
+    loadEntryList();
+    watchJournal(m_journal);
+}
+
+MainWindow::OpenJournal *MainWindow::journalById(int id) const
+{
+    for (OpenJournal *journal : m_journals) {
+        if (journal->id == id) {
+            return journal;
+        }
+    }
+    return nullptr;
+}
+
+MainWindow::OpenJournal *MainWindow::openJournal(const QString& directory)
+{
+    const QString path = QDir(directory).absolutePath();
+    for (OpenJournal *journal : m_journals) {
+        if (journal->fileManager->journalDirectory() == path) {
+            return journal;
+        }
+    }
+    
+    OpenJournal *journal = new OpenJournal;
+    journal->id = m_nextJournalId++;
+    journal->fileManager = new FileManager(path);
+    journal->watcher = nullptr;
+    journal->loaded = false;
+    journal->stale = false;
+    m_journals.append(journal);
+    
+    {
+        QSignalBlocker blocker(m_journalSelector);
+        m_journalSelector->addItem(QDir(path).dirName());
+        m_journalSelector->setItemData(m_journalSelector->count() - 1, path, Qt::ToolTipRole);
+    }
+    
+    // Scan entries ahead of time at the priority of a hidden journal, so
+    // switching to it later does not wait on the disk. Only this load
+    // asks a running daemon, which may first have to rescan the journal
+    FileManager *fileManager = journal->fileManager;
+    int id = journal->id;
+    journal->loading = BackgroundScheduler::instance().run(fileManager, [fileManager]() {
+        return fileManager->loadAllEntries(true);
+    });
+    
+    auto *watcher = new QFutureWatcher<QList<JournalEntry>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, id]() {
+        if (OpenJournal *journal = journalById(id)) {
+            finishLoading(journal);
+            if (journal == m_journal) {
+                showJournal(journal);
+            }
+        }
+        watcher->deleteLater();
+    });
+    watcher->setFuture(journal->loading);
+    
+    watchJournal(journal);
+    return journal;
+}
+
+void MainWindow::finishLoading(OpenJournal *journal)
+{
+    if (journal->loaded) {
+        return;
+    }
+    journal->loaded = true;
+    
+    if (journal->loading.isCanceled()) {
+        journal->stale = true;
+    } else {
+        const QList<JournalEntry> entries = journal->loading.result();
+        for (const JournalEntry& entry : entries) {
+            journal->entryTitles.insert(entry.filePath(), entryDisplayText(entry));
+        }
+    }
+    journal->loading = QFuture<QList<JournalEntry>>();
+    
+    indexArchivedEntries(journal);
+}
+
+void MainWindow::activateJournal(OpenJournal *journal)
+{
+    if (journal == m_journal) {
+        return;
+    }
+    
+    if (m_journal) {
+        if (!maybeSave()) {
+            QSignalBlocker blocker(m_journalSelector);
+            m_journalSelector->setCurrentIndex(m_journals.indexOf(m_journal));
+            return;
+        }
+        
+        // Keep what the outgoing journal was showing for when it comes back;
+        // one still loading gets its titles from the scan instead
+        if (m_journal->loaded) {
+            m_journal->currentEntry = m_currentEntry;
+            m_journal->entryTitles = m_entryTitles;
+        }
+    }
+    
+    m_journal = journal;
+    m_fileManager = journal->fileManager;
+    m_reloadTimer->stop();
+    BackgroundScheduler::instance().setActiveOwner(m_fileManager);
+    
+    {
+        QSignalBlocker blocker(m_journalSelector);
+        m_journalSelector->setCurrentIndex(m_journals.indexOf(journal));
+    }
+    setWindowTitle(tr("%1 - jrnl").arg(m_journalSelector->currentText()));
+    
+    if (journal->loaded) {
+        showJournal(journal);
+        return;
+    }
+    
+    // A scan still in flight now runs ahead of all other work. Rather than
+    // wait on it, show an empty journal until its watcher in openJournal()
+    // reports the scan finished
+    m_currentEntry = JournalEntry();
+    m_entryTitles.clear();
+    m_titleIndex.reset();
+    {
+        QSignalBlocker blocker(m_entryList);
+        m_entryList->clear();
+    }
+    m_backlinkList->clear();
+    m_relatedList->clear();
+    m_editor->clear();
+    m_editor->setModified(false);
+    m_editor->setEnabled(false);
+    m_sidebar->setEnabled(false);
+    m_statusLabel->setText(tr("Loading %1...").arg(m_fileManager->journalDirectory()));
+    saveOpenJournals();
+}
+
+void MainWindow::showJournal(OpenJournal *journal)
+{
+    m_editor->setEnabled(true);
+    m_sidebar->setEnabled(true);
+    
+    m_currentEntry = journal->currentEntry;
+    m_entryTitles = journal->entryTitles;
+    m_titleIndex.reset();
+    m_rangeFrom = QDateTime();
+    m_rangeTo = QDateTime();
+    
+    if (journal->stale) {
+        loadEntryList();
+        watchJournal(journal);
+    } else {
+        refreshTagFilter();
+        populateEntryList();
+        updateBacklinks();
+        updateRelated();
+        updateCalendarMarks();
+    }
+    
+    if (m_currentEntry.filePath().isEmpty()) {
+        m_editor->clear();
+        m_editor->setModified(false);
+    } else {
+        displayEntry(m_currentEntry);
+    }
+    
+    m_statusLabel->setText(tr("Journal: %1 (%2 entries)")
+                           .arg(m_fileManager->journalDirectory())
+                           .arg(m_entryTitles.size()));
+    saveOpenJournals();
+}
+
+void MainWindow::onJournalSelected(int index)
+{
+    if (index >= 0 && index < m_journals.size()) {
+        activateJournal(m_journals.at(index));
+    }
+}
+
+void MainWindow::restoreJournals()
+{
+    QSettings settings;
+    QStringList directories = settings.value("journals/open").toStringList();
+    QString active = settings.value("journals/active").toString();
+    
+    if (directories.isEmpty()) {
+        directories << QDir::homePath() + "/.jrnl";
+    }
+    if (!directories.contains(active)) {
+        active = directories.first();
+    }
+    
+    // Open the shown journal first so its scan is not queued behind the rest
+    activateJournal(openJournal(active));
+    for (const QString& directory : directories) {
+        openJournal(directory);
+    }
+    
+    // Restoring added the others to the selector after it was set
+    {
+        QSignalBlocker blocker(m_journalSelector);
+        m_journalSelector->setCurrentIndex(m_journals.indexOf(m_journal));
+    }
+    saveOpenJournals();
+}
+
+void MainWindow::saveOpenJournals()
+{
+    QStringList directories;
+    for (OpenJournal *journal : m_journals) {
+        directories << journal->fileManager->journalDirectory();
+    }
+    
+    QSettings settings;
+    settings.setValue("journals/open", directories);
+    settings.setValue("journals/active", m_fileManager->journalDirectory());
+}
+
+void MainWindow::openJournalDialog()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Open Journal"),
+                                                    m_fileManager->journalDirectory(),
+                                                    QFileDialog::ShowDirsOnly);
+    if (!dir.isEmpty()) {
+        activateJournal(openJournal(dir));
+    }
+}
+
+void MainWindow::closeJournal()
+{
+    if (m_journals.size() < 2) {
+        QMessageBox::information(this, tr("Close Journal"),
+                               tr("This is the only open journal."));
+        return;
+    }
+    
+    if (!maybeSave()) {
+        return;
+    }
+    
+    // Show a neighbouring journal first; its state is already current
+    OpenJournal *closing = m_journal;
+    int index = m_journals.indexOf(closing);
+    m_editor->setModified(false);
+    m_journal = nullptr;
+    activateJournal(m_journals.at(index == 0 ? 1 : index - 1));
+    
+    m_journals.removeAt(index);
+    {
+        QSignalBlocker blocker(m_journalSelector);
+        m_journalSelector->removeItem(index);
+        m_journalSelector->setCurrentIndex(m_journals.indexOf(m_journal));
+    }
+    
+    // Waits for any of its background work that is already running
+    delete closing->fileManager;
+    delete closing->watcher;
+    delete closing;
+    
+    saveOpenJournals();
+}
+
+QString MainWindow::entryDisplayText(const JournalEntry& entry) const
+{
+    QString displayText = entry.title();
+    if (displayText.isEmpty()) {
+        displayText = tr("Untitled - %1").arg(
+            entry.createdAt().toString("yyyy-MM-dd hh:mm"));
+    }
+    return displayText;
 }
 
 bool MainWindow::maybeSave()
@@ -291,15 +1092,246 @@ bool MainWindow::maybeSave()
 
 void MainWindow::showSettings()
 {
-    // Get new journal directory from user
-    QString dir = QFileDialog::getExistingDirectory(this, tr("Select Journal Directory"),
-                                                    m_fileManager->journalDirectory(),
-                                                    QFileDialog::ShowDirsOnly);
+    // The journal directory is the only preference; pick one to open
+    openJournalDialog();
+}
+
+void MainWindow::migrateToShardedLayout()
+{
+    QMessageBox::StandardButton reply;
+    reply = QMessageBox::question(this, tr("Sharded Layout"),
+                                  tr("Move entries into year/month folders?\n"
+                                     "Entries stay available while they are being moved."),
+                                  QMessageBox::Yes | QMessageBox::No);
+    if (reply != QMessageBox::Yes) {
+        return;
+    }
     
-    if (!dir.isEmpty()) {
-        m_fileManager->setJournalDirectory(dir);
+    QProgressDialog progressDialog(tr("Migrating entries..."), tr("Stop"), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    
+    int moved = m_fileManager->migrateToShardedLayout([&progressDialog](int done, int total) {
+        progressDialog.setMaximum(total);
+        progressDialog.setValue(done);
+        return !progressDialog.wasCanceled();
+    });
+    
+    // The open entry may have moved into its shard
+    const QString movedPath = m_fileManager->entryPath(m_currentEntry.id());
+    if (!movedPath.isEmpty()) {
+        m_currentEntry.setFilePath(movedPath);
+    }
+    
+    loadEntryList();
+    watchJournal(m_journal);
+    m_statusLabel->setText(tr("Moved %1 entries into sharded folders").arg(moved));
+}
+
+void MainWindow::changeStorageBackend()
+{
+    if (!maybeSave()) {
+        return;
+    }
+    
+    QStringList backends;
+    backends << tr("Markdown files (one file per entry)")
+             << tr("Packed store (single file)");
+    int current = m_fileManager->backend() == FileManager::Backend::Packed ? 1 : 0;
+    
+    bool ok;
+    QString choice = QInputDialog::getItem(this, tr("Storage Backend"),
+                                           tr("Store entries as:"),
+                                           backends, current, false, &ok);
+    if (!ok || backends.indexOf(choice) == current) {
+        return;
+    }
+    
+    FileManager::Backend backend = backends.indexOf(choice) == 1
+        ? FileManager::Backend::Packed : FileManager::Backend::Markdown;
+    
+    if (backend == FileManager::Backend::Packed) {
+        QMessageBox::StandardButton reply;
+        reply = QMessageBox::question(this, tr("Storage Backend"),
+                                      tr("Entries will be copied into a single pack file and their "
+                                         ".md files deleted. Use Tools > Export as Markdown first "
+                                         "if you want to keep them as files.\n\n"
+                                         "Convert the journal?"),
+                                      QMessageBox::Yes | QMessageBox::No);
+        if (reply != QMessageBox::Yes) {
+            return;
+        }
+    }
+    
+    if (m_fileManager->setBackend(backend)) {
         loadEntryList();
-        m_statusLabel->setText(tr("Journal directory changed to: %1").arg(dir));
+        m_statusLabel->setText(tr("Storage backend changed"));
+    } else {
+        QMessageBox::warning(this, tr("Storage Backend"),
+                           tr("Failed to convert the journal. "
+                              "Your entries were left unchanged."));
+    }
+}
+
+void MainWindow::exportToMarkdown()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Export Journal To"),
+                                                    QString(),
+                                                    QFileDialog::ShowDirsOnly);
+    if (dir.isEmpty()) {
+        return;
+    }
+    
+    if (m_fileManager->exportToMarkdown(dir)) {
+        m_statusLabel->setText(tr("Journal exported to: %1").arg(dir));
+    } else {
+        QMessageBox::warning(this, tr("Export Error"),
+                           tr("Some entries could not be exported."));
+    }
+}
+
+void MainWindow::archiveOldEntries()
+{
+    if (!maybeSave()) {
+        return;
+    }
+    
+    bool ok;
+    int days = QInputDialog::getInt(this, tr("Archive Old Entries"),
+                                    tr("Compress entries older than (days):"),
+                                    m_fileManager->archiveAgeDays(), 1, 36500, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    
+    m_fileManager->setArchiveAgeDays(days);
+    int archived = m_fileManager->archiveOldEntries();
+    
+    loadEntryList();
+    m_statusLabel->setText(tr("Archived %1 entries").arg(archived));
+}
+
+void MainWindow::mirrorJournal()
+{
+    if (!maybeSave()) {
+        return;
+    }
+    
+    QString directory = QFileDialog::getExistingDirectory(this, tr("Mirror Journal To"),
+                                                          m_fileManager->mirrorDirectory());
+    if (directory.isEmpty()) {
+        return;
+    }
+    m_fileManager->setMirrorDirectory(directory);
+    
+    QProgressDialog progressDialog(tr("Mirroring journal..."), tr("Stop"), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    
+    JournalMirror mirror(m_fileManager->journalDirectory(), directory);
+    JournalMirror::SyncStats stats = mirror.sync([&progressDialog](int done, int total) {
+        progressDialog.setMaximum(total);
+        progressDialog.setValue(done);
+        return !progressDialog.wasCanceled();
+    });
+    progressDialog.reset();
+    
+    if (!stats.errors.isEmpty()) {
+        QMessageBox::warning(this, tr("Mirror Journal"),
+                             tr("Some files could not be mirrored:\n%1")
+                                 .arg(stats.errors.join('\n')));
+    }
+    m_statusLabel->setText(tr("Mirrored %1 files: %2 new, %3 updated, %4 removed, %5 KiB written")
+                               .arg(stats.files).arg(stats.copied).arg(stats.updated)
+                               .arg(stats.removed).arg(stats.literalBytes / 1024));
+}
+
+void MainWindow::verifyMirror()
+{
+    QString directory = m_fileManager->mirrorDirectory();
+    if (directory.isEmpty()) {
+        directory = QFileDialog::getExistingDirectory(this, tr("Verify Mirror"));
+        if (directory.isEmpty()) {
+            return;
+        }
+    }
+    
+    QProgressDialog progressDialog(tr("Verifying mirror..."), tr("Stop"), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(500);
+    
+    JournalMirror mirror(m_fileManager->journalDirectory(), directory);
+    JournalMirror::VerifyResult result = mirror.verify([&progressDialog](int done, int total) {
+        progressDialog.setMaximum(total);
+        progressDialog.setValue(done);
+        return !progressDialog.wasCanceled();
+    });
+    progressDialog.reset();
+    
+    if (result.isClean()) {
+        QString message = tr("All %1 files in %2 are intact.").arg(result.files).arg(directory);
+        if (!result.outdated.isEmpty()) {
+            message += "\n" + tr("%n file(s) changed since the last mirror.", "", int(result.outdated.size()));
+        }
+        QMessageBox::information(this, tr("Verify Mirror"), message);
+        return;
+    }
+    
+    QStringList problems = result.errors;
+    for (const QString& path : std::as_const(result.missing)) {
+        problems << tr("Missing: %1").arg(path);
+    }
+    for (const QString& path : std::as_const(result.damaged)) {
+        problems << tr("Damaged: %1").arg(path);
+    }
+    QMessageBox::warning(this, tr("Verify Mirror"),
+                         tr("The mirror in %1 has problems; mirroring again repairs them.\n%2")
+                             .arg(directory, problems.join('\n')));
+}
+
+void MainWindow::dumpLatencyReport()
+{
+    QString report = m_editor->latencyMonitor().report();
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Latency Report"),
+                                                    "jrnl-latency.txt",
+                                                    tr("Text Files (*.txt)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, tr("Save Error"),
+                           tr("Could not write %1").arg(fileName));
+        return;
+    }
+    file.write(report.toUtf8());
+    
+    m_statusLabel->setText(tr("Latency report saved to: %1").arg(fileName));
+}
+
+void MainWindow::toggleTracing(bool enabled)
+{
+    if (enabled) {
+        Tracer::instance().setEnabled(true);
+        m_statusLabel->setText(tr("Recording trace"));
+        return;
+    }
+    
+    Tracer::instance().setEnabled(false);
+    
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Trace"),
+                                                    "jrnl-trace.json",
+                                                    tr("Chrome Trace Files (*.json)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    if (Tracer::instance().writeChromeTrace(fileName)) {
+        m_statusLabel->setText(tr("Trace saved to: %1").arg(fileName));
+    } else {
+        QMessageBox::warning(this, tr("Save Error"),
+                           tr("Could not write %1").arg(fileName));
     }
 }
 
@@ -311,11 +1343,11 @@ void MainWindow::toggleDistractionFree()
     
     // Optionally hide sidebar in distraction-free mode
     if (!current) {
-        m_entryList->hide();
+        m_sidebar->hide();
         menuBar()->hide();
         statusBar()->hide();
     } else {
-        m_entryList->show();
+        m_sidebar->show();
         menuBar()->show();
         statusBar()->show();
     }
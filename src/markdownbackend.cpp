@@ -0,0 +1,151 @@
+#include "markdownbackend.h"
+#include "tracer.h"
+#include "markdownformat.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QRegularExpression>
+#include <QtConcurrent>
+#include <QDebug>
+
+MarkdownBackend::MarkdownBackend(const QString& rootPath)
+    : m_root(rootPath)
+    , m_rootPath(m_root.absolutePath())
+    , m_sharded(false)
+{
+}
+
+bool MarkdownBackend::writeEntry(const QString& key, const JournalEntry& entry)
+{
+    TraceSpan span("MarkdownBackend::writeEntry", "io");
+    
+    QString filePath = m_root.absoluteFilePath(key);
+    
+    // Sharded keys include their YYYY/MM directory
+    if (!m_root.mkpath(QFileInfo(filePath).absolutePath())) {
+        qWarning() << "Failed to create directory for:" << filePath;
+        return false;
+    }
+    
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open file for writing:" << filePath;
+        return false;
+    }
+    
+    QTextStream out(&file);
+    out.setEncoding(QStringConverter::Utf8);
+    out << MarkdownFormat::serialize(entry);
+    
+    file.close();
+    return true;
+}
+
+JournalEntry MarkdownBackend::readEntry(const QString& key)
+{
+    TraceSpan span("MarkdownBackend::readEntry", "io");
+    
+    // Build the path by hand: QDir caches lazily and is not safe to share
+    // between threads
+    const QString path = keyPath(key);
+    
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open file for reading:" << path;
+        return JournalEntry();
+    }
+    
+    QString content;
+    {
+        TraceSpan decodeSpan("QTextStream::readAll", "io");
+        QTextStream in(&file);
+        in.setEncoding(QStringConverter::Utf8);
+        content = in.readAll();
+    }
+    file.close();
+    
+    bool hasFrontmatter = false;
+    JournalEntry entry = MarkdownFormat::parse(content, &hasFrontmatter);
+    
+    if (!hasFrontmatter) {
+        // Use file metadata for dates
+        QFileInfo fileInfo(path);
+        // birthTime() may not work on all filesystems, use lastModified() as fallback
+        QDateTime created = fileInfo.birthTime();
+        if (!created.isValid()) {
+            created = fileInfo.lastModified();
+        }
+        entry.setCreatedAt(created);
+        entry.setModifiedAt(fileInfo.lastModified());
+    }
+    
+    return entry;
+}
+
+bool MarkdownBackend::removeEntry(const QString& key)
+{
+    QFile file(m_root.absoluteFilePath(key));
+    return file.remove();
+}
+
+QStringList MarkdownBackend::listKeys()
+{
+    TraceSpan span("MarkdownBackend::listKeys", "io");
+    
+    if (m_sharded) {
+        return listShardedKeys();
+    }
+    
+    QStringList nameFilters;
+    nameFilters << "*.md";
+    return m_root.entryList(nameFilters, QDir::Files, QDir::Time | QDir::Reversed);
+}
+
+QStringList MarkdownBackend::listShardedKeys()
+{
+    static const QRegularExpression yearPattern("^\\d{4}$");
+    static const QRegularExpression monthPattern("^\\d{2}$");
+    
+    QStringList nameFilters;
+    nameFilters << "*.md";
+    
+    // Flat files that have not been migrated yet
+    QStringList files = m_root.entryList(nameFilters, QDir::Files, QDir::Unsorted);
+    
+    // Collect YYYY/MM shard directories
+    QStringList shards;
+    const QStringList years = m_root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Unsorted);
+    for (const QString& year : years) {
+        if (!yearPattern.match(year).hasMatch()) {
+            continue;
+        }
+        
+        QDir yearDir(m_root.absoluteFilePath(year));
+        const QStringList months = yearDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Unsorted);
+        for (const QString& month : months) {
+            if (monthPattern.match(month).hasMatch()) {
+                shards << year + "/" + month;
+            }
+        }
+    }
+    
+    // Read the shard directories in parallel
+    const QString root = m_root.absolutePath();
+    const QList<QStringList> shardFiles = QtConcurrent::blockingMapped<QList<QStringList>>(
+        shards, [root, nameFilters](const QString& shard) {
+            TraceSpan span("MarkdownBackend::listShard", "io");
+            QStringList names = QDir(root + "/" + shard).entryList(nameFilters, QDir::Files, QDir::Unsorted);
+            for (QString& name : names) {
+                name.prepend(shard + "/");
+            }
+            return names;
+        });
+    
+    for (const QStringList& names : shardFiles) {
+        files += names;
+    }
+    
+    // Names carry the creation date, so no stat() per file is needed to order them
+    sortKeysByName(files);
+    return files;
+}
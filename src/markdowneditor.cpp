@@ -1,14 +1,35 @@
 #include "markdowneditor.h"
+#include "tracer.h"
 #include <QKeyEvent>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QContextMenuEvent>
+#include <QMenu>
 #include <QFont>
 #include <QRegularExpression>
 
+// How often the latency overlay picks up new numbers
+static const int HUD_REFRESH_MS = 250;
+
 MarkdownEditor::MarkdownEditor(QWidget *parent)
     : QPlainTextEdit(parent)
     , m_distractionFreeMode(false)
+    , m_highlighter(nullptr)
+    , m_spellChecker(nullptr)
+    , m_latencyHud(nullptr)
 {
+    // The editor only accepts a layout on a document it is handed
+    QTextDocument *doc = new QTextDocument(this);
+    doc->setDocumentLayout(new TimedDocumentLayout(doc, &m_latency));
+    setDocument(doc);
+    
     setupEditor();
-    new MarkdownHighlighter(document());
+    m_spellChecker = new SpellChecker(this);
+    m_highlighter = new MarkdownHighlighter(document());
+    m_highlighter->setLatencyMonitor(&m_latency);
+    m_highlighter->setSpellChecker(m_spellChecker);
+    m_spellChecker->setHighlighter(m_highlighter);
+    setupLatencyHud();
 }
 
 void MarkdownEditor::setupEditor()
@@ -34,6 +55,51 @@ void MarkdownEditor::setupEditor()
     setTabStopDistance(tabStop * metrics.horizontalAdvance(' '));
 }
 
+void MarkdownEditor::setupLatencyHud()
+{
+    // A child of the editor rather than the viewport, so showing it never
+    // counts towards the paint timings it reports
+    m_latencyHud = new QLabel(this);
+    m_latencyHud->setAttribute(Qt::WA_TransparentForMouseEvents);
+    m_latencyHud->setTextFormat(Qt::PlainText);
+    m_latencyHud->setStyleSheet("QLabel { background: rgba(0, 0, 0, 160); color: #e0e0e0;"
+                                " padding: 6px; border-radius: 4px; }");
+    
+    QFont font("Courier");
+    font.setStyleHint(QFont::Monospace);
+    font.setPointSize(9);
+    m_latencyHud->setFont(font);
+    m_latencyHud->hide();
+    
+    m_hudTimer.setInterval(HUD_REFRESH_MS);
+    connect(&m_hudTimer, &QTimer::timeout, this, &MarkdownEditor::refreshLatencyHud);
+}
+
+void MarkdownEditor::setLatencyHudVisible(bool visible)
+{
+    m_latencyHud->setVisible(visible);
+    
+    if (visible) {
+        refreshLatencyHud();
+        m_hudTimer.start();
+    } else {
+        m_hudTimer.stop();
+    }
+}
+
+void MarkdownEditor::refreshLatencyHud()
+{
+    m_latencyHud->setText(m_latency.summary());
+    m_latencyHud->adjustSize();
+    positionLatencyHud();
+}
+
+void MarkdownEditor::positionLatencyHud()
+{
+    const int margin = 8;
+    m_latencyHud->move(width() - m_latencyHud->width() - margin, margin);
+}
+
 void MarkdownEditor::setDistractionFreeMode(bool enabled)
 {
     m_distractionFreeMode = enabled;
@@ -48,18 +114,93 @@ void MarkdownEditor::setDistractionFreeMode(bool enabled)
 
 void MarkdownEditor::keyPressEvent(QKeyEvent *event)
 {
+    TraceSpan span("MarkdownEditor::keyPressEvent", "editor");
+    
+    qint64 receivedAt = m_latency.now();
+    int revision = document()->revision();
+    int position = textCursor().position();
+    
     // Handle tab key to insert spaces
     if (event->key() == Qt::Key_Tab) {
         insertPlainText("    ");
-        return;
+    } else {
+        QPlainTextEdit::keyPressEvent(event);
     }
     
-    QPlainTextEdit::keyPressEvent(event);
+    // Only keys that change what is on screen get an end-to-end sample;
+    // anything else would be closed by an unrelated cursor blink
+    if (document()->revision() != revision || textCursor().position() != position) {
+        m_latency.record(LatencyMonitor::Input, m_latency.now() - receivedAt);
+        m_latency.markInput(receivedAt);
+    }
+}
+
+void MarkdownEditor::paintEvent(QPaintEvent *event)
+{
+    TraceSpan span("MarkdownEditor::paintEvent", "editor");
+    
+    qint64 start = m_latency.now();
+    
+    QPlainTextEdit::paintEvent(event);
+    
+    m_latency.record(LatencyMonitor::Paint, m_latency.now() - start);
+    m_latency.markPainted();
+}
+
+void MarkdownEditor::resizeEvent(QResizeEvent *event)
+{
+    QPlainTextEdit::resizeEvent(event);
+    positionLatencyHud();
+}
+
+void MarkdownEditor::contextMenuEvent(QContextMenuEvent *event)
+{
+    QMenu *menu = createStandardContextMenu(event->pos());
+    
+    // Offer to accept a misspelled word under the pointer
+    const QString word = m_spellChecker->misspelledWordAt(cursorForPosition(event->pos()));
+    if (!word.isEmpty()) {
+        QAction *first = menu->actions().value(0);
+        QAction *addWord = new QAction(tr("Add \"%1\" to Dictionary").arg(word), menu);
+        connect(addWord, &QAction::triggered, this, [this, word]() {
+            m_spellChecker->addToDictionary(word);
+        });
+        menu->insertAction(first, addWord);
+        menu->insertSeparator(first);
+    }
+    
+    menu->exec(event->globalPos());
+    delete menu;
+}
+
+// TimedDocumentLayout implementation
+TimedDocumentLayout::TimedDocumentLayout(QTextDocument *document, LatencyMonitor *monitor)
+    : QPlainTextDocumentLayout(document)
+    , m_latency(monitor)
+    , m_depth(0)
+{
+}
+
+void TimedDocumentLayout::documentChanged(int from, int charsRemoved, int charsAdded)
+{
+    TraceSpan span("TimedDocumentLayout::documentChanged", "editor");
+    
+    qint64 start = m_latency->now();
+    
+    ++m_depth;
+    QPlainTextDocumentLayout::documentChanged(from, charsRemoved, charsAdded);
+    --m_depth;
+    
+    if (m_depth == 0) {
+        m_latency->record(LatencyMonitor::Layout, m_latency->now() - start);
+    }
 }
 
 // MarkdownHighlighter implementation
 MarkdownHighlighter::MarkdownHighlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent)
+    , m_latency(nullptr)
+    , m_spellChecker(nullptr)
 {
     setupHighlightRules();
 }
@@ -104,6 +245,11 @@ void MarkdownHighlighter::setupHighlightRules()
     rule.format = codeFormat;
     m_rules.append(rule);
     
+    // Fenced code blocks span several blocks, so they are tracked in the
+    // block state rather than matched by a rule
+    m_fencePattern = QRegularExpression("^\\s*(```|~~~)");
+    m_codeFormat = codeFormat;
+    
     // Links
     QTextCharFormat linkFormat;
     linkFormat.setForeground(Qt::blue);
@@ -112,6 +258,21 @@ void MarkdownHighlighter::setupHighlightRules()
     rule.format = linkFormat;
     m_rules.append(rule);
     
+    // Wiki links to other entries
+    QTextCharFormat wikiLinkFormat;
+    wikiLinkFormat.setForeground(Qt::darkCyan);
+    wikiLinkFormat.setFontUnderline(true);
+    rule.pattern = QRegularExpression("\\[\\[[^\\[\\]\\n]+\\]\\]");
+    rule.format = wikiLinkFormat;
+    m_rules.append(rule);
+    
+    // Tags
+    QTextCharFormat tagFormat;
+    tagFormat.setForeground(Qt::darkYellow);
+    rule.pattern = QRegularExpression("(?:^|(?<=\\s))#[\\p{L}\\p{N}_/-]*\\p{L}[\\p{L}\\p{N}_/-]*");
+    rule.format = tagFormat;
+    m_rules.append(rule);
+    
     // Lists
     QTextCharFormat listFormat;
     listFormat.setForeground(Qt::darkMagenta);
@@ -125,11 +286,41 @@ void MarkdownHighlighter::setupHighlightRules()
 
 void MarkdownHighlighter::highlightBlock(const QString &text)
 {
-    for (const HighlightRule &rule : m_rules) {
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+    TraceSpan span("MarkdownHighlighter::highlightBlock", "editor");
+    
+    qint64 start = m_latency ? m_latency->now() : 0;
+    
+    const bool inFence = previousBlockState() == InCodeFence;
+    const bool isFence = m_fencePattern.match(text).hasMatch();
+    setCurrentBlockState(inFence != isFence ? InCodeFence : Normal);
+    
+    if (inFence || isFence) {
+        setFormat(0, text.length(), m_codeFormat);
+    } else {
+        for (const HighlightRule &rule : m_rules) {
+            QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
+            while (matchIterator.hasNext()) {
+                QRegularExpressionMatch match = matchIterator.next();
+                setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+            }
         }
+        
+        // Underlines go on top of the rule formats; a word can span
+        // several of them, so each character keeps its own
+        if (m_spellChecker) {
+            const QList<SpellChecker::Range> misspellings = m_spellChecker->misspellings(currentBlock(), text);
+            for (const SpellChecker::Range &range : misspellings) {
+                for (int i = range.start; i < range.start + range.length; ++i) {
+                    QTextCharFormat merged = format(i);
+                    merged.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+                    merged.setUnderlineColor(Qt::red);
+                    setFormat(i, 1, merged);
+                }
+            }
+        }
+    }
+    
+    if (m_latency) {
+        m_latency->record(LatencyMonitor::Highlight, m_latency->now() - start);
     }
 }
@@ -0,0 +1,133 @@
+#include "markdownformat.h"
+#include "tracer.h"
+#include <QStringList>
+#include <QRegularExpression>
+
+namespace MarkdownFormat {
+
+QString serialize(const JournalEntry& entry)
+{
+    TraceSpan span("MarkdownFormat::serialize", "parse");
+    
+    QString text;
+    
+    // Write metadata as YAML frontmatter
+    text += "---\n";
+    if (!entry.id().isEmpty()) {
+        text += "id: " + entry.id() + "\n";
+    }
+    text += "title: " + entry.title() + "\n";
+    text += "created: " + entry.createdAt().toString(Qt::ISODate) + "\n";
+    text += "modified: " + entry.modifiedAt().toString(Qt::ISODate) + "\n";
+    
+    // Other fields and unparsed lines are written back as they were
+    // read; list values carry their own line breaks
+    const QList<JournalEntry::Field> fields = entry.fields();
+    for (const JournalEntry::Field& field : fields) {
+        if (field.first.isEmpty()) {
+            text += field.second + "\n";
+            continue;
+        }
+        text += field.first + ":";
+        if (!field.second.isEmpty() && !field.second.startsWith('\n')) {
+            text += " ";
+        }
+        text += field.second + "\n";
+    }
+    text += "---\n\n";
+    
+    // Write title as H1 if present
+    if (!entry.title().isEmpty()) {
+        text += "# " + entry.title() + "\n\n";
+    }
+    
+    // Write content
+    text += entry.content();
+    
+    return text;
+}
+
+JournalEntry parse(const QString& text, bool *hasFrontmatter)
+{
+    TraceSpan span("MarkdownFormat::parse", "parse");
+    
+    JournalEntry entry;
+    
+    if (hasFrontmatter) {
+        *hasFrontmatter = text.startsWith("---\n");
+    }
+    
+    // Parse YAML frontmatter if present
+    if (text.startsWith("---\n")) {
+        int endPos = text.indexOf("\n---\n", 4);
+        if (endPos != -1) {
+            QString frontmatter = text.mid(4, endPos - 4);
+            QString mainContent = text.mid(endPos + 5).trimmed();
+            
+            // Parse frontmatter fields; indented lines continue the
+            // previous field, as in YAML block lists, and any other line
+            // is kept as it is so that it is written back unchanged
+            static const QRegularExpression fieldPattern("^([A-Za-z0-9_][A-Za-z0-9_.-]*):(?: (.*)|)$");
+            QList<JournalEntry::Field> fields;
+            bool continuing = false;
+            QStringList lines = frontmatter.split('\n');
+            for (const QString& line : lines) {
+                QRegularExpressionMatch match = fieldPattern.match(line);
+                if (!match.hasMatch()) {
+                    const bool indented = line.startsWith(' ') || line.startsWith('\t');
+                    if (continuing && indented && !line.trimmed().isEmpty()) {
+                        fields.last().second += "\n" + line;
+                    } else {
+                        fields.append(JournalEntry::Field(QString(), line));
+                        continuing = false;
+                    }
+                    continue;
+                }
+                
+                const QString name = match.captured(1);
+                const QString value = match.captured(2).trimmed();
+                continuing = false;
+                if (name == "id") {
+                    entry.setId(value);
+                } else if (name == "title") {
+                    entry.setTitle(value);
+                } else if (name == "created") {
+                    entry.setCreatedAt(QDateTime::fromString(value, Qt::ISODate));
+                } else if (name == "modified") {
+                    entry.setModifiedAt(QDateTime::fromString(value, Qt::ISODate));
+                } else {
+                    fields.append(JournalEntry::Field(name, value));
+                    continuing = true;
+                }
+            }
+            entry.setFields(fields);
+            
+            // Remove H1 title if it matches the frontmatter title exactly
+            if (!entry.title().isEmpty() && 
+                mainContent.startsWith("# " + entry.title() + "\n")) {
+                // Find the end of the title line
+                int newlinePos = mainContent.indexOf('\n');
+                if (newlinePos != -1) {
+                    mainContent = mainContent.mid(newlinePos + 1).trimmed();
+                }
+            }
+            
+            entry.setContent(mainContent);
+        }
+    } else {
+        // No frontmatter, try to extract title from H1
+        if (text.startsWith("# ")) {
+            int newlinePos = text.indexOf('\n');
+            if (newlinePos != -1) {
+                entry.setTitle(text.mid(2, newlinePos - 2).trimmed());
+                entry.setContent(text.mid(newlinePos + 1).trimmed());
+            }
+        } else {
+            entry.setContent(text);
+        }
+    }
+    
+    return entry;
+}
+
+} // namespace MarkdownFormat
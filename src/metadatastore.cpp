@@ -0,0 +1,580 @@
+#include "metadatastore.h"
+#include "tracer.h"
+#include <QDate>
+#include <QDateTime>
+#include <QtNumeric>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <limits>
+
+// Markers for rows without a value in a column
+static const quint32 NO_CODE = std::numeric_limits<quint32>::max();
+static const qint64 NO_DATE = std::numeric_limits<qint64>::min();
+
+// Characters that end an unquoted word in a filter
+static const QString FILTER_DELIMITERS = QStringLiteral("()=!<>~\"");
+
+void MetadataStore::Bitmap::set(quint32 row)
+{
+    if (words.size() <= row / 64) {
+        words.resize(row / 64 + 1, 0);
+    }
+    words[row / 64] |= quint64(1) << (row % 64);
+}
+
+void MetadataStore::Bitmap::reset(quint32 row)
+{
+    if (row / 64 < words.size()) {
+        words[row / 64] &= ~(quint64(1) << (row % 64));
+    }
+}
+
+void MetadataStore::Bitmap::unite(const Bitmap& other)
+{
+    if (words.size() < other.words.size()) {
+        words.resize(other.words.size(), 0);
+    }
+    for (size_t i = 0; i < other.words.size(); ++i) {
+        words[i] |= other.words[i];
+    }
+}
+
+void MetadataStore::Bitmap::intersect(const Bitmap& other)
+{
+    if (words.size() > other.words.size()) {
+        words.resize(other.words.size());
+    }
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] &= other.words[i];
+    }
+}
+
+void MetadataStore::Bitmap::subtract(const Bitmap& other)
+{
+    const size_t count = std::min(words.size(), other.words.size());
+    for (size_t i = 0; i < count; ++i) {
+        words[i] &= ~other.words[i];
+    }
+}
+
+// Bitmap of the rows whose typed value passes a test; the loop has no
+// branches, so compilers vectorise it
+template <typename T, typename Test>
+static std::vector<quint64> scanColumn(const std::vector<T>& values, Test test)
+{
+    std::vector<quint64> words((values.size() + 63) / 64, 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        words[i / 64] |= quint64(test(values[i])) << (i % 64);
+    }
+    return words;
+}
+
+// Recursive descent over the filter, evaluating as it goes:
+//   or   := and ("OR" and)*
+//   and  := term (["AND"] term)*
+//   term := "NOT" term | "(" or ")" | name [op value]
+struct MetadataStore::Parser
+{
+    enum class Kind { Word, Quoted, Operator, Open, Close, End };
+    
+    struct Token {
+        Kind kind;
+        QString text;
+    };
+    
+    const MetadataStore *store;
+    QVector<Token> tokens;
+    int pos = 0;
+    QString error;
+    
+    bool tokenize(const QString& text)
+    {
+        int i = 0;
+        while (i < text.size()) {
+            const QChar c = text[i];
+            if (c.isSpace()) {
+                ++i;
+            } else if (c == '(' || c == ')') {
+                tokens.append(Token{ c == '(' ? Kind::Open : Kind::Close, QString(c) });
+                ++i;
+            } else if (c == '"' || c == '\'') {
+                const int end = text.indexOf(c, i + 1);
+                if (end < 0) {
+                    error = tr("Missing closing quote");
+                    return false;
+                }
+                tokens.append(Token{ Kind::Quoted, text.mid(i + 1, end - i - 1) });
+                i = end + 1;
+            } else if (QStringLiteral("=!<>~").contains(c)) {
+                QString op(c);
+                if (c != '=' && c != '~' && i + 1 < text.size() && text[i + 1] == '=') {
+                    op += '=';
+                }
+                if (op == "!") {
+                    error = tr("Expected \"!=\"");
+                    return false;
+                }
+                tokens.append(Token{ Kind::Operator, op });
+                i += op.size();
+            } else {
+                int end = i;
+                while (end < text.size() && !text[end].isSpace() && !FILTER_DELIMITERS.contains(text[end])) {
+                    ++end;
+                }
+                tokens.append(Token{ Kind::Word, text.mid(i, end - i) });
+                i = end;
+            }
+        }
+        tokens.append(Token{ Kind::End, QString() });
+        return true;
+    }
+    
+    bool isKeyword(const Token& token, const char *keyword) const
+    {
+        return token.kind == Kind::Word && token.text.compare(QLatin1String(keyword), Qt::CaseInsensitive) == 0;
+    }
+    
+    Bitmap fail(const Token& token)
+    {
+        if (error.isEmpty()) {
+            error = token.kind == Kind::End ? tr("Filter ends too early")
+                                            : tr("Unexpected \"%1\"").arg(token.text);
+        }
+        return Bitmap();
+    }
+    
+    Bitmap parseOr()
+    {
+        Bitmap rows = parseAnd();
+        while (error.isEmpty() && isKeyword(tokens[pos], "OR")) {
+            ++pos;
+            rows.unite(parseAnd());
+        }
+        return rows;
+    }
+    
+    Bitmap parseAnd()
+    {
+        Bitmap rows = parseTerm();
+        while (error.isEmpty()) {
+            const Token& token = tokens[pos];
+            if (isKeyword(token, "AND")) {
+                ++pos;
+            } else if (isKeyword(token, "OR")
+                       || (token.kind != Kind::Word && token.kind != Kind::Quoted && token.kind != Kind::Open)) {
+                break;
+            }
+            rows.intersect(parseTerm());
+        }
+        return rows;
+    }
+    
+    Bitmap parseTerm()
+    {
+        const Token token = tokens[pos];
+        if (isKeyword(token, "NOT")) {
+            ++pos;
+            Bitmap rows = store->m_live;
+            rows.subtract(parseTerm());
+            return rows;
+        }
+        
+        if (token.kind == Kind::Open) {
+            ++pos;
+            Bitmap rows = parseOr();
+            if (tokens[pos].kind != Kind::Close) {
+                return fail(tokens[pos]);
+            }
+            ++pos;
+            return rows;
+        }
+        
+        if (token.kind != Kind::Word && token.kind != Kind::Quoted) {
+            return fail(token);
+        }
+        ++pos;
+        
+        if (tokens[pos].kind != Kind::Operator) {
+            return store->rowsWithField(token.text);
+        }
+        static const QHash<QString, Op> operators = {
+            { "=", Op::Equal }, { "!=", Op::NotEqual }, { "<", Op::Less }, { "<=", Op::LessEqual },
+            { ">", Op::Greater }, { ">=", Op::GreaterEqual }, { "~", Op::Contains },
+        };
+        const Op op = operators.value(tokens[pos].text);
+        ++pos;
+        
+        const Token value = tokens[pos];
+        if (value.kind != Kind::Word && value.kind != Kind::Quoted) {
+            return fail(value);
+        }
+        ++pos;
+        return store->compare(token.text, op, value.text);
+    }
+};
+
+MetadataStore::MetadataStore()
+{
+}
+
+void MetadataStore::updateEntry(const QString& entryId, const JournalEntry& entry)
+{
+    quint32 row;
+    auto it = m_rows.constFind(entryId);
+    if (it != m_rows.constEnd()) {
+        row = *it;
+        clearRow(row);
+    } else if (!m_freeRows.isEmpty()) {
+        row = m_freeRows.takeLast();
+        m_rows.insert(entryId, row);
+    } else {
+        row = m_entryIds.size();
+        m_entryIds.append(QString());
+        m_rows.insert(entryId, row);
+    }
+    m_entryIds[row] = entryId;
+    m_live.set(row);
+    
+    setValue("title", row, entry.title());
+    setValue("created", row, entry.createdAt().toString(Qt::ISODate));
+    setValue("modified", row, entry.modifiedAt().toString(Qt::ISODate));
+    const QList<JournalEntry::Field> fields = entry.fields();
+    for (const JournalEntry::Field& field : fields) {
+        if (field.first.isEmpty()) {
+            continue;
+        }
+        setValue(field.first, row, field.second);
+    }
+}
+
+void MetadataStore::removeEntry(const QString& entryId)
+{
+    auto it = m_rows.find(entryId);
+    if (it == m_rows.end()) {
+        return;
+    }
+    
+    const quint32 row = *it;
+    clearRow(row);
+    m_live.reset(row);
+    m_entryIds[row].clear();
+    m_freeRows.append(row);
+    m_rows.erase(it);
+}
+
+void MetadataStore::clear()
+{
+    m_entryIds.clear();
+    m_freeRows.clear();
+    m_rows.clear();
+    m_live = Bitmap();
+    m_columns.clear();
+    m_columnIds.clear();
+}
+
+QStringList MetadataStore::fieldNames() const
+{
+    QStringList names;
+    for (const Column& column : m_columns) {
+        const bool used = std::any_of(column.present.words.begin(), column.present.words.end(),
+                                      [](quint64 word) { return word != 0; });
+        if (used) {
+            names.append(column.name);
+        }
+    }
+    std::sort(names.begin(), names.end(), [](const QString& a, const QString& b) {
+        return a.compare(b, Qt::CaseInsensitive) < 0;
+    });
+    return names;
+}
+
+bool MetadataStore::select(const QString& filter, QStringList *entryIds, QString *error) const
+{
+    TraceSpan span("MetadataStore::select", "index");
+    
+    Parser parser;
+    parser.store = this;
+    Bitmap rows;
+    if (filter.trimmed().isEmpty()) {
+        rows = m_live;
+    } else if (parser.tokenize(filter)) {
+        rows = parser.parseOr();
+        if (parser.error.isEmpty() && parser.tokens[parser.pos].kind != Parser::Kind::End) {
+            parser.fail(parser.tokens[parser.pos]);
+        }
+    }
+    
+    if (!parser.error.isEmpty()) {
+        if (error) {
+            *error = parser.error;
+        }
+        return false;
+    }
+    
+    rows.intersect(m_live);
+    entryIds->clear();
+    for (size_t i = 0; i < rows.words.size(); ++i) {
+        for (quint64 word = rows.words[i]; word != 0; word &= word - 1) {
+            entryIds->append(m_entryIds[int(i * 64 + qCountTrailingZeroBits(word))]);
+        }
+    }
+    return true;
+}
+
+QStringList MetadataStore::splitValues(const QString& value)
+{
+    QStringList items;
+    const QString trimmed = value.trimmed();
+    if (trimmed.startsWith('[') && trimmed.endsWith(']')) {
+        // Flow list: [a, b, c]
+        items = trimmed.mid(1, trimmed.size() - 2).split(',');
+    } else if (value.startsWith('\n')) {
+        // Block list, one "- item" per line
+        const QStringList lines = value.split('\n', Qt::SkipEmptyParts);
+        for (const QString& line : lines) {
+            QString item = line.trimmed();
+            if (item.startsWith('-')) {
+                item.remove(0, 1);
+            }
+            items.append(item);
+        }
+    } else {
+        items.append(trimmed);
+    }
+    
+    QStringList values;
+    for (QString item : std::as_const(items)) {
+        item = item.trimmed();
+        if (item.size() >= 2 && (item.front() == '"' || item.front() == '\'') && item.back() == item.front()) {
+            item = item.mid(1, item.size() - 2);
+        }
+        if (!item.isEmpty()) {
+            values.append(item);
+        }
+    }
+    return values;
+}
+
+bool MetadataStore::parseDate(const QString& text, qint64 *from, qint64 *to)
+{
+    // Only text shaped like a date, so that plain numbers stay numbers
+    if (text.size() < 10 || !text[0].isDigit() || text[4] != '-') {
+        return false;
+    }
+    
+    // QDate also accepts a date with a time after it, so only a bare date
+    // stands for the whole day
+    if (text.size() > 10) {
+        const QDateTime dateTime = QDateTime::fromString(text, Qt::ISODate);
+        if (!dateTime.isValid()) {
+            return false;
+        }
+        *from = dateTime.toMSecsSinceEpoch();
+        *to = *from + 1;
+        return true;
+    }
+    
+    const QDate date = QDate::fromString(text, Qt::ISODate);
+    if (!date.isValid()) {
+        return false;
+    }
+    *from = date.startOfDay().toMSecsSinceEpoch();
+    *to = date.addDays(1).startOfDay().toMSecsSinceEpoch();
+    return true;
+}
+
+void MetadataStore::setValue(const QString& name, quint32 row, const QString& value)
+{
+    const QStringList items = splitValues(value);
+    if (items.isEmpty()) {
+        return;
+    }
+    
+    const QString key = name.toCaseFolded();
+    int id;
+    auto existing = m_columnIds.constFind(key);
+    if (existing != m_columnIds.constEnd()) {
+        id = *existing;
+    } else {
+        id = m_columns.size();
+        m_columns.append(Column());
+        m_columns.last().name = name;
+        m_columnIds.insert(key, id);
+    }
+    
+    Column& column = m_columns[id];
+    if (column.firstCodes.size() <= row) {
+        column.firstCodes.resize(row + 1, NO_CODE);
+    }
+    
+    for (const QString& item : items) {
+        const QString folded = item.toCaseFolded();
+        quint32 code;
+        auto known = column.codes.constFind(folded);
+        if (known != column.codes.constEnd()) {
+            code = *known;
+        } else {
+            code = column.values.size();
+            column.values.append(folded);
+            column.rowsWithCode.append(Bitmap());
+            column.codes.insert(folded, code);
+        }
+        
+        if (column.firstCodes[row] == NO_CODE) {
+            column.firstCodes[row] = code;
+        } else if (column.firstCodes[row] != code && !column.moreCodes[row].contains(code)) {
+            column.moreCodes[row].append(code);
+        }
+        column.rowsWithCode[code].set(row);
+        
+        // The first item that reads as a number or a date is the one
+        // range tests compare
+        bool isNumber;
+        const double number = item.toDouble(&isNumber);
+        qint64 from;
+        qint64 to;
+        if (isNumber) {
+            if (column.numbers.size() <= row) {
+                column.numbers.resize(row + 1, qQNaN());
+            }
+            if (qIsNaN(column.numbers[row])) {
+                column.numbers[row] = number;
+            }
+        } else if (parseDate(item, &from, &to)) {
+            if (column.dates.size() <= row) {
+                column.dates.resize(row + 1, NO_DATE);
+            }
+            if (column.dates[row] == NO_DATE) {
+                column.dates[row] = from;
+            }
+        }
+    }
+    column.present.set(row);
+}
+
+void MetadataStore::clearRow(quint32 row)
+{
+    for (Column& column : m_columns) {
+        if (row >= column.firstCodes.size() || column.firstCodes[row] == NO_CODE) {
+            continue;
+        }
+        
+        column.rowsWithCode[column.firstCodes[row]].reset(row);
+        column.firstCodes[row] = NO_CODE;
+        const QVector<quint32> more = column.moreCodes.take(row);
+        for (quint32 code : more) {
+            column.rowsWithCode[code].reset(row);
+        }
+        if (row < column.numbers.size()) {
+            column.numbers[row] = qQNaN();
+        }
+        if (row < column.dates.size()) {
+            column.dates[row] = NO_DATE;
+        }
+        column.present.reset(row);
+    }
+}
+
+MetadataStore::Bitmap MetadataStore::rowsWithField(const QString& name) const
+{
+    auto id = m_columnIds.constFind(name.toCaseFolded());
+    return id != m_columnIds.constEnd() ? m_columns[*id].present : Bitmap();
+}
+
+MetadataStore::Bitmap MetadataStore::compare(const QString& name, Op op, const QString& value) const
+{
+    // Entries without the field count as not equal to anything
+    if (op == Op::NotEqual) {
+        Bitmap rows = m_live;
+        rows.subtract(compare(name, Op::Equal, value));
+        return rows;
+    }
+    
+    Bitmap rows;
+    auto id = m_columnIds.constFind(name.toCaseFolded());
+    if (id == m_columnIds.constEnd()) {
+        return rows;
+    }
+    const Column& column = m_columns[*id];
+    const QString folded = value.toCaseFolded();
+    
+    if (op == Op::Contains) {
+        for (int code = 0; code < column.values.size(); ++code) {
+            if (column.values[code].contains(folded)) {
+                rows.unite(column.rowsWithCode[code]);
+            }
+        }
+        return rows;
+    }
+    
+    bool isNumber;
+    const double number = value.toDouble(&isNumber);
+    qint64 from = 0;
+    qint64 to = 0;
+    const bool isDate = !isNumber && parseDate(value, &from, &to);
+    
+    // Equality also holds between differently written numbers and dates
+    if (op == Op::Equal) {
+        auto code = column.codes.constFind(folded);
+        if (code != column.codes.constEnd()) {
+            rows = column.rowsWithCode[*code];
+        }
+        Bitmap typed;
+        if (isNumber) {
+            typed.words = scanColumn(column.numbers, [number](double v) { return v == number; });
+        } else if (isDate) {
+            typed.words = scanColumn(column.dates, [from, to](qint64 d) { return d >= from && d < to; });
+        }
+        rows.unite(typed);
+        return rows;
+    }
+    
+    if (isNumber) {
+        // NaN fails every comparison, so rows without a number drop out
+        switch (op) {
+        case Op::Less:
+            rows.words = scanColumn(column.numbers, [number](double v) { return v < number; });
+            break;
+        case Op::LessEqual:
+            rows.words = scanColumn(column.numbers, [number](double v) { return v <= number; });
+            break;
+        case Op::Greater:
+            rows.words = scanColumn(column.numbers, [number](double v) { return v > number; });
+            break;
+        default:
+            rows.words = scanColumn(column.numbers, [number](double v) { return v >= number; });
+            break;
+        }
+        return rows;
+    }
+    
+    if (isDate) {
+        // A day literal covers [from, to), so "<= day" includes all of it
+        switch (op) {
+        case Op::Less:
+            rows.words = scanColumn(column.dates, [from](qint64 d) { return d != NO_DATE && d < from; });
+            break;
+        case Op::LessEqual:
+            rows.words = scanColumn(column.dates, [to](qint64 d) { return d != NO_DATE && d < to; });
+            break;
+        case Op::Greater:
+            rows.words = scanColumn(column.dates, [to](qint64 d) { return d >= to; });
+            break;
+        default:
+            rows.words = scanColumn(column.dates, [from](qint64 d) { return d >= from; });
+            break;
+        }
+        return rows;
+    }
+    
+    // Text is ordered per distinct value, then the value's rows are taken whole
+    for (int code = 0; code < column.values.size(); ++code) {
+        const int order = column.values[code].compare(folded);
+        const bool match = (op == Op::Less && order < 0) || (op == Op::LessEqual && order <= 0)
+                        || (op == Op::Greater && order > 0) || (op == Op::GreaterEqual && order >= 0);
+        if (match) {
+            rows.unite(column.rowsWithCode[code]);
+        }
+    }
+    return rows;
+}
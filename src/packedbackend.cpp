@@ -0,0 +1,490 @@
+#include "packedbackend.h"
+#include "tracer.h"
+#include "markdownformat.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+// Pack layout: 16-byte file header (magic, version, generation), then a
+// sequence of records, each a 16-byte little-endian header followed by
+// the UTF-8 key and the data.
+static const char PACK_MAGIC[8] = { 'J', 'R', 'N', 'L', 'P', 'A', 'C', 'K' };
+static const quint32 PACK_VERSION = 1;
+static const qint64 PACK_HEADER_SIZE = 16;
+static const int PACK_GENERATION_OFFSET = 12;
+
+static const quint32 RECORD_MAGIC = 0x4345524A;  // "JREC"
+static const qint64 RECORD_HEADER_SIZE = 16;
+static const quint8 RECORD_PUT = 1;
+static const quint8 RECORD_DELETE = 2;
+
+// Compact once dead records exceed both this size and the live data
+static const qint64 COMPACT_MIN_DEAD_BYTES = 1024 * 1024;
+
+// Longest wait for another process to finish writing the pack
+static const int LOCK_TIMEOUT_MS = 10000;
+
+static qint64 recordSize(quint32 keyLength, quint32 dataLength)
+{
+    return RECORD_HEADER_SIZE + keyLength + dataLength;
+}
+
+PackedBackend::PackedBackend(const QString& packPath, const QString& lockPath)
+    : m_file(packPath)
+    , m_lockPath(lockPath)
+    , m_map(nullptr)
+    , m_mappedSize(0)
+    , m_indexedSize(0)
+    , m_generation(0)
+    , m_liveBytes(0)
+    , m_deadBytes(0)
+{
+    // Opening never compacts, so merely opening a journal cannot replace
+    // the pack another process is using
+    QDir().mkpath(QFileInfo(lockPath).absolutePath());
+    QLockFile lock(m_lockPath);
+    openPack(lockPack(&lock));
+}
+
+PackedBackend::~PackedBackend()
+{
+    unmap();
+    m_file.close();
+}
+
+bool PackedBackend::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_file.isOpen();
+}
+
+bool PackedBackend::writeEntry(const QString& key, const JournalEntry& entry)
+{
+    TraceSpan span("PackedBackend::writeEntry", "io");
+    
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return false;
+    }
+    
+    QLockFile lock(m_lockPath);
+    if (!lockPack(&lock) || !refresh(true)) {
+        return false;
+    }
+    
+    Slot slot;
+    if (!appendRecord(RECORD_PUT, key, MarkdownFormat::serialize(entry).toUtf8(), &slot)) {
+        return false;
+    }
+    
+    retireSlot(key);
+    m_index.insert(key, slot);
+    m_liveBytes += recordSize(slot.keyLength, slot.dataLength);
+    
+    maybeCompact();
+    return true;
+}
+
+JournalEntry PackedBackend::readEntry(const QString& key)
+{
+    TraceSpan span("PackedBackend::readEntry", "io");
+    
+    QByteArray data;
+    {
+        QMutexLocker locker(&m_mutex);
+        refresh(false);
+        auto it = m_index.constFind(key);
+        if (it == m_index.constEnd()) {
+            qWarning() << "Entry not found in pack:" << key;
+            return JournalEntry();
+        }
+        data = recordData(*it);
+    }
+    
+    return MarkdownFormat::parse(QString::fromUtf8(data));
+}
+
+bool PackedBackend::removeEntry(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return false;
+    }
+    
+    QLockFile lock(m_lockPath);
+    if (!lockPack(&lock) || !refresh(true) || !m_index.contains(key)) {
+        return false;
+    }
+    
+    Slot tombstone;
+    if (!appendRecord(RECORD_DELETE, key, QByteArray(), &tombstone)) {
+        return false;
+    }
+    
+    retireSlot(key);
+    m_deadBytes += recordSize(tombstone.keyLength, tombstone.dataLength);
+    
+    maybeCompact();
+    return true;
+}
+
+QStringList PackedBackend::listKeys()
+{
+    QStringList keys;
+    {
+        QMutexLocker locker(&m_mutex);
+        refresh(false);
+        keys = m_index.keys();
+    }
+    sortKeysByName(keys);
+    return keys;
+}
+
+bool PackedBackend::compact()
+{
+    QMutexLocker locker(&m_mutex);
+    QLockFile lock(m_lockPath);
+    if (!m_file.isOpen() || !lockPack(&lock) || !refresh(true)) {
+        return false;
+    }
+    return compactLocked();
+}
+
+bool PackedBackend::exportToMarkdown(const QString& directory)
+{
+    QMutexLocker locker(&m_mutex);
+    refresh(false);
+    
+    QDir target(directory);
+    bool success = true;
+    
+    for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+        QString filePath = target.absoluteFilePath(it.key());
+        if (!target.mkpath(QFileInfo(filePath).absolutePath())) {
+            qWarning() << "Failed to create directory for:" << filePath;
+            success = false;
+            continue;
+        }
+        
+        // Records hold the exact Markdown bytes, so write them through untouched
+        QFile file(filePath);
+        QByteArray data = recordData(it.value());
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+            qWarning() << "Failed to export entry:" << filePath;
+            success = false;
+        }
+    }
+    
+    return success;
+}
+
+bool PackedBackend::lockPack(QLockFile *lock) const
+{
+    if (!lock->tryLock(LOCK_TIMEOUT_MS)) {
+        qWarning() << "Failed to lock pack file:" << m_file.fileName() << lock->error();
+        return false;
+    }
+    return true;
+}
+
+bool PackedBackend::openPack(bool locked)
+{
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Failed to open pack file:" << m_file.fileName();
+        return false;
+    }
+    
+    if (m_file.size() == 0) {
+        QByteArray header(PACK_HEADER_SIZE, '\0');
+        std::memcpy(header.data(), PACK_MAGIC, sizeof(PACK_MAGIC));
+        qToLittleEndian<quint32>(PACK_VERSION, header.data() + 8);
+        if (!locked || m_file.write(header) != header.size() || !m_file.flush()) {
+            qWarning() << "Failed to initialize pack file:" << m_file.fileName();
+            m_file.close();
+            return false;
+        }
+    }
+    
+    if (!loadIndex(locked)) {
+        unmap();
+        m_file.close();
+        return false;
+    }
+    
+    return true;
+}
+
+bool PackedBackend::loadIndex(bool locked)
+{
+    TraceSpan span("PackedBackend::loadIndex", "io");
+    
+    m_index.clear();
+    m_liveBytes = 0;
+    m_deadBytes = 0;
+    
+    if (!remap()) {
+        return false;
+    }
+    
+    if (m_mappedSize < PACK_HEADER_SIZE || std::memcmp(m_map, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) {
+        qWarning() << "Not a jrnl pack file:" << m_file.fileName();
+        return false;
+    }
+    
+    m_generation = qFromLittleEndian<quint32>(m_map + PACK_GENERATION_OFFSET);
+    m_indexedSize = PACK_HEADER_SIZE;
+    return scanRecords(locked);
+}
+
+bool PackedBackend::scanRecords(bool locked)
+{
+    if (m_file.size() > m_mappedSize && !remap()) {
+        return false;
+    }
+    
+    qint64 pos = m_indexedSize;
+    while (pos + RECORD_HEADER_SIZE <= m_mappedSize) {
+        const uchar *header = m_map + pos;
+        const quint32 magic = qFromLittleEndian<quint32>(header);
+        const quint8 type = header[4];
+        const quint16 checksum = qFromLittleEndian<quint16>(header + 6);
+        const quint32 keyLength = qFromLittleEndian<quint32>(header + 8);
+        const quint32 dataLength = qFromLittleEndian<quint32>(header + 12);
+        const qint64 size = recordSize(keyLength, dataLength);
+        
+        if (magic != RECORD_MAGIC || pos + size > m_mappedSize) {
+            break;
+        }
+        
+        const char *body = reinterpret_cast<const char *>(header + RECORD_HEADER_SIZE);
+        if (qChecksum(QByteArrayView(body, keyLength + dataLength)) != checksum) {
+            break;
+        }
+        
+        const QString key = QString::fromUtf8(body, keyLength);
+        retireSlot(key);
+        
+        if (type == RECORD_PUT) {
+            m_index.insert(key, Slot{ pos, keyLength, dataLength });
+            m_liveBytes += size;
+        } else {
+            m_deadBytes += size;
+        }
+        
+        pos += size;
+    }
+    m_indexedSize = pos;
+    
+    // Anything after the last valid record is a write interrupted by a
+    // crash. Without the lock it may be another process's append still
+    // in progress, so it is only skipped.
+    if (pos < m_mappedSize && locked) {
+        qWarning() << "Discarding" << (m_mappedSize - pos) << "damaged bytes at end of pack:"
+                   << m_file.fileName();
+        unmap();
+        if (!m_file.resize(pos)) {
+            return false;
+        }
+        return remap();
+    }
+    
+    return true;
+}
+
+bool PackedBackend::refresh(bool locked)
+{
+    if (!m_file.isOpen()) {
+        return false;
+    }
+    
+    // Reads only look for a change in size; writers, holding the lock,
+    // always check the header too
+    const qint64 size = QFileInfo(m_file.fileName()).size();
+    if (!locked && size == m_indexedSize) {
+        return true;
+    }
+    
+    QFile current(m_file.fileName());
+    QByteArray header;
+    if (current.open(QIODevice::ReadOnly)) {
+        header = current.read(PACK_HEADER_SIZE);
+    }
+    if (header.size() < PACK_HEADER_SIZE) {
+        qWarning() << "Failed to read pack header:" << m_file.fileName();
+        return false;
+    }
+    
+    // Another process compacted the pack; the file still open here is
+    // the old one, which nobody reads any more
+    const quint32 generation = qFromLittleEndian<quint32>(header.constData() + PACK_GENERATION_OFFSET);
+    if (generation != m_generation || size < m_indexedSize) {
+        unmap();
+        m_file.close();
+        return openPack(locked);
+    }
+    
+    // Pick up records other processes appended
+    return size == m_indexedSize || scanRecords(locked);
+}
+
+bool PackedBackend::remap()
+{
+    unmap();
+    
+    qint64 size = m_file.size();
+    m_map = m_file.map(0, size);
+    if (!m_map) {
+        qWarning() << "Failed to map pack file:" << m_file.fileName();
+        return false;
+    }
+    
+    m_mappedSize = size;
+    return true;
+}
+
+void PackedBackend::unmap()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mappedSize = 0;
+    }
+}
+
+bool PackedBackend::appendRecord(quint8 type, const QString& key, const QByteArray& data, Slot *slot)
+{
+    const QByteArray keyBytes = key.toUtf8();
+    
+    QByteArray record(RECORD_HEADER_SIZE, '\0');
+    record.reserve(recordSize(keyBytes.size(), data.size()));
+    record += keyBytes;
+    record += data;
+    
+    char *header = record.data();
+    qToLittleEndian<quint32>(RECORD_MAGIC, header);
+    header[4] = static_cast<char>(type);
+    qToLittleEndian<quint16>(qChecksum(QByteArrayView(record).sliced(RECORD_HEADER_SIZE)), header + 6);
+    qToLittleEndian<quint32>(keyBytes.size(), header + 8);
+    qToLittleEndian<quint32>(data.size(), header + 12);
+    
+    const qint64 pos = m_file.size();
+    if (!m_file.seek(pos) || m_file.write(record) != record.size() || !m_file.flush()) {
+        qWarning() << "Failed to append to pack file:" << m_file.fileName();
+        m_file.resize(pos);
+        return false;
+    }
+    
+    m_indexedSize = pos + record.size();
+    slot->offset = pos;
+    slot->keyLength = keyBytes.size();
+    slot->dataLength = data.size();
+    return true;
+}
+
+QByteArray PackedBackend::recordData(const Slot& slot)
+{
+    const qint64 end = slot.offset + recordSize(slot.keyLength, slot.dataLength);
+    
+    // Records appended since the last mapping are not visible yet
+    if (end > m_mappedSize && !remap()) {
+        return QByteArray();
+    }
+    
+    const char *data = reinterpret_cast<const char *>(m_map + slot.offset + RECORD_HEADER_SIZE + slot.keyLength);
+    return QByteArray(data, slot.dataLength);
+}
+
+void PackedBackend::retireSlot(const QString& key)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        return;
+    }
+    
+    const qint64 size = recordSize(it->keyLength, it->dataLength);
+    m_liveBytes -= size;
+    m_deadBytes += size;
+    m_index.erase(it);
+}
+
+void PackedBackend::maybeCompact()
+{
+    if (m_deadBytes > COMPACT_MIN_DEAD_BYTES && m_deadBytes > m_liveBytes) {
+        compactLocked();
+    }
+}
+
+// Callers hold the pack lock
+bool PackedBackend::compactLocked()
+{
+    TraceSpan span("PackedBackend::compact", "io");
+    
+    if (!m_file.isOpen() || !remap()) {
+        return false;
+    }
+    
+    QSaveFile out(m_file.fileName());
+    if (!out.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to start pack compaction:" << m_file.fileName();
+        return false;
+    }
+    
+    // A new generation tells other processes to reload
+    QByteArray header(reinterpret_cast<const char *>(m_map), PACK_HEADER_SIZE);
+    qToLittleEndian<quint32>(m_generation + 1, header.data() + PACK_GENERATION_OFFSET);
+    if (out.write(header) != header.size()) {
+        out.cancelWriting();
+        return false;
+    }
+    
+    // Copy live records verbatim, grouped by key order
+    QStringList keys = m_index.keys();
+    sortKeysByName(keys);
+    
+    QHash<QString, Slot> compacted;
+    compacted.reserve(m_index.size());
+    qint64 pos = PACK_HEADER_SIZE;
+    
+    for (const QString& key : keys) {
+        const Slot slot = m_index.value(key);
+        const qint64 size = recordSize(slot.keyLength, slot.dataLength);
+        if (out.write(reinterpret_cast<const char *>(m_map + slot.offset), size) != size) {
+            qWarning() << "Failed to write compacted pack:" << m_file.fileName();
+            out.cancelWriting();
+            return false;
+        }
+        compacted.insert(key, Slot{ pos, slot.keyLength, slot.dataLength });
+        pos += size;
+    }
+    
+    // The old pack has to be released before it can be replaced
+    unmap();
+    m_file.close();
+    
+    bool committed = out.commit();
+    if (!committed) {
+        qWarning() << "Failed to replace pack file:" << m_file.fileName();
+    }
+    
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Failed to reopen pack file:" << m_file.fileName();
+        return false;
+    }
+    
+    if (!committed) {
+        return remap();
+    }
+    
+    m_index = compacted;
+    m_indexedSize = pos;
+    m_generation += 1;
+    m_liveBytes = pos - PACK_HEADER_SIZE;
+    m_deadBytes = 0;
+    return remap();
+}
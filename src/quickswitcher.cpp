@@ -0,0 +1,139 @@
+#include "quickswitcher.h"
+#include "backgroundscheduler.h"
+#include <QVBoxLayout>
+#include <QKeyEvent>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+// Rows shown for a query
+static const int MAX_RESULTS = 50;
+
+QuickSwitcher::QuickSwitcher(std::shared_ptr<const TitleIndex> index, const void *owner,
+                             QWidget *parent)
+    : QDialog(parent)
+    , m_index(std::move(index))
+    , m_owner(owner)
+    , m_queryEdit(nullptr)
+    , m_resultList(nullptr)
+    , m_statusLabel(nullptr)
+    , m_searchPending(false)
+{
+    setWindowTitle(tr("Go to Entry"));
+    resize(560, 420);
+    
+    m_queryEdit = new QLineEdit(this);
+    m_queryEdit->setPlaceholderText(tr("Type part of a title or file name"));
+    m_queryEdit->installEventFilter(this);
+    connect(m_queryEdit, &QLineEdit::textChanged, this, &QuickSwitcher::onQueryChanged);
+    connect(m_queryEdit, &QLineEdit::returnPressed, this, &QuickSwitcher::acceptCurrent);
+    
+    m_resultList = new QListWidget(this);
+    connect(m_resultList, &QListWidget::itemActivated, this, &QuickSwitcher::acceptCurrent);
+    
+    m_statusLabel = new QLabel(tr("%n entries", nullptr, m_index->size()), this);
+    
+    connect(&m_searchWatcher, &QFutureWatcherBase::finished, this, &QuickSwitcher::onSearchFinished);
+    
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_queryEdit);
+    layout->addWidget(m_resultList);
+    layout->addWidget(m_statusLabel);
+}
+
+bool QuickSwitcher::eventFilter(QObject *watched, QEvent *event)
+{
+    // Let the arrow keys move through the results while typing
+    if (watched == m_queryEdit && event->type() == QEvent::KeyPress) {
+        switch (static_cast<QKeyEvent *>(event)->key()) {
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+        case Qt::Key_PageUp:
+        case Qt::Key_PageDown:
+            QCoreApplication::sendEvent(m_resultList, event);
+            return true;
+        default:
+            break;
+        }
+    }
+    return QDialog::eventFilter(watched, event);
+}
+
+void QuickSwitcher::onQueryChanged(const QString& query)
+{
+    // One search at a time; only the newest text is searched next
+    if (!m_searchWatcher.isFinished()) {
+        m_pendingQuery = query;
+        m_searchPending = true;
+        return;
+    }
+    startSearch(query);
+}
+
+void QuickSwitcher::startSearch(const QString& query)
+{
+    // Anything matching the longer text also matched the shorter one
+    const QString folded = TitleIndex::foldQuery(query);
+    const bool narrow = !m_lastQuery.isEmpty() && folded.startsWith(m_lastQuery);
+    const QVector<int> within = narrow ? m_lastMatched : QVector<int>();
+    
+    std::shared_ptr<const TitleIndex> index = m_index;
+    m_searchWatcher.setFuture(BackgroundScheduler::instance().run(m_owner, [index, query, within, narrow]() {
+        QElapsedTimer timer;
+        timer.start();
+        
+        SearchResult result;
+        result.query = query;
+        result.matches = index->search(query, MAX_RESULTS, narrow ? &within : nullptr, &result.matched);
+        result.elapsedNs = timer.nsecsElapsed();
+        return result;
+    }));
+}
+
+void QuickSwitcher::onSearchFinished()
+{
+    if (m_searchWatcher.isCanceled()) {
+        return;
+    }
+    
+    const SearchResult result = m_searchWatcher.result();
+    m_lastQuery = TitleIndex::foldQuery(result.query);
+    m_lastMatched = result.matched;
+    
+    // The text changed while searching; skip straight to the newest
+    if (m_searchPending) {
+        m_searchPending = false;
+        startSearch(m_pendingQuery);
+        return;
+    }
+    
+    m_resultList->clear();
+    for (const TitleIndex::Match& match : result.matches) {
+        const QString path = m_index->path(match.entry);
+        QListWidgetItem *item = new QListWidgetItem(m_index->title(match.entry));
+        item->setData(Qt::UserRole, path);
+        item->setToolTip(QFileInfo(path).fileName());
+        m_resultList->addItem(item);
+    }
+    if (m_resultList->count() > 0) {
+        m_resultList->setCurrentRow(0);
+    }
+    
+    if (m_lastQuery.isEmpty()) {
+        m_statusLabel->setText(tr("%n entries", nullptr, m_index->size()));
+    } else {
+        m_statusLabel->setText(tr("%n matches in %1 ms", nullptr, int(result.matched.size()))
+                               .arg(QString::number(result.elapsedNs / 1e6, 'f', 2)));
+    }
+}
+
+void QuickSwitcher::acceptCurrent()
+{
+    QListWidgetItem *item = m_resultList->currentItem();
+    if (!item) {
+        return;
+    }
+    
+    m_selectedPath = item->data(Qt::UserRole).toString();
+    accept();
+}
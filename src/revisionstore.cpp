@@ -0,0 +1,252 @@
+#include "revisionstore.h"
+#include "tracer.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+
+// Content-defined chunking bounds; the boundary mask gives ~2 KiB chunks.
+// It tests the high bits: the shift ages each byte out of the hash after
+// 64 steps, so only the high bits depend on a full 64-byte window
+static const int MIN_CHUNK_SIZE = 512;
+static const int MAX_CHUNK_SIZE = 8192;
+static const quint64 CHUNK_BOUNDARY_MASK = ((1ULL << 11) - 1) << (64 - 11);
+
+static const int HASH_SIZE = 32;                          // SHA-256
+static const int LOG_RECORD_SIZE = 8 + HASH_SIZE + 8;     // time, manifest, size
+
+// Random table for the gear hash, generated from a fixed seed so chunk
+// boundaries are identical across runs and machines
+static const std::array<quint64, 256>& gearTable()
+{
+    static const std::array<quint64, 256> table = [] {
+        std::array<quint64, 256> values;
+        quint64 state = 0x6a726e6c67656172ULL;
+        for (quint64& value : values) {
+            // splitmix64
+            state += 0x9e3779b97f4a7c15ULL;
+            quint64 z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+        return values;
+    }();
+    return table;
+}
+
+RevisionStore::RevisionStore(const QString& directory)
+    : m_directory(directory)
+{
+}
+
+bool RevisionStore::recordRevision(const QString& entryId, const QByteArray& content)
+{
+    TraceSpan span("RevisionStore::recordRevision", "io");
+    
+    QMutexLocker locker(&m_mutex);
+    
+    // The manifest is the concatenation of the chunk hashes
+    QByteArray manifest;
+    const QList<QByteArray> chunks = splitChunks(content);
+    manifest.reserve(chunks.size() * HASH_SIZE);
+    for (const QByteArray& chunk : chunks) {
+        QByteArray hash = storeObject(chunk);
+        if (hash.isEmpty()) {
+            return false;
+        }
+        manifest += hash;
+    }
+    
+    QByteArray manifestHash = storeObject(manifest);
+    if (manifestHash.isEmpty()) {
+        return false;
+    }
+    
+    Revision latest;
+    if (latestRevision(entryId, &latest) && latest.manifest == manifestHash) {
+        return true;
+    }
+    
+    QFile log(logPath(entryId));
+    if (!QDir().mkpath(QFileInfo(log).absolutePath()) || !log.open(QIODevice::Append)) {
+        qWarning() << "Failed to open revision log:" << log.fileName();
+        return false;
+    }
+    
+    QByteArray record(LOG_RECORD_SIZE, '\0');
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), record.data());
+    std::copy(manifestHash.cbegin(), manifestHash.cend(), record.begin() + 8);
+    qToLittleEndian<qint64>(content.size(), record.data() + 8 + HASH_SIZE);
+    
+    return log.write(record) == record.size();
+}
+
+QList<RevisionStore::Revision> RevisionStore::revisions(const QString& entryId) const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<Revision> result;
+    
+    QFile log(logPath(entryId));
+    if (!log.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+    
+    const QByteArray data = log.readAll();
+    const int count = data.size() / LOG_RECORD_SIZE;
+    result.reserve(count);
+    
+    for (int i = 0; i < count; ++i) {
+        const char *record = data.constData() + i * LOG_RECORD_SIZE;
+        Revision revision;
+        revision.timestamp = QDateTime::fromMSecsSinceEpoch(qFromLittleEndian<qint64>(record));
+        revision.manifest = QByteArray(record + 8, HASH_SIZE);
+        revision.size = qFromLittleEndian<qint64>(record + 8 + HASH_SIZE);
+        result.append(revision);
+    }
+    
+    return result;
+}
+
+bool RevisionStore::readRevision(const Revision& revision, QByteArray *content) const
+{
+    QMutexLocker locker(&m_mutex);
+    
+    const QByteArray manifest = readObject(revision.manifest);
+    if (manifest.isNull() || manifest.size() % HASH_SIZE != 0) {
+        qWarning() << "Revision manifest is missing or damaged:" << revision.manifest.toHex();
+        return false;
+    }
+    
+    content->clear();
+    content->reserve(revision.size);
+    for (int pos = 0; pos < manifest.size(); pos += HASH_SIZE) {
+        const QByteArray chunk = readObject(manifest.mid(pos, HASH_SIZE));
+        if (chunk.isNull()) {
+            qWarning() << "Revision chunk is missing or damaged:" << manifest.mid(pos, HASH_SIZE).toHex();
+            content->clear();
+            return false;
+        }
+        *content += chunk;
+    }
+    
+    return true;
+}
+
+QString RevisionStore::objectPath(const QByteArray& hash) const
+{
+    // Fan out over 256 directories like git does
+    const QString hex = QString::fromLatin1(hash.toHex());
+    return m_directory + "/objects/" + hex.left(2) + "/" + hex.mid(2);
+}
+
+QString RevisionStore::logPath(const QString& entryId) const
+{
+    const QByteArray keyHash = QCryptographicHash::hash(entryId.toUtf8(), QCryptographicHash::Sha1);
+    return m_directory + "/logs/" + QString::fromLatin1(keyHash.toHex()) + ".log";
+}
+
+QByteArray RevisionStore::storeObject(const QByteArray& data)
+{
+    const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    const QString path = objectPath(hash);
+    
+    // Identical content is already stored
+    if (QFileInfo::exists(path)) {
+        return hash;
+    }
+    
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        qWarning() << "Failed to create object directory for:" << path;
+        return QByteArray();
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write revision object:" << path;
+        return QByteArray();
+    }
+    file.write(qCompress(data));
+    if (!file.commit()) {
+        qWarning() << "Failed to commit revision object:" << path;
+        return QByteArray();
+    }
+    
+    return hash;
+}
+
+QByteArray RevisionStore::readObject(const QByteArray& hash) const
+{
+    QFile file(objectPath(hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    
+    // qUncompress() yields a null array both on failure and for an empty
+    // object; the uncompressed length qCompress() puts first tells them
+    // apart
+    const QByteArray compressed = file.readAll();
+    const QByteArray data = qUncompress(compressed);
+    if (!data.isNull()) {
+        return data;
+    }
+    if (compressed.size() >= 4 && qFromBigEndian<quint32>(compressed.constData()) == 0) {
+        return QByteArray("");
+    }
+    qWarning() << "Revision object is damaged:" << file.fileName();
+    return QByteArray();
+}
+
+QList<QByteArray> RevisionStore::splitChunks(const QByteArray& content) const
+{
+    QList<QByteArray> chunks;
+    const std::array<quint64, 256>& gear = gearTable();
+    const uchar *data = reinterpret_cast<const uchar *>(content.constData());
+    const qsizetype size = content.size();
+    
+    qsizetype start = 0;
+    quint64 hash = 0;
+    for (qsizetype i = 0; i < size; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        const qsizetype length = i - start + 1;
+        
+        if ((length >= MIN_CHUNK_SIZE && (hash & CHUNK_BOUNDARY_MASK) == 0) ||
+            length >= MAX_CHUNK_SIZE) {
+            chunks.append(content.mid(start, length));
+            start = i + 1;
+            hash = 0;
+        }
+    }
+    
+    if (start < size || chunks.isEmpty()) {
+        chunks.append(content.mid(start));
+    }
+    
+    return chunks;
+}
+
+bool RevisionStore::latestRevision(const QString& entryId, Revision *revision) const
+{
+    QFile log(logPath(entryId));
+    if (!log.open(QIODevice::ReadOnly) || log.size() < LOG_RECORD_SIZE) {
+        return false;
+    }
+    
+    // Records are fixed-size, so the latest one is at a known offset
+    log.seek((log.size() / LOG_RECORD_SIZE - 1) * LOG_RECORD_SIZE);
+    const QByteArray record = log.read(LOG_RECORD_SIZE);
+    if (record.size() != LOG_RECORD_SIZE) {
+        return false;
+    }
+    
+    revision->timestamp = QDateTime::fromMSecsSinceEpoch(qFromLittleEndian<qint64>(record.constData()));
+    revision->manifest = record.mid(8, HASH_SIZE);
+    revision->size = qFromLittleEndian<qint64>(record.constData() + 8 + HASH_SIZE);
+    return true;
+}
@@ -0,0 +1,424 @@
+#include "similarityindex.h"
+#include "tracer.h"
+#include <QSet>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Hashed term vectors: 2^9 dimensions of one signed byte each
+static const int DIMENSION_BITS = 9;
+static const int DIMENSIONS = 1 << DIMENSION_BITS;
+
+// Locality-sensitive hashing: each table keys entries by which side of
+// BITS_PER_TABLE random hyperplanes they fall on
+static const int LSH_TABLES = 8;
+static const int BITS_PER_TABLE = 16;
+static const quint32 LSH_SEED = 0x6a726e6c;
+
+// Up to this many entries a full scan beats probing the tables
+static const int FULL_SCAN_LIMIT = 4096;
+
+// Weights are recomputed once the entry count drifts this far
+static const double REBUILD_DRIFT = 0.2;
+static const int REBUILD_MIN_CHANGE = 16;
+
+static const int MIN_TERM_LENGTH = 3;
+static const float TITLE_WEIGHT = 2.0f;
+static const float MIN_SIMILARITY = 0.05f;
+
+static bool isStopWord(const QString& word)
+{
+    static const QSet<QString> stopWords = {
+        "about", "after", "again", "all", "also", "and", "any", "are", "because", "been",
+        "before", "being", "but", "can", "could", "did", "does", "for", "from", "had",
+        "has", "have", "her", "here", "him", "his", "how", "into", "its", "just",
+        "more", "most", "not", "now", "off", "one", "only", "other", "our", "out",
+        "over", "she", "should", "some", "such", "than", "that", "the", "their", "them",
+        "then", "there", "these", "they", "this", "those", "too", "very", "was", "were",
+        "what", "when", "where", "which", "while", "who", "why", "will", "with", "would",
+        "you", "your"
+    };
+    return stopWords.contains(word);
+}
+
+SimilarityIndex::SimilarityIndex()
+    : m_documents(0)
+    , m_builtForDocuments(0)
+    , m_stale(false)
+    , m_buckets(LSH_TABLES)
+    , m_visitStamp(0)
+{
+    // Fixed seed: the same text always lands in the same buckets
+    QRandomGenerator random(LSH_SEED);
+    m_planes.resize(size_t(LSH_TABLES) * BITS_PER_TABLE * DIMENSIONS);
+    for (qint8& value : m_planes) {
+        value = random.bounded(2) ? 1 : -1;
+    }
+}
+
+int SimilarityIndex::dot(const qint8 *a, const qint8 *b)
+{
+#if defined(__SSE2__)
+    // Widen 16 bytes to two vectors of 16-bit lanes (unpacking a byte
+    // with itself and shifting right sign-extends it), then multiply and
+    // add adjacent pairs into 32-bit lanes
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < DIMENSIONS; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        const __m128i aLow = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        const __m128i aHigh = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+        const __m128i bLow = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+        const __m128i bHigh = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(aLow, bLow));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(aHigh, bHigh));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__ARM_NEON)
+    int32x4_t sum = vdupq_n_s32(0);
+    for (int i = 0; i < DIMENSIONS; i += 16) {
+        const int8x16_t va = vld1q_s8(a + i);
+        const int8x16_t vb = vld1q_s8(b + i);
+        sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        sum = vpadalq_s16(sum, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+    }
+    return vgetq_lane_s32(sum, 0) + vgetq_lane_s32(sum, 1)
+         + vgetq_lane_s32(sum, 2) + vgetq_lane_s32(sum, 3);
+#else
+    int sum = 0;
+    for (int i = 0; i < DIMENSIONS; ++i) {
+        sum += int(a[i]) * int(b[i]);
+    }
+    return sum;
+#endif
+}
+
+QVector<SimilarityIndex::Term> SimilarityIndex::extractTerms(const QString& title, const QString& content)
+{
+    QHash<quint32, float> counts;
+    QString word;
+    
+    auto addWords = [&](const QString& text, float weight) {
+        for (qsizetype i = 0; i <= text.size(); ++i) {
+            const QChar c = i < text.size() ? text[i] : QChar(' ');
+            if (c.isLetterOrNumber()) {
+                word.append(c.toLower());
+                continue;
+            }
+            
+            bool numeric = true;
+            for (QChar wordChar : std::as_const(word)) {
+                numeric = numeric && wordChar.isDigit();
+            }
+            if (word.size() >= MIN_TERM_LENGTH && !numeric && !isStopWord(word)) {
+                counts[qHash(word)] += weight;
+            }
+            word.clear();
+        }
+    };
+    addWords(title, TITLE_WEIGHT);
+    addWords(content, 1.0f);
+    
+    QVector<Term> terms;
+    terms.reserve(counts.size());
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        terms.append(Term{ it.key(), 1.0f + std::log(it.value()) });
+    }
+    return terms;
+}
+
+void SimilarityIndex::updateEntry(const QString& entryId, const QString& title, const QString& content)
+{
+    TraceSpan span("SimilarityIndex::updateEntry", "index");
+    
+    quint32 slot;
+    auto existing = m_slotIds.constFind(entryId);
+    if (existing != m_slotIds.constEnd()) {
+        slot = *existing;
+        removeBuckets(slot);
+        forgetTerms(slot);
+    } else {
+        slot = allocateSlot(entryId);
+    }
+    
+    m_slots[slot].terms = extractTerms(title, content);
+    for (const Term& term : std::as_const(m_slots[slot].terms)) {
+        ++m_documentFrequency[term.hash];
+    }
+    
+    computeVector(slot);
+    insertBuckets(slot);
+    noteDocumentCountChanged();
+}
+
+void SimilarityIndex::removeEntry(const QString& entryId)
+{
+    auto existing = m_slotIds.constFind(entryId);
+    if (existing == m_slotIds.constEnd()) {
+        return;
+    }
+    
+    const quint32 slot = *existing;
+    removeBuckets(slot);
+    forgetTerms(slot);
+    m_slots[slot] = Slot();
+    m_freeSlots.append(slot);
+    m_slotIds.remove(entryId);
+    
+    --m_documents;
+    noteDocumentCountChanged();
+}
+
+void SimilarityIndex::clear()
+{
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_slotIds.clear();
+    m_vectors.clear();
+    m_signatures.clear();
+    m_documentFrequency.clear();
+    m_documents = 0;
+    m_builtForDocuments = 0;
+    m_stale = false;
+    for (auto& table : m_buckets) {
+        table.clear();
+    }
+    m_visited.clear();
+}
+
+QList<SimilarityIndex::Match> SimilarityIndex::related(const QString& entryId, int count)
+{
+    TraceSpan span("SimilarityIndex::related", "index");
+    
+    auto found = m_slotIds.constFind(entryId);
+    if (found == m_slotIds.constEnd() || count <= 0) {
+        return QList<Match>();
+    }
+    if (m_stale) {
+        rebuild();
+    }
+    
+    const quint32 query = *found;
+    if (m_slots[query].scale == 0) {
+        return QList<Match>();
+    }
+    
+    // Candidates: entries sharing a bucket with the query, or a bucket
+    // one bit away, in any table
+    std::vector<quint32> candidates;
+    if (m_slotIds.size() > FULL_SCAN_LIMIT) {
+        m_visited.resize(m_slots.size(), 0);
+        if (++m_visitStamp == 0) {
+            std::fill(m_visited.begin(), m_visited.end(), 0);
+            m_visitStamp = 1;
+        }
+        m_visited[query] = m_visitStamp;
+        
+        for (int table = 0; table < LSH_TABLES; ++table) {
+            const quint16 key = m_signatures[size_t(query) * LSH_TABLES + table];
+            for (int flip = -1; flip < BITS_PER_TABLE; ++flip) {
+                const quint16 probe = flip < 0 ? key : quint16(key ^ (1u << flip));
+                auto bucket = m_buckets[table].constFind(probe);
+                if (bucket == m_buckets[table].constEnd()) {
+                    continue;
+                }
+                for (quint32 slot : *bucket) {
+                    if (m_visited[slot] != m_visitStamp) {
+                        m_visited[slot] = m_visitStamp;
+                        candidates.push_back(slot);
+                    }
+                }
+            }
+        }
+    }
+    
+    // Too few near neighbours to fill the list: score everything
+    if (int(candidates.size()) < count) {
+        candidates.clear();
+        for (quint32 slot = 0; slot < quint32(m_slots.size()); ++slot) {
+            if (m_slots[slot].bucketed && slot != query) {
+                candidates.push_back(slot);
+            }
+        }
+    }
+    
+    const qint8 *queryVector = vector(query);
+    const float queryScale = m_slots[query].scale;
+    std::vector<std::pair<float, quint32>> scored;
+    scored.reserve(candidates.size());
+    for (quint32 slot : candidates) {
+        const float score = float(dot(queryVector, vector(slot))) * queryScale * m_slots[slot].scale;
+        if (score >= MIN_SIMILARITY) {
+            scored.emplace_back(score, slot);
+        }
+    }
+    
+    const size_t shown = qMin(size_t(count), scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + shown, scored.end(),
+                      [](const std::pair<float, quint32>& a, const std::pair<float, quint32>& b) {
+        return a.first > b.first;
+    });
+    
+    QList<Match> matches;
+    matches.reserve(shown);
+    for (size_t i = 0; i < shown; ++i) {
+        matches.append(Match{ m_slots[scored[i].second].entryId, scored[i].first });
+    }
+    return matches;
+}
+
+quint32 SimilarityIndex::allocateSlot(const QString& entryId)
+{
+    quint32 slot;
+    if (!m_freeSlots.isEmpty()) {
+        slot = m_freeSlots.takeLast();
+    } else {
+        slot = quint32(m_slots.size());
+        m_slots.append(Slot());
+        m_vectors.resize(m_vectors.size() + DIMENSIONS);
+        m_signatures.resize(m_signatures.size() + LSH_TABLES);
+    }
+    
+    m_slots[slot].entryId = entryId;
+    m_slots[slot].used = true;
+    m_slotIds.insert(entryId, slot);
+    ++m_documents;
+    return slot;
+}
+
+void SimilarityIndex::forgetTerms(quint32 slot)
+{
+    for (const Term& term : std::as_const(m_slots[slot].terms)) {
+        auto frequency = m_documentFrequency.find(term.hash);
+        if (frequency != m_documentFrequency.end() && --*frequency <= 0) {
+            m_documentFrequency.erase(frequency);
+        }
+    }
+    m_slots[slot].terms.clear();
+}
+
+void SimilarityIndex::computeVector(quint32 slot)
+{
+    Slot& entry = m_slots[slot];
+    
+    // Feature hashing: the top bits pick the dimension, another bit the
+    // sign, so colliding terms cancel out on average instead of adding up
+    float dense[DIMENSIONS] = {};
+    const float documents = float(m_documents);
+    for (const Term& term : std::as_const(entry.terms)) {
+        const float idf = std::log((1.0f + documents) / (1.0f + m_documentFrequency.value(term.hash))) + 1.0f;
+        const quint32 mixed = term.hash * 0x9E3779B1u;
+        const int dimension = int(mixed >> (32 - DIMENSION_BITS));
+        dense[dimension] += (mixed & 0x10000) ? -term.weight * idf : term.weight * idf;
+    }
+    
+    float norm = 0;
+    float peak = 0;
+    for (float value : dense) {
+        norm += value * value;
+        peak = qMax(peak, std::fabs(value));
+    }
+    
+    qint8 *out = m_vectors.data() + size_t(slot) * DIMENSIONS;
+    if (peak == 0) {
+        std::memset(out, 0, DIMENSIONS);
+        entry.scale = 0;
+        return;
+    }
+    
+    // Largest component maps to 127; scale converts back to unit length
+    const float step = peak / 127.0f;
+    for (int i = 0; i < DIMENSIONS; ++i) {
+        out[i] = qint8(std::lround(dense[i] / step));
+    }
+    entry.scale = step / std::sqrt(norm);
+}
+
+quint16 SimilarityIndex::signature(quint32 slot, int table) const
+{
+    const qint8 *values = vector(slot);
+    const qint8 *planes = m_planes.data() + size_t(table) * BITS_PER_TABLE * DIMENSIONS;
+    
+    quint16 key = 0;
+    for (int bit = 0; bit < BITS_PER_TABLE; ++bit) {
+        if (dot(values, planes + bit * DIMENSIONS) >= 0) {
+            key |= quint16(1u << bit);
+        }
+    }
+    return key;
+}
+
+void SimilarityIndex::insertBuckets(quint32 slot)
+{
+    // Entries without any terms have no direction to compare
+    if (m_slots[slot].scale == 0) {
+        return;
+    }
+    
+    for (int table = 0; table < LSH_TABLES; ++table) {
+        const quint16 key = signature(slot, table);
+        m_signatures[size_t(slot) * LSH_TABLES + table] = key;
+        m_buckets[table][key].append(slot);
+    }
+    m_slots[slot].bucketed = true;
+}
+
+void SimilarityIndex::removeBuckets(quint32 slot)
+{
+    if (!m_slots[slot].bucketed) {
+        return;
+    }
+    
+    for (int table = 0; table < LSH_TABLES; ++table) {
+        const quint16 key = m_signatures[size_t(slot) * LSH_TABLES + table];
+        auto bucket = m_buckets[table].find(key);
+        if (bucket != m_buckets[table].end()) {
+            bucket->removeOne(slot);
+            if (bucket->isEmpty()) {
+                m_buckets[table].erase(bucket);
+            }
+        }
+    }
+    m_slots[slot].bucketed = false;
+}
+
+void SimilarityIndex::noteDocumentCountChanged()
+{
+    const int change = qAbs(m_documents - m_builtForDocuments);
+    if (change > qMax(REBUILD_MIN_CHANGE, int(m_builtForDocuments * REBUILD_DRIFT))) {
+        m_stale = true;
+    }
+}
+
+void SimilarityIndex::rebuild()
+{
+    TraceSpan span("SimilarityIndex::rebuild", "index");
+    
+    for (auto& table : m_buckets) {
+        table.clear();
+    }
+    for (quint32 slot = 0; slot < quint32(m_slots.size()); ++slot) {
+        m_slots[slot].bucketed = false;
+        if (m_slots[slot].used) {
+            computeVector(slot);
+            insertBuckets(slot);
+        }
+    }
+    
+    m_builtForDocuments = m_documents;
+    m_stale = false;
+}
+
+const qint8 *SimilarityIndex::vector(quint32 slot) const
+{
+    return m_vectors.data() + size_t(slot) * DIMENSIONS;
+}
@@ -0,0 +1,425 @@
+#include "spellchecker.h"
+#include "tracer.h"
+#include <QtConcurrent>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QLocale>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+// Pause in typing before changed blocks are checked
+static const int CHECK_DELAY_MS = 300;
+
+// Blocks per worker run; a long document is checked in several runs so
+// the first results show up quickly
+static const int MAX_BLOCKS_PER_CHECK = 2000;
+
+static const QChar TYPOGRAPHIC_APOSTROPHE(0x2019);
+
+static QString findWordList()
+{
+    QStringList candidates;
+    const QString configured = qEnvironmentVariable("JRNL_DICTIONARY");
+    if (!configured.isEmpty()) {
+        candidates << configured;
+    }
+    
+    // Full word lists accept every inflection; Hunspell lists only hold
+    // stems, since their affix rules are not applied here
+    const QString locale = QLocale::system().name();
+    candidates << QStringLiteral("/usr/share/dict/words")
+               << QString("/usr/share/hunspell/%1.dic").arg(locale)
+               << QString("/usr/share/myspell/%1.dic").arg(locale);
+    
+    for (const QString& candidate : candidates) {
+        if (QFileInfo::exists(candidate)) {
+            return candidate;
+        }
+    }
+    return QString();
+}
+
+static QStringList readWordList(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to read word list:" << path;
+        return QStringList();
+    }
+    
+    QStringList words;
+    QTextStream in(&file);
+    bool firstLine = true;
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        
+        // Hunspell lists start with a word count and tag words with flags
+        if (firstLine) {
+            firstLine = false;
+            bool isCount = false;
+            line.toInt(&isCount);
+            if (isCount) {
+                continue;
+            }
+        }
+        const qsizetype flags = line.indexOf('/');
+        if (flags > 0) {
+            line.truncate(flags);
+        }
+        
+        if (!line.isEmpty()) {
+            words << line.replace(TYPOGRAPHIC_APOSTROPHE, '\'');
+        }
+    }
+    return words;
+}
+
+SpellBlockData::SpellBlockData(SpellChecker *checker, quint64 blockId)
+    : id(blockId)
+    , checkedHash(0)
+    , checked(false)
+    , queued(false)
+    , m_checker(checker)
+{
+}
+
+SpellBlockData::~SpellBlockData()
+{
+    if (m_checker) {
+        m_checker->forgetBlock(id);
+    }
+}
+
+SpellChecker::SpellChecker(QObject *parent)
+    : QObject(parent)
+    , m_enabled(true)
+    , m_nextBlockId(1)
+{
+    m_checkTimer.setSingleShot(true);
+    m_checkTimer.setInterval(CHECK_DELAY_MS);
+    connect(&m_checkTimer, &QTimer::timeout, this, &SpellChecker::startCheck);
+    connect(&m_checkWatcher, &QFutureWatcherBase::finished, this, &SpellChecker::onCheckFinished);
+    connect(&m_loadWatcher, &QFutureWatcherBase::finished, this, &SpellChecker::onDictionaryLoaded);
+    
+    QFile personal(personalDictionaryPath());
+    if (personal.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&personal);
+        while (!in.atEnd()) {
+            const QString word = in.readLine().trimmed();
+            if (!word.isEmpty()) {
+                m_personal.insert(word);
+            }
+        }
+    }
+    
+    // The dictionary may need compiling on first use, so it never loads
+    // on the UI thread; blocks are queued once it is ready
+    m_loadWatcher.setFuture(QtConcurrent::run(&SpellChecker::loadDictionary));
+}
+
+QString SpellChecker::personalDictionaryPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+        + "/spell/personal.txt";
+}
+
+std::shared_ptr<const SpellDictionary> SpellChecker::loadDictionary()
+{
+    TraceSpan span("SpellChecker::loadDictionary", "spell");
+    
+    const QString source = findWordList();
+    if (source.isEmpty()) {
+        return nullptr;
+    }
+    
+    // Compiled once per word list and reused until the list changes
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/spell";
+    const QString compiled = cacheDir + "/"
+        + QCryptographicHash::hash(source.toUtf8(), QCryptographicHash::Sha1).toHex().left(16)
+        + ".dawg";
+    
+    auto dictionary = std::make_shared<SpellDictionary>();
+    const QFileInfo compiledInfo(compiled);
+    if (compiledInfo.exists() && compiledInfo.lastModified() >= QFileInfo(source).lastModified()
+        && dictionary->open(compiled)) {
+        return dictionary;
+    }
+    
+    if (!QDir().mkpath(cacheDir) || !SpellDictionary::compile(readWordList(source), compiled)
+        || !dictionary->open(compiled)) {
+        qWarning() << "Spell checking is unavailable, failed to compile:" << source;
+        return nullptr;
+    }
+    return dictionary;
+}
+
+void SpellChecker::onDictionaryLoaded()
+{
+    m_dictionary = m_loadWatcher.result();
+    emit dictionaryReady(m_dictionary != nullptr);
+    
+    if (m_dictionary && m_enabled) {
+        refreshAll();
+    }
+}
+
+void SpellChecker::setEnabled(bool enabled)
+{
+    if (enabled == m_enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    
+    if (!enabled) {
+        m_checkTimer.stop();
+        m_queue.clear();
+        for (SpellBlockData *data : std::as_const(m_blocks)) {
+            data->queued = false;
+        }
+    }
+    refreshAll();
+}
+
+void SpellChecker::refreshAll()
+{
+    if (m_highlighter) {
+        m_highlighter->rehighlight();
+    }
+}
+
+QList<SpellChecker::Range> SpellChecker::misspellings(const QTextBlock& block, const QString& text)
+{
+    if (!m_enabled) {
+        return QList<Range>();
+    }
+    
+    auto *data = dynamic_cast<SpellBlockData *>(block.userData());
+    if (!data) {
+        data = new SpellBlockData(this, m_nextBlockId++);
+        QTextBlock(block).setUserData(data);
+        m_blocks.insert(data->id, data);
+    }
+    data->block = block;
+    
+    const size_t hash = qHash(text);
+    if (m_dictionary && !data->queued && (!data->checked || data->checkedHash != hash)) {
+        data->queued = true;
+        m_queue.append(data->id);
+        m_checkTimer.start();
+    }
+    
+    // Until the new text is checked, words that are still in place keep
+    // their underline; anything that moved is dropped
+    QList<Range> ranges;
+    for (const SpellBlockData::Misspelling& misspelling : std::as_const(data->misspellings)) {
+        if (QStringView(text).mid(misspelling.start, misspelling.word.size()) == misspelling.word) {
+            ranges.append(Range{ misspelling.start, int(misspelling.word.size()) });
+        }
+    }
+    return ranges;
+}
+
+QString SpellChecker::misspelledWordAt(const QTextCursor& cursor) const
+{
+    const QTextBlock block = cursor.block();
+    const auto *data = dynamic_cast<const SpellBlockData *>(block.userData());
+    if (!m_enabled || !data) {
+        return QString();
+    }
+    
+    const int position = cursor.positionInBlock();
+    const QString text = block.text();
+    for (const SpellBlockData::Misspelling& misspelling : data->misspellings) {
+        if (position >= misspelling.start && position <= misspelling.start + misspelling.word.size()
+            && QStringView(text).mid(misspelling.start, misspelling.word.size()) == misspelling.word) {
+            return misspelling.word;
+        }
+    }
+    return QString();
+}
+
+void SpellChecker::addToDictionary(const QString& word)
+{
+    if (word.isEmpty() || m_personal.contains(word)) {
+        return;
+    }
+    m_personal.insert(word);
+    
+    const QString path = personalDictionaryPath();
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if (!file.open(QIODevice::Append | QIODevice::Text) || file.write((word + '\n').toUtf8()) < 0) {
+        qWarning() << "Failed to save personal dictionary:" << path;
+    }
+    
+    // Only blocks that flagged the word need drawing again
+    for (SpellBlockData *data : std::as_const(m_blocks)) {
+        const qsizetype removed = data->misspellings.removeIf(
+            [&word](const SpellBlockData::Misspelling& misspelling) { return misspelling.word == word; });
+        if (removed > 0 && m_highlighter) {
+            m_highlighter->rehighlightBlock(data->block);
+        }
+    }
+}
+
+void SpellChecker::forgetBlock(quint64 id)
+{
+    m_blocks.remove(id);
+}
+
+void SpellChecker::startCheck()
+{
+    // One run at a time; the next starts when this one reports back
+    if (!m_checkWatcher.isFinished() || !m_dictionary) {
+        return;
+    }
+    
+    QList<Job> jobs;
+    const int count = int(qMin<qsizetype>(m_queue.size(), MAX_BLOCKS_PER_CHECK));
+    for (int i = 0; i < count; ++i) {
+        SpellBlockData *data = m_blocks.value(m_queue[i]);
+        if (!data) {
+            continue;
+        }
+        data->queued = false;
+        jobs.append(Job{ data->id, data->block.text() });
+    }
+    m_queue.remove(0, count);
+    
+    if (!jobs.isEmpty()) {
+        m_checkWatcher.setFuture(QtConcurrent::run(&SpellChecker::check, jobs, m_dictionary, m_personal));
+    }
+}
+
+void SpellChecker::onCheckFinished()
+{
+    TraceSpan span("SpellChecker::applyResults", "spell");
+    
+    QList<Result> results = m_checkWatcher.result();
+    for (Result& result : results) {
+        // Blocks deleted or edited since were queued again by the edit
+        SpellBlockData *data = m_blocks.value(result.id);
+        if (!data || data->block.text() != result.text) {
+            continue;
+        }
+        
+        // Words added to the dictionary while this run was in flight
+        result.misspellings.removeIf([this](const SpellBlockData::Misspelling& misspelling) {
+            return m_personal.contains(misspelling.word);
+        });
+        
+        bool changed = result.misspellings.size() != data->misspellings.size();
+        for (qsizetype i = 0; !changed && i < result.misspellings.size(); ++i) {
+            changed = result.misspellings[i].start != data->misspellings[i].start
+                   || result.misspellings[i].word != data->misspellings[i].word;
+        }
+        
+        data->checked = true;
+        data->checkedHash = qHash(result.text);
+        data->misspellings = result.misspellings;
+        
+        // Refresh just this block; the rest of the document keeps its formats
+        if (changed && m_enabled && m_highlighter) {
+            m_highlighter->rehighlightBlock(data->block);
+        }
+    }
+    
+    if (!m_queue.isEmpty()) {
+        startCheck();
+    }
+}
+
+QList<SpellChecker::Result> SpellChecker::check(const QList<Job>& jobs,
+                                                std::shared_ptr<const SpellDictionary> dictionary,
+                                                const QSet<QString>& personal)
+{
+    TraceSpan span("SpellChecker::check", "spell");
+    
+    // Never checked: inline code, link targets, wiki links, autolinks and
+    // HTML tags, bare URLs, e-mail addresses and #tags
+    const QRegularExpression skipPattern(
+        "(`+).*?\\1"
+        "|\\]\\([^)]*\\)"
+        "|\\[\\[[^\\[\\]]*\\]\\]"
+        "|<[^<>\\s][^<>]*>"
+        "|\\b(?:[a-zA-Z][a-zA-Z0-9+.-]*://|www\\.)\\S+"
+        "|[\\w.+-]+@[\\w-]+\\.[\\w.-]+"
+        "|(?:^|(?<=\\s))#[\\p{L}\\p{N}_/-]+");
+    const QRegularExpression wordPattern("[\\p{L}\\p{M}\\p{N}_]+(?:['\\x{2019}][\\p{L}\\p{M}]+)*");
+    
+    QList<Result> results;
+    results.reserve(jobs.size());
+    for (const Job& job : jobs) {
+        Result result{ job.id, job.text, {} };
+        
+        QList<Range> skipped;
+        QRegularExpressionMatchIterator skips = skipPattern.globalMatch(job.text);
+        while (skips.hasNext()) {
+            const QRegularExpressionMatch match = skips.next();
+            skipped.append(Range{ int(match.capturedStart()), int(match.capturedLength()) });
+        }
+        
+        int nextSkip = 0;
+        QRegularExpressionMatchIterator words = wordPattern.globalMatch(job.text);
+        while (words.hasNext()) {
+            const QRegularExpressionMatch match = words.next();
+            const int start = int(match.capturedStart());
+            const int end = start + int(match.capturedLength());
+            
+            while (nextSkip < skipped.size()
+                   && skipped[nextSkip].start + skipped[nextSkip].length <= start) {
+                ++nextSkip;
+            }
+            if (nextSkip < skipped.size() && skipped[nextSkip].start < end) {
+                continue;
+            }
+            
+            // Numbers, identifiers and acronyms are not words to check
+            const QString word = match.captured();
+            bool hasDigit = false;
+            for (QChar c : word) {
+                hasDigit = hasDigit || c.isDigit() || c == '_';
+            }
+            if (hasDigit || (word.size() > 1 && word == word.toUpper())) {
+                continue;
+            }
+            
+            if (!isCorrect(word, *dictionary, personal)) {
+                result.misspellings.append(SpellBlockData::Misspelling{ start, word });
+            }
+        }
+        
+        results.append(result);
+    }
+    return results;
+}
+
+bool SpellChecker::isCorrect(const QString& word, const SpellDictionary& dictionary,
+                             const QSet<QString>& personal)
+{
+    if (personal.contains(word)) {
+        return true;
+    }
+    
+    QString plain = word;
+    plain.replace(TYPOGRAPHIC_APOSTROPHE, '\'');
+    if (dictionary.contains(plain)) {
+        return true;
+    }
+    
+    // Capitalised at the start of a sentence
+    const QString lower = plain.toLower();
+    if (lower != plain && (dictionary.contains(lower) || personal.contains(lower))) {
+        return true;
+    }
+    
+    // Possessives of known words, for lists without them
+    if (plain.endsWith(QLatin1String("'s"))) {
+        return isCorrect(plain.chopped(2), dictionary, personal);
+    }
+    return false;
+}
@@ -0,0 +1,313 @@
+#include "spelldictionary.h"
+#include "tracer.h"
+#include <QSaveFile>
+#include <QSet>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// File layout: 32-byte header, the alphabet as little-endian UTF-16 code
+// units padded to four bytes, then the edges as little-endian 32-bit words
+static const char DAWG_MAGIC[8] = { 'J', 'R', 'N', 'L', 'D', 'A', 'W', 'G' };
+static const quint32 DAWG_VERSION = 1;
+static const qint64 DAWG_HEADER_SIZE = 32;
+
+// Each edge holds the index of the child's first edge (0 when the child
+// has none), an end-of-word flag, a last-edge-of-node flag and its label
+// as an index into the alphabet
+static const quint32 EDGE_TARGET_MASK = (1u << 22) - 1;
+static const quint32 EDGE_TERMINAL = 1u << 22;
+static const quint32 EDGE_LAST = 1u << 23;
+static const int EDGE_LABEL_SHIFT = 24;
+static const int MAX_ALPHABET = 256;
+
+namespace {
+
+struct BuildNode {
+    std::vector<std::pair<quint8, int>> edges;   // Label, child node
+    bool final = false;
+};
+
+QByteArray nodeSignature(const BuildNode& node)
+{
+    QByteArray key;
+    key.reserve(1 + int(node.edges.size()) * 5);
+    key.append(char(node.final));
+    for (const auto& edge : node.edges) {
+        key.append(char(edge.first));
+        key.append(reinterpret_cast<const char *>(&edge.second), sizeof(edge.second));
+    }
+    return key;
+}
+
+}
+
+SpellDictionary::SpellDictionary()
+    : m_map(nullptr)
+    , m_edges(nullptr)
+    , m_edgeCount(0)
+    , m_root(0)
+    , m_wordCount(0)
+{
+    std::fill(std::begin(m_latin1Labels), std::end(m_latin1Labels), qint16(-1));
+}
+
+SpellDictionary::~SpellDictionary()
+{
+    close();
+}
+
+bool SpellDictionary::compile(QStringList words, const QString& path)
+{
+    TraceSpan span("SpellDictionary::compile", "spell");
+    
+    words.removeAll(QString());
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    
+    // Alphabet in code unit order, so every node's edges come out sorted
+    QSet<char16_t> seen;
+    for (const QString& word : words) {
+        for (QChar c : word) {
+            seen.insert(c.unicode());
+        }
+    }
+    if (seen.size() > MAX_ALPHABET) {
+        qWarning() << "Word list uses too many distinct characters:" << seen.size();
+        return false;
+    }
+    QList<char16_t> alphabet(seen.begin(), seen.end());
+    std::sort(alphabet.begin(), alphabet.end());
+    QHash<char16_t, quint8> labels;
+    for (int i = 0; i < alphabet.size(); ++i) {
+        labels.insert(alphabet[i], quint8(i));
+    }
+    
+    // Daciuk's incremental construction: with sorted input, once a word
+    // leaves the previous word's path that tail can never grow again, so
+    // it is replaced by an equal subtree already registered, if any.
+    // Replaced nodes are recycled, keeping memory close to the final size.
+    std::vector<BuildNode> nodes(1);
+    std::vector<int> freeNodes;
+    std::vector<int> path{ 0 };
+    QHash<QByteArray, int> registry;
+    
+    auto minimize = [&](int depth) {
+        while (int(path.size()) - 1 > depth) {
+            const int child = path.back();
+            path.pop_back();
+            
+            const QByteArray key = nodeSignature(nodes[child]);
+            auto existing = registry.constFind(key);
+            if (existing != registry.constEnd()) {
+                nodes[path.back()].edges.back().second = *existing;
+                nodes[child] = BuildNode();
+                freeNodes.push_back(child);
+            } else {
+                registry.insert(key, child);
+            }
+        }
+    };
+    
+    QString previous;
+    for (const QString& word : std::as_const(words)) {
+        int common = 0;
+        const int limit = int(qMin(word.size(), previous.size()));
+        while (common < limit && word[common] == previous[common]) {
+            ++common;
+        }
+        minimize(common);
+        
+        for (int i = common; i < word.size(); ++i) {
+            int child;
+            if (freeNodes.empty()) {
+                child = int(nodes.size());
+                nodes.emplace_back();
+            } else {
+                child = freeNodes.back();
+                freeNodes.pop_back();
+            }
+            nodes[path.back()].edges.emplace_back(labels.value(word[i].unicode()), child);
+            path.push_back(child);
+        }
+        nodes[path.back()].final = true;
+        previous = word;
+    }
+    minimize(0);
+    
+    // Lay nodes out breadth-first; edge 0 is reserved so that a zero
+    // target can mean "no children", and childless nodes take no space
+    std::vector<quint32> firstEdge(nodes.size(), 0);
+    std::vector<bool> placed(nodes.size(), false);
+    std::vector<int> order;
+    quint32 edgeCount = 1;
+    if (!nodes[0].edges.empty()) {
+        order.push_back(0);
+        placed[0] = true;
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        const BuildNode& node = nodes[order[i]];
+        firstEdge[order[i]] = edgeCount;
+        edgeCount += quint32(node.edges.size());
+        for (const auto& edge : node.edges) {
+            if (!placed[edge.second] && !nodes[edge.second].edges.empty()) {
+                placed[edge.second] = true;
+                order.push_back(edge.second);
+            }
+        }
+    }
+    if (edgeCount > EDGE_TARGET_MASK) {
+        qWarning() << "Word list is too large for a dictionary:" << words.size() << "words";
+        return false;
+    }
+    
+    const qint64 alphabetBytes = (alphabet.size() * 2 + 3) & ~qint64(3);
+    QByteArray data(DAWG_HEADER_SIZE + alphabetBytes + qint64(edgeCount) * 4, '\0');
+    char *out = data.data();
+    
+    std::memcpy(out, DAWG_MAGIC, sizeof(DAWG_MAGIC));
+    qToLittleEndian<quint32>(DAWG_VERSION, out + 8);
+    qToLittleEndian<quint32>(quint32(words.size()), out + 12);
+    qToLittleEndian<quint32>(quint32(alphabet.size()), out + 16);
+    qToLittleEndian<quint32>(edgeCount, out + 20);
+    qToLittleEndian<quint32>(order.empty() ? 0 : firstEdge[0], out + 24);
+    
+    for (int i = 0; i < alphabet.size(); ++i) {
+        qToLittleEndian<quint16>(alphabet[i], out + DAWG_HEADER_SIZE + i * 2);
+    }
+    
+    char *edges = out + DAWG_HEADER_SIZE + alphabetBytes;
+    quint32 index = 1;
+    for (int nodeIndex : order) {
+        const BuildNode& node = nodes[nodeIndex];
+        for (size_t i = 0; i < node.edges.size(); ++i) {
+            const BuildNode& child = nodes[node.edges[i].second];
+            quint32 edge = firstEdge[node.edges[i].second]
+                         | (quint32(node.edges[i].first) << EDGE_LABEL_SHIFT);
+            if (child.final) {
+                edge |= EDGE_TERMINAL;
+            }
+            if (i + 1 == node.edges.size()) {
+                edge |= EDGE_LAST;
+            }
+            qToLittleEndian<quint32>(edge, edges + 4 * index++);
+        }
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to write dictionary:" << path;
+        return false;
+    }
+    return true;
+}
+
+bool SpellDictionary::open(const QString& path)
+{
+    close();
+    
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    const qint64 size = m_file.size();
+    m_map = size >= DAWG_HEADER_SIZE ? m_file.map(0, size) : nullptr;
+    if (!m_map) {
+        qWarning() << "Failed to map dictionary:" << path;
+        close();
+        return false;
+    }
+    
+    const quint32 alphabetSize = qFromLittleEndian<quint32>(m_map + 16);
+    const quint32 edgeCount = qFromLittleEndian<quint32>(m_map + 20);
+    const quint32 root = qFromLittleEndian<quint32>(m_map + 24);
+    const qint64 alphabetBytes = (qint64(alphabetSize) * 2 + 3) & ~qint64(3);
+    if (std::memcmp(m_map, DAWG_MAGIC, sizeof(DAWG_MAGIC)) != 0
+        || qFromLittleEndian<quint32>(m_map + 8) != DAWG_VERSION
+        || alphabetSize > quint32(MAX_ALPHABET) || edgeCount == 0 || root >= edgeCount
+        || DAWG_HEADER_SIZE + alphabetBytes + qint64(edgeCount) * 4 != size) {
+        qWarning() << "Dictionary is damaged or from another version:" << path;
+        close();
+        return false;
+    }
+    
+    for (quint32 i = 0; i < alphabetSize; ++i) {
+        const char16_t c = qFromLittleEndian<quint16>(m_map + DAWG_HEADER_SIZE + i * 2);
+        if (c < 256) {
+            m_latin1Labels[c] = qint16(i);
+        } else {
+            m_otherLabels.insert(c, quint8(i));
+        }
+    }
+    
+    m_wordCount = qFromLittleEndian<quint32>(m_map + 12);
+    m_edgeCount = edgeCount;
+    m_root = root;
+    m_edges = m_map + DAWG_HEADER_SIZE + alphabetBytes;
+    return true;
+}
+
+void SpellDictionary::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_file.close();
+    
+    m_edges = nullptr;
+    m_edgeCount = 0;
+    m_root = 0;
+    m_wordCount = 0;
+    std::fill(std::begin(m_latin1Labels), std::end(m_latin1Labels), qint16(-1));
+    m_otherLabels.clear();
+}
+
+int SpellDictionary::labelOf(char16_t c) const
+{
+    if (c < 256) {
+        return m_latin1Labels[c];
+    }
+    auto label = m_otherLabels.constFind(c);
+    return label != m_otherLabels.constEnd() ? *label : -1;
+}
+
+bool SpellDictionary::contains(QStringView word) const
+{
+    if (!m_edges || word.isEmpty()) {
+        return false;
+    }
+    
+    quint32 node = m_root;
+    for (qsizetype i = 0; i < word.size(); ++i) {
+        const int label = labelOf(word[i].unicode());
+        if (label < 0 || node == 0) {
+            return false;
+        }
+        
+        // Edges of a node are sorted by label
+        quint32 edge = 0;
+        for (quint32 index = node; ; ++index) {
+            if (index >= m_edgeCount) {
+                return false;
+            }
+            edge = qFromLittleEndian<quint32>(m_edges + 4 * index);
+            const int edgeLabel = int(edge >> EDGE_LABEL_SHIFT);
+            if (edgeLabel == label) {
+                break;
+            }
+            if (edgeLabel > label || (edge & EDGE_LAST)) {
+                return false;
+            }
+        }
+        
+        if (i + 1 == word.size()) {
+            return edge & EDGE_TERMINAL;
+        }
+        node = edge & EDGE_TARGET_MASK;
+    }
+    return false;
+}
@@ -0,0 +1,9 @@
+#include "storagebackend.h"
+#include <algorithm>
+
+void StorageBackend::sortKeysByName(QStringList& keys)
+{
+    std::sort(keys.begin(), keys.end(), [](const QString& a, const QString& b) {
+        return QStringView(a).mid(a.lastIndexOf('/') + 1) < QStringView(b).mid(b.lastIndexOf('/') + 1);
+    });
+}
@@ -0,0 +1,89 @@
+#include "timelineindex.h"
+#include <algorithm>
+#include <limits>
+
+TimelineIndex::TimelineIndex()
+    : m_sorted(true)
+{
+}
+
+void TimelineIndex::insert(const QString& entryId, const QDateTime& dateTime)
+{
+    // Entries without a usable date sort before everything else
+    const QDateTime createdAt = dateTime.isValid() ? dateTime : QDateTime::fromMSecsSinceEpoch(0);
+    
+    auto existing = m_createdAt.constFind(entryId);
+    if (existing != m_createdAt.constEnd()) {
+        if (*existing == createdAt) {
+            return;
+        }
+        remove(entryId);
+    }
+    
+    Item item{ createdAt.toMSecsSinceEpoch(), entryId };
+    if (!m_items.empty() && item < m_items.back()) {
+        m_sorted = false;
+    }
+    m_items.push_back(item);
+    m_createdAt.insert(entryId, createdAt);
+    ++m_dayCounts[createdAt.date().toJulianDay()];
+}
+
+void TimelineIndex::remove(const QString& entryId)
+{
+    auto existing = m_createdAt.find(entryId);
+    if (existing == m_createdAt.end()) {
+        return;
+    }
+    
+    const QDateTime createdAt = *existing;
+    Item item{ createdAt.toMSecsSinceEpoch(), entryId };
+    auto it = m_sorted
+        ? std::lower_bound(m_items.begin(), m_items.end(), item)
+        : std::find_if(m_items.begin(), m_items.end(),
+                       [&entryId](const Item& other) { return other.entryId == entryId; });
+    if (it != m_items.end() && it->entryId == entryId) {
+        m_items.erase(it);
+    }
+    
+    const qint64 day = createdAt.date().toJulianDay();
+    if (--m_dayCounts[day] <= 0) {
+        m_dayCounts.remove(day);
+    }
+    m_createdAt.erase(existing);
+}
+
+void TimelineIndex::clear()
+{
+    m_items.clear();
+    m_sorted = true;
+    m_createdAt.clear();
+    m_dayCounts.clear();
+}
+
+QStringList TimelineIndex::range(const QDateTime& from, const QDateTime& to) const
+{
+    const qint64 fromTime = from.isValid() ? from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    const qint64 toTime = to.isValid() ? to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    
+    ensureSorted();
+    auto first = std::lower_bound(m_items.begin(), m_items.end(), fromTime,
+                                  [](const Item& item, qint64 time) { return item.time < time; });
+    auto last = std::upper_bound(first, m_items.end(), toTime,
+                                 [](qint64 time, const Item& item) { return time < item.time; });
+    
+    QStringList result;
+    result.reserve(int(last - first));
+    for (auto it = first; it != last; ++it) {
+        result.append(it->entryId);
+    }
+    return result;
+}
+
+void TimelineIndex::ensureSorted() const
+{
+    if (!m_sorted) {
+        std::sort(m_items.begin(), m_items.end());
+        m_sorted = true;
+    }
+}
@@ -0,0 +1,263 @@
+#include "titleindex.h"
+#include "tracer.h"
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <algorithm>
+
+// Scoring weights: every matched character earns SCORE_MATCH, adjusted
+// for where it sits relative to the previous match and to word starts
+static const int SCORE_MATCH = 16;
+static const int BONUS_WORD_START = 10;
+static const int BONUS_TEXT_START = 8;
+static const int BONUS_CONSECUTIVE = 6;
+static const int PENALTY_GAP = 1;
+static const int MAX_GAP_PENALTY = 12;
+
+// Matches only in the file name rank below equal matches in the title
+static const int PENALTY_FILE_NAME = 4;
+
+// Candidates per parallel scoring chunk; smaller sets are scored inline
+static const int CHUNK_SIZE = 16384;
+
+static inline const char16_t *utf16(const QString& text)
+{
+    return reinterpret_cast<const char16_t *>(text.constData());
+}
+
+static inline bool isSeparator(char16_t c)
+{
+    return c == ' ' || c == '-' || c == '_' || c == '.' || c == '/'
+        || c == '(' || c == '[' || c == '#' || c == '\'';
+}
+
+TitleIndex::TitleIndex(const QHash<QString, QString>& titles)
+{
+    TraceSpan span("TitleIndex::build", "index");
+    
+    m_paths.reserve(titles.size());
+    m_titles.reserve(titles.size());
+    m_titleSpans.reserve(titles.size());
+    m_nameSpans.reserve(titles.size());
+    m_masks.reserve(titles.size());
+    
+    auto append = [](std::vector<char16_t>& arena, const QString& text) {
+        const QString folded = text.toLower();
+        Span span{ quint32(arena.size()), quint32(folded.size()) };
+        arena.insert(arena.end(), utf16(folded), utf16(folded) + folded.size());
+        return span;
+    };
+    
+    for (auto it = titles.constBegin(); it != titles.constEnd(); ++it) {
+        Span titleSpan = append(m_titleArena, it.value());
+        Span nameSpan = append(m_nameArena, QFileInfo(it.key()).fileName());
+        
+        m_paths << it.key();
+        m_titles << it.value();
+        m_titleSpans.push_back(titleSpan);
+        m_nameSpans.push_back(nameSpan);
+        m_masks.push_back(charMask(m_titleArena.data() + titleSpan.offset, int(titleSpan.length))
+                          | charMask(m_nameArena.data() + nameSpan.offset, int(nameSpan.length)));
+    }
+}
+
+QString TitleIndex::foldQuery(const QString& query)
+{
+    QString folded = query.toLower();
+    folded.remove(' ');
+    return folded;
+}
+
+quint64 TitleIndex::charMask(const char16_t *text, int length)
+{
+    // One bit per letter and digit, everything else shares the rest
+    quint64 mask = 0;
+    for (int i = 0; i < length; ++i) {
+        char16_t c = text[i];
+        int bit;
+        if (c >= 'a' && c <= 'z') {
+            bit = c - 'a';
+        } else if (c >= '0' && c <= '9') {
+            bit = 26 + (c - '0');
+        } else {
+            bit = 36 + c % 28;
+        }
+        mask |= quint64(1) << bit;
+    }
+    return mask;
+}
+
+int TitleIndex::score(const char16_t *query, int queryLength,
+                      const std::vector<char16_t>& arena, const Span& span)
+{
+    const char16_t *text = arena.data() + span.offset;
+    const int length = int(span.length);
+    if (length < queryLength) {
+        return -1;
+    }
+    
+    // Leftmost point where the whole query has been seen in order
+    int matched = 0;
+    int end = -1;
+    for (int i = 0; i < length; ++i) {
+        if (text[i] == query[matched] && ++matched == queryLength) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) {
+        return -1;
+    }
+    
+    // Walk back from there for the tightest window holding the match
+    int start = end;
+    matched = queryLength - 1;
+    for (int i = end; i >= 0; --i) {
+        if (text[i] == query[matched] && --matched < 0) {
+            start = i;
+            break;
+        }
+    }
+    
+    int total = 0;
+    int previous = -1;
+    matched = 0;
+    for (int i = start; i <= end && matched < queryLength; ++i) {
+        if (text[i] != query[matched]) {
+            continue;
+        }
+        
+        int points = SCORE_MATCH;
+        if (i == 0) {
+            points += BONUS_TEXT_START + BONUS_WORD_START;
+        } else if (isSeparator(text[i - 1])) {
+            points += BONUS_WORD_START;
+        }
+        if (previous >= 0) {
+            points += i == previous + 1
+                ? BONUS_CONSECUTIVE
+                : -qMin(PENALTY_GAP * (i - previous - 1), MAX_GAP_PENALTY);
+        }
+        
+        total += points;
+        previous = i;
+        ++matched;
+    }
+    return total;
+}
+
+QList<TitleIndex::Match> TitleIndex::search(const QString& query, int limit,
+                                            const QVector<int> *within,
+                                            QVector<int> *matched) const
+{
+    TraceSpan span("TitleIndex::search", "index");
+    
+    const QString folded = foldQuery(query);
+    if (matched) {
+        matched->clear();
+    }
+    if (folded.isEmpty()) {
+        return {};
+    }
+    
+    const char16_t *needle = utf16(folded);
+    const int needleLength = int(folded.size());
+    const quint64 need = charMask(needle, needleLength);
+    
+    // Entries missing any character of the query can never match
+    std::vector<int> candidates;
+    if (within) {
+        candidates.reserve(within->size());
+        for (int entry : *within) {
+            if ((m_masks[entry] & need) == need) {
+                candidates.push_back(entry);
+            }
+        }
+    } else {
+        const size_t count = m_masks.size();
+        const quint64 *masks = m_masks.data();
+        std::vector<quint8> pass(count);
+        for (size_t i = 0; i < count; ++i) {
+            pass[i] = quint8((masks[i] & need) == need);
+        }
+        candidates.reserve(count / 4);
+        for (size_t i = 0; i < count; ++i) {
+            if (pass[i]) {
+                candidates.push_back(int(i));
+            }
+        }
+    }
+    
+    // Each chunk keeps its own best rows, so merging stays small
+    QList<ChunkResult> chunks;
+    const int count = int(candidates.size());
+    if (count <= CHUNK_SIZE) {
+        chunks.append(scoreChunk(needle, needleLength, candidates.data(), count, limit));
+    } else {
+        QList<int> starts;
+        for (int start = 0; start < count; start += CHUNK_SIZE) {
+            starts.append(start);
+        }
+        chunks = QtConcurrent::blockingMapped<QList<ChunkResult>>(starts, [&](int start) {
+            return scoreChunk(needle, needleLength, candidates.data() + start,
+                              qMin(CHUNK_SIZE, count - start), limit);
+        });
+    }
+    
+    std::vector<Match> results;
+    for (ChunkResult& chunk : chunks) {
+        results.insert(results.end(), chunk.best.begin(), chunk.best.end());
+        if (matched) {
+            matched->append(chunk.matched);
+        }
+    }
+    
+    const size_t shown = qMin(size_t(qMax(limit, 0)), results.size());
+    std::partial_sort(results.begin(), results.begin() + shown, results.end(),
+                      [this](const Match& a, const Match& b) { return ranksBefore(a, b); });
+    
+    return QList<Match>(results.begin(), results.begin() + shown);
+}
+
+TitleIndex::ChunkResult TitleIndex::scoreChunk(const char16_t *query, int queryLength,
+                                               const int *candidates, int count, int limit) const
+{
+    ChunkResult result;
+    result.matched.reserve(count);
+    
+    for (int i = 0; i < count; ++i) {
+        const int entry = candidates[i];
+        
+        // File names mostly repeat the title, so they are only scored
+        // when the title itself does not match
+        int best = score(query, queryLength, m_titleArena, m_titleSpans[entry]);
+        if (best < 0) {
+            best = score(query, queryLength, m_nameArena, m_nameSpans[entry]);
+            if (best < 0) {
+                continue;
+            }
+            best -= PENALTY_FILE_NAME;
+        }
+        
+        result.best.push_back(Match{ entry, best });
+        result.matched.append(entry);
+    }
+    
+    // Only the shown rows need to be ordered; shorter titles win ties
+    const size_t shown = qMin(size_t(qMax(limit, 0)), result.best.size());
+    std::partial_sort(result.best.begin(), result.best.begin() + shown, result.best.end(),
+                      [this](const Match& a, const Match& b) { return ranksBefore(a, b); });
+    result.best.resize(shown);
+    
+    return result;
+}
+
+bool TitleIndex::ranksBefore(const Match& a, const Match& b) const
+{
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    if (m_titleSpans[a.entry].length != m_titleSpans[b.entry].length) {
+        return m_titleSpans[a.entry].length < m_titleSpans[b.entry].length;
+    }
+    return a.entry < b.entry;
+}
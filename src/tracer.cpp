@@ -0,0 +1,203 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QSaveFile>
+#include <QMutexLocker>
+#include <QDebug>
+
+// Spans kept per thread; a power of two so the ring index is a mask
+static const quint64 RING_CAPACITY = 1 << 16;
+static const quint64 RING_MASK = RING_CAPACITY - 1;
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    qint64 start;
+    qint64 duration;
+};
+
+/**
+ * @brief Spans recorded by one thread
+ *
+ * Only the owning thread writes. It fills the slot first and then
+ * publishes it by advancing @c head, so a reader that loads @c head
+ * sees every slot below it; slots the writer may have lapped while they
+ * were being copied are dropped by re-reading @c head afterwards.
+ */
+struct TraceRing {
+    int threadId;
+    QString threadName;
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<quint64> head;
+};
+
+/**
+ * @brief The calling thread's ring, handed back when the thread exits
+ */
+struct TraceThread {
+    TraceRing *ring = nullptr;
+    
+    ~TraceThread()
+    {
+        if (ring) {
+            Tracer::instance().releaseThread(ring);
+            ring = nullptr;
+        }
+    }
+};
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+static thread_local TraceThread t_thread;
+
+static void appendEscaped(QByteArray& out, const char *text)
+{
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += *c;
+    }
+}
+
+static QByteArray microseconds(qint64 nanoseconds)
+{
+    return QByteArray::number(nanoseconds / 1000.0, 'f', 3);
+}
+
+Tracer& Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer()
+    : m_since(0)
+{
+    m_clock.start();
+}
+
+Tracer::~Tracer()
+{
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled && !isEnabled()) {
+        // Rings are never cleared under a running writer; earlier spans
+        // are hidden by their start time instead
+        m_since.store(now(), std::memory_order_relaxed);
+    }
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+TraceRing *Tracer::registerThread()
+{
+    QMutexLocker locker(&m_ringsMutex);
+    
+    // A reused ring keeps the spans of its earlier thread until they are
+    // overwritten; they never overlap the new thread's in time
+    TraceRing *ring;
+    if (!m_freeRings.empty()) {
+        ring = m_freeRings.back();
+        m_freeRings.pop_back();
+    } else {
+        m_rings.push_back(std::make_unique<TraceRing>());
+        ring = m_rings.back().get();
+        ring->threadId = int(m_rings.size());
+        ring->events.reset(new TraceEvent[RING_CAPACITY]);
+        ring->head.store(0, std::memory_order_relaxed);
+    }
+    
+    QThread *thread = QThread::currentThread();
+    ring->threadName = thread->objectName();
+    if (ring->threadName.isEmpty()) {
+        bool isGui = QCoreApplication::instance()
+                     && thread == QCoreApplication::instance()->thread();
+        ring->threadName = isGui ? QStringLiteral("GUI")
+                                 : QStringLiteral("Worker %1").arg(ring->threadId);
+    }
+    
+    return ring;
+}
+
+void Tracer::releaseThread(TraceRing *ring)
+{
+    QMutexLocker locker(&m_ringsMutex);
+    m_freeRings.push_back(ring);
+}
+
+void Tracer::record(const char *name, const char *category, qint64 start, qint64 duration)
+{
+    TraceRing *ring = t_thread.ring;
+    if (!ring) {
+        ring = t_thread.ring = registerThread();
+    }
+    
+    quint64 head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head & RING_MASK] = TraceEvent{name, category, start, duration};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool Tracer::writeChromeTrace(const QString& fileName) const
+{
+    const qint64 since = m_since.load(std::memory_order_relaxed);
+    
+    QByteArray out;
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"jrnl\"}}";
+    
+    QMutexLocker locker(&m_ringsMutex);
+    
+    for (const std::unique_ptr<TraceRing>& ring : m_rings) {
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+        out += QByteArray::number(ring->threadId);
+        out += ",\"args\":{\"name\":\"";
+        appendEscaped(out, ring->threadName.toUtf8().constData());
+        out += "\"}}";
+        
+        quint64 end = ring->head.load(std::memory_order_acquire);
+        quint64 begin = end > RING_CAPACITY ? end - RING_CAPACITY : 0;
+        
+        std::vector<TraceEvent> events;
+        events.reserve(end - begin);
+        for (quint64 i = begin; i < end; ++i) {
+            events.push_back(ring->events[i & RING_MASK]);
+        }
+        
+        // Drop whatever the owning thread overwrote while we were copying
+        quint64 after = ring->head.load(std::memory_order_acquire);
+        quint64 firstIntact = after > RING_CAPACITY ? after - RING_CAPACITY : 0;
+        size_t skip = firstIntact > begin ? size_t(qMin(firstIntact - begin, end - begin)) : 0;
+        
+        for (size_t i = skip; i < events.size(); ++i) {
+            const TraceEvent &event = events[i];
+            if (event.start < since) {
+                continue;
+            }
+            
+            out += ",\n{\"name\":\"";
+            appendEscaped(out, event.name);
+            out += "\",\"cat\":\"";
+            appendEscaped(out, event.category);
+            out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            out += QByteArray::number(ring->threadId);
+            out += ",\"ts\":";
+            out += microseconds(event.start);
+            out += ",\"dur\":";
+            out += microseconds(event.duration);
+            out += '}';
+        }
+    }
+    
+    locker.unlock();
+    out += "\n]}\n";
+    
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open trace file for writing:" << fileName;
+        return false;
+    }
+    file.write(out);
+    return file.commit();
+}